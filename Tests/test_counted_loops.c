@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../c/src/rr_machine.h"
+
+// Programs generated when no count is given
+#define DEFAULT_PROGRAMS 2000
+// Runs per program, each picking up where the last stopped
+#define RUNS_PER_PROGRAM 6
+// Cycles the last, unlimited run is allowed before the program is taken not to halt
+#define UNLIMITED_CYCLES 300000
+
+static u64 random_state = 88172645463325252ULL;
+
+// Closed-form runs that got past at least one trip through a loop body, and the cycles they stood in for
+// Counted by wrapping counted_loop_run at link time (-Wl,--wrap=counted_loop_run, see the Makefile)
+static u64 fast_forwards = 0;
+static u64 fast_forwarded_cycles = 0;
+
+u64 __real_counted_loop_run(const rr_counted_loop_t *loop, u8 *registers, u8 *flags, u64 max_cycles);
+
+u64 __wrap_counted_loop_run(const rr_counted_loop_t *loop, u8 *registers, u8 *flags, u64 max_cycles) {
+	
+	u64 cycles = __real_counted_loop_run(loop, registers, flags, max_cycles);
+	
+	// The ADC/BRA pair alone is 2 cycles, anything more skipped a body
+	if(cycles > 2) {
+		
+		fast_forwards++;
+		fast_forwarded_cycles += cycles;
+		
+	}
+	
+	return cycles;
+	
+}
+
+static u64 random_next() {
+	
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	
+	return random_state;
+	
+}
+
+// Returns 0 when both machines are in the same state between cycles
+static u8 machines_differ(const rr_machine_t *a, const rr_machine_t *b) {
+	
+	return a->program_counter != b->program_counter || a->status_register != b->status_register || a->instruction_register != b->instruction_register ||
+		memcmp(a->registers, b->registers, 16) || memcmp(a->memory, b->memory, 256);
+		
+}
+
+// Write a counted loop to memory - a few LDIs, a body of register-only instructions, ADC <counter> and a BRA back while Z is clear
+// The body sometimes writes the counter, so loops that can't be skipped are generated too
+static void write_loop(u8 *memory) {
+	
+	u8 p = 0;
+	u8 head;
+	u8 c;
+	u8 counter = random_next() & 0xF;
+	u8 step = random_next() & 0xF;
+	u8 prelude = random_next() % 4;
+	u8 body = random_next() % 6;
+	
+	if(step == counter)
+		step = (step + 1) & 0xF;
+		
+	for(c = 0; c < prelude; c++) {
+		
+		memory[p++] = 0x50 | (random_next() & 0xF);
+		memory[p++] = random_next();
+		
+	}
+	
+	head = p;
+	
+	for(c = 0; c < body; c++) {
+		
+		// ADC, AND, XOR, ROT, LDI, LDM, LDR or MDF
+		static const u8 opcodes[8] = {0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xF};
+		u8 opcode = opcodes[random_next() % 8];
+		u8 r = random_next() & 0xF;
+		u8 s = random_next() & 0xF;
+		u8 t = random_next() & 0xF;
+		
+		if((random_next() & 3) && r == counter)
+			r = (r + 2) & 0xF;
+			
+		if(opcode == 0xF) {
+			
+			memory[p++] = 0xF0 | (random_next() & 0xF);
+			memory[p++] = 0;
+			
+		}
+		else if(opcode == 0x7) {
+			
+			memory[p++] = 0x70;
+			memory[p++] = (r << 4) | s;
+			
+		}
+		else if(opcode >= 0x5) {
+			
+			memory[p++] = (opcode << 4) | r;
+			memory[p++] = random_next();
+			
+		}
+		else {
+			
+			memory[p++] = (opcode << 4) | r;
+			memory[p++] = (s << 4) | t;
+			
+		}
+		
+	}
+	
+	// Either operand order adds the step to the counter
+	memory[p++] = 0x10 | counter;
+	memory[p++] = random_next() & 1 ? (counter << 4) | step : (step << 4) | counter;
+	memory[p++] = 0xE8;
+	memory[p++] = head;
+	memory[p++] = 0x00;
+	memory[p++] = 0x00;
+	
+}
+
+// Counted loops run by the threaded interpreter (skipped to their exit by counted_loop_run) against the same loops stepped a cycle at a time by machine_step
+// Usage: test_counted_loops [<program count>]
+s32 main(s32 argc, const char **argv) {
+	
+	u32 programs = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_PROGRAMS;
+	u64 cycles = 0;
+	u32 program = 0;
+	rr_machine_t *fast = machine_new();
+	rr_machine_t *stepped = machine_new();
+	
+	if(!fast || !stepped)
+		return 1;
+		
+	for(; program < programs; program++) {
+		
+		u8 memory[256];
+		u16 c;
+		u8 run = 0;
+		
+		for(c = 0; c < 256; c++)
+			memory[c] = random_next();
+			
+		write_loop(memory);
+		
+		machine_reset(fast);
+		machine_reset(stepped);
+		
+		for(c = 0; c < 256; c++) {
+			
+			machine_poke(fast, c, memory[c]);
+			machine_poke(stepped, c, memory[c]);
+			
+		}
+		
+		for(c = 0; c < 16; c++)
+			fast->registers[c] = stepped->registers[c] = random_next();
+			
+		fast->status_register = stepped->status_register = random_next() & 0b11;
+		
+		// Short and long limits stop runs inside loops as well as after them, the last run goes to a halt
+		for(; run < RUNS_PER_PROGRAM && CURRENT_STATE(fast) != 0b11; run++) {
+			
+			u64 limit = run == RUNS_PER_PROGRAM - 1 ? UNLIMITED_CYCLES : random_next() & 1 ? 1 + random_next() % 40 : 1 + random_next() % 3000;
+			u64 expected = 0;
+			u64 ran;
+			
+			while(expected < limit) {
+				
+				expected++;
+				
+				if(machine_step(stepped, 0) == 0b11)
+					break;
+					
+			}
+			
+			ran = machine_run_fast(fast, limit);
+			cycles += ran;
+			
+			if(ran != expected || machines_differ(fast, stepped)) {
+				
+				fprintf(stderr, "Program %u, run %u: %" PRIu64 " cycles run, %" PRIu64 " stepped, PC %02X/%02X, SR %X/%X\n", program, run, ran, expected, fast->program_counter, stepped->program_counter, fast->status_register, stepped->status_register);
+				return 1;
+				
+			}
+			
+		}
+		
+	}
+	
+	// Matching proves nothing if no loop was ever skipped
+	if(programs && !fast_forwards) {
+		
+		fprintf(stderr, "Counted loops: no loop was fast-forwarded in %u programs\n", programs);
+		return 1;
+		
+	}
+	
+	fprintf(stdout, "Counted loops: %u programs and %" PRIu64 " cycles matched stepping, %" PRIu64 " fast-forwards stood in for %" PRIu64 " of the cycles\n", programs, cycles, fast_forwards, fast_forwarded_cycles);
+	
+	free(fast);
+	free(stepped);
+	
+	return 0;
+	
+}
\ No newline at end of file
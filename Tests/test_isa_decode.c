@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+#include "../c/src/rr_machine.h"
+#include "../c/src/rr_isa.h"
+
+// The switch decoder the tables in rr_isa.c replaced, kept as the reference they are checked against
+static void switch_decode(u16 instruction, u8 *operands) {
+	
+	u8 instr = instruction >> 12;
+	
+	memset(operands, 0, 4);
+	operands[0] = instr;
+	
+	switch(instr) {
+		
+		// HLT, RET - no operands
+		case 0x0:
+		case 0xD:
+			break;
+		// ADC, AND, XOR, ROT - _RST
+		case 0x1:
+		case 0x2:
+		case 0x3:
+		case 0x4:
+			operands[1] = (instruction >> 8) & 0xF;
+			operands[2] = (instruction >> 4) & 0xF;
+			operands[3] = instruction & 0xF;
+			break;
+		// LDI, LDM, STO - _RXX
+		case 0x5:
+		case 0x6:
+		case 0x8:
+			operands[1] = (instruction >> 8) & 0xF;
+			operands[2] = instruction & 0xFF;
+			break;
+		// LDR, STR - __RS
+		case 0x7:
+		case 0x9:
+			operands[1] = (instruction >> 4) & 0xF;
+			operands[2] = instruction & 0xF;
+			break;
+		// PSH, POP - _R__
+		case 0xA:
+		case 0xB:
+			operands[1] = (instruction >> 8) & 0xF;
+			break;
+		// JSR - __XX
+		case 0xC:
+			operands[1] = instruction & 0xFF;
+			break;
+		// BRA - _IXX
+		case 0xE:
+			operands[1] = (instruction >> 10) & 0x3;
+			operands[2] = (instruction >> 8) & 0x3;
+			operands[3] = instruction & 0xFF;
+			break;
+		// MDF - _I__
+		case 0xF:
+			operands[1] = (instruction >> 10) & 0x3;
+			operands[2] = (instruction >> 8) & 0x3;
+			break;
+			
+	}
+	
+}
+
+// Every instruction decoded by isa_decode and machine_decode_instruction against the switch decoder, and disassembled within ISA_TEXT_SIZE
+s32 main() {
+	
+	u32 instruction = 0;
+	u32 failures = 0;
+	
+	for(; instruction < 0x10000; instruction++) {
+		
+		u8 expected[4];
+		u8 table[4];
+		u8 machine[4];
+		char text[ISA_TEXT_SIZE + 16];
+		u32 length;
+		
+		switch_decode(instruction, expected);
+		isa_decode(instruction, table);
+		machine_decode_instruction(instruction, machine);
+		length = machine_disassemble(instruction, text);
+		
+		if(memcmp(expected, table, 4) || memcmp(expected, machine, 4) || length >= ISA_TEXT_SIZE || strncmp(text, isa_mnemonics[instruction >> 12], 3)) {
+			
+			if(failures++ < 16)
+				fprintf(stderr, "%04X: expected %X %02X %02X %02X, table %X %02X %02X %02X, machine %X %02X %02X %02X, \"%s\"\n", instruction,
+					expected[0], expected[1], expected[2], expected[3], table[0], table[1], table[2], table[3], machine[0], machine[1], machine[2], machine[3], text);
+					
+		}
+		
+	}
+	
+	if(failures) {
+		
+		fprintf(stderr, "ISA decode: %u of 65536 instructions differ from the switch decoder\n", failures);
+		return 1;
+		
+	}
+	
+	fprintf(stdout, "ISA decode: all 65536 instructions match the switch decoder\n");
+	
+	return 0;
+	
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../c/src/rr_machine.h"
+#include "../c/src/rr_lanes.h"
+
+// Lane sets run when no count is given
+#define DEFAULT_SETS 200
+// Not a multiple of LANE_GROUP, so the padded tail of each row is run too
+#define LANE_COUNT 75
+// Cycle limit for each lane, programs that don't halt are stopped here
+#define LANE_CYCLES 5000
+
+static u64 random_state = 2463534242ULL;
+
+static u64 random_next() {
+	
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	
+	return random_state;
+	
+}
+
+// Lanes run in lockstep by lanes_run against each lane's machine run alone by machine_run_fast
+// Half the sets share one program between lanes with different registers (lanes stay together), the rest give every lane its own memory (lanes split up)
+// Usage: test_lanes [<set count>]
+s32 main(s32 argc, const char **argv) {
+	
+	u32 sets = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_SETS;
+	u32 set = 0;
+	u64 cycles = 0;
+	rr_machine_t **machines = malloc(LANE_COUNT * sizeof(rr_machine_t *));
+	rr_machine_t *exported = machine_new();
+	u32 lane;
+	
+	if(!machines || !exported)
+		return 1;
+		
+	for(lane = 0; lane < LANE_COUNT; lane++)
+		if(!(machines[lane] = machine_new()))
+			return 1;
+			
+	for(; set < sets; set++) {
+		
+		rr_lanes_t *lanes = lanes_new(LANE_COUNT);
+		u8 shared = set & 1;
+		u8 program[256];
+		u16 c;
+		
+		if(!lanes)
+			return 1;
+			
+		for(c = 0; c < 256; c++)
+			program[c] = random_next();
+			
+		for(lane = 0; lane < LANE_COUNT; lane++) {
+			
+			rr_machine_t *machine = machines[lane];
+			
+			machine_reset(machine);
+			
+			for(c = 0; c < 256; c++)
+				machine_poke(machine, c, shared ? program[c] : random_next());
+				
+			for(c = 0; c < 16; c++)
+				machine->registers[c] = random_next();
+				
+			machine->status_register = random_next() & 0b11;
+			
+			if(lanes_import(lanes, lane, machine))
+				return 1;
+				
+		}
+		
+		lanes_run(lanes, LANE_CYCLES);
+		
+		for(lane = 0; lane < LANE_COUNT; lane++) {
+			
+			rr_machine_t *machine = machines[lane];
+			u64 ran = machine_run_fast(machine, LANE_CYCLES);
+			
+			if(lanes_export(lanes, lane, exported))
+				return 1;
+				
+			cycles += ran;
+			
+			if(ran != lanes->cycles[lane] || exported->program_counter != machine->program_counter || exported->status_register != machine->status_register ||
+				exported->instruction_register != machine->instruction_register || memcmp(exported->registers, machine->registers, 16) || memcmp(exported->memory, machine->memory, 256)) {
+				
+				fprintf(stderr, "Set %u, lane %u: %" PRIu64 " cycles in the lane, %" PRIu64 " alone, PC %02X/%02X, SR %X/%X\n", set, lane, lanes->cycles[lane], ran,
+					exported->program_counter, machine->program_counter, exported->status_register, machine->status_register);
+				return 1;
+				
+			}
+			
+		}
+		
+		lanes_free(lanes);
+		
+	}
+	
+	fprintf(stdout, "Lanes: %u sets of %u lanes and %" PRIu64 " cycles matched the scalar machine\n", sets, LANE_COUNT, cycles);
+	
+	for(lane = 0; lane < LANE_COUNT; lane++)
+		free(machines[lane]);
+		
+	free(machines);
+	free(exported);
+	
+	return 0;
+	
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/rr_machine.h"
+#include "src/rr_corpus.h"
+
+#define LINE_BUFFER_SIZE 4096
+
+// Read a 256 byte image, returns 1 if it can't be opened or is shorter than 256 bytes
+u8 read_image(const char *image_filename, u8 *image) {
+	
+	FILE *image_file = fopen(image_filename, "rb");
+	u8 failed;
+	
+	if(!image_file)
+		return 1;
+		
+	failed = fread(image, 1, 256, image_file) != 256;
+	fclose(image_file);
+	
+	return failed;
+	
+}
+
+// Apply "pc=<value>", "sr=<value>" or "r<0-15>=<value>" to state, returns 1 for anything else
+u8 parse_state(char *field, rr_machine_t *state) {
+	
+	char *value_str = strchr(field, '=');
+	u32 value;
+	
+	if(!value_str)
+		return 1;
+		
+	*value_str++ = 0;
+	value = strtoul(value_str[0] == '$' ? value_str + 1 : value_str, NULL, value_str[0] == '$' ? 16 : 0);
+	
+	if(!strcmp(field, "pc"))
+		state->program_counter = value;
+	else if(!strcmp(field, "sr"))
+		state->status_register = value & 0x0F;
+	else if(field[0] == 'r' && field[1] && strtoul(field + 1, NULL, 10) < 16)
+		state->registers[strtoul(field + 1, NULL, 10)] = value;
+	else
+		return 1;
+		
+	return 0;
+	
+}
+
+// Pack 256 byte memory images into one corpus file for corpus_open, each named after its path
+// A list file gives one image per line, optionally followed by the state to start it from - unset registers start at 0 and sp at $FF:
+// <image path> [pc=<value>] [sr=<value>] [r<0-15>=<value>]...
+// Usage: rr_corpus_pack <corpus file> [--list <list file>] [--no-names] [<image file>...]
+s32 main(s32 argc, const char **argv) {
+	
+	rr_corpus_builder_t *builder;
+	u8 image[256];
+	u8 names = 1;
+	u8 result;
+	s32 a = 2;
+	
+	if(argc < 3) {
+		
+		fprintf(stderr, "Usage: %s <corpus file> [--list <list file>] [--no-names] [<image file>...]\n", argv[0]);
+		return 1;
+		
+	}
+	
+	if(!(builder = corpus_builder_new()))
+		return 1;
+		
+	for(; a < argc; a++)
+		if(!strcmp(argv[a], "--no-names"))
+			names = 0;
+			
+	for(a = 2; a < argc; a++) {
+		
+		if(!strcmp(argv[a], "--no-names"))
+			continue;
+			
+		if(!strcmp(argv[a], "--list") && a + 1 < argc) {
+			
+			char line[LINE_BUFFER_SIZE];
+			FILE *list = fopen(argv[++a], "r");
+			u32 line_number = 0;
+			
+			if(!list) {
+				
+				fprintf(stderr, "Unable to open list %s\n", argv[a]);
+				corpus_builder_free(builder);
+				return 1;
+				
+			}
+			
+			while(fgets(line, LINE_BUFFER_SIZE, list)) {
+				
+				rr_machine_t state;
+				char *path = strtok(line, " \t\r\n");
+				char *field;
+				u8 has_state = 0;
+				
+				line_number++;
+				
+				if(!path || path[0] == '#')
+					continue;
+					
+				memset(&state, 0, sizeof(state));
+				STACK_POINTER((&state)) = 0xFF;
+				
+				while((field = strtok(NULL, " \t\r\n"))) {
+					
+					if(parse_state(field, &state)) {
+						
+						fprintf(stderr, "Unknown state %s on line %u of %s\n", field, line_number, argv[a]);
+						fclose(list);
+						corpus_builder_free(builder);
+						return 1;
+						
+					}
+					
+					has_state = 1;
+					
+				}
+				
+				if(read_image(path, image) || corpus_builder_add(builder, image, names ? path : NULL, has_state ? &state : NULL)) {
+					
+					fprintf(stderr, "Unable to pack %s\n", path);
+					fclose(list);
+					corpus_builder_free(builder);
+					return 1;
+					
+				}
+				
+			}
+			
+			fclose(list);
+			
+		}
+		else if(read_image(argv[a], image) || corpus_builder_add(builder, image, names ? argv[a] : NULL, NULL)) {
+			
+			fprintf(stderr, "Unable to pack %s\n", argv[a]);
+			corpus_builder_free(builder);
+			return 1;
+			
+		}
+		
+	}
+	
+	if((result = corpus_builder_write(builder, argv[1])))
+		fprintf(stderr, "Unable to write %s\n", argv[1]);
+	else
+		fprintf(stdout, "Packed %u images into %s\n", builder->image_count, argv[1]);
+		
+	corpus_builder_free(builder);
+	
+	return result;
+	
+}
\ No newline at end of file
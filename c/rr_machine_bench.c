@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/rr_machine.h"
+
+// Instruction encodings, two bytes each, for writing programs straight into arrays
+#define HLT() 0x00, 0x00
+#define ADC(r, s, t) 0x10 | (r), ((s) << 4) | (t)
+#define AND(r, s, t) 0x20 | (r), ((s) << 4) | (t)
+#define XOR(r, s, t) 0x30 | (r), ((s) << 4) | (t)
+#define ROT(r, s, t) 0x40 | (r), ((s) << 4) | (t)
+#define LDI(r, x) 0x50 | (r), (x)
+#define LDM(r, m) 0x60 | (r), (m)
+#define LDR(r, s) 0x70, ((r) << 4) | (s)
+#define STO(r, m) 0x80 | (r), (m)
+#define STR(r, s) 0x90, ((r) << 4) | (s)
+#define PSH(r) 0xA0 | (r), 0x00
+#define POP(r) 0xB0 | (r), 0x00
+#define JSR(x) 0xC0, (x)
+#define RET() 0xD0, 0x00
+#define BRA(i, x) 0xE0 | (i), (x)
+#define MDF(i) 0xF0 | (i), 0x00
+
+// BRA conditions and MDF settings (which flags, then their states)
+#define ALWAYS 0x0
+#define IF_NOT_ZERO 0x8
+#define IF_ZERO 0xA
+#define CLEAR_CARRY 0x4
+
+#define BENCH_MODES 2
+#define BENCH_MAX_RESULTS 64
+// Default minimum time spent on each measurement, measurements per result (the median is kept), and slowdown against the baseline reported as a regression
+#define BENCH_DEFAULT_SECONDS 0.1
+#define BENCH_DEFAULT_REPEAT 5
+#define BENCH_MAX_REPEAT 31
+#define BENCH_DEFAULT_THRESHOLD 30.0
+
+typedef struct bench_program_d {
+	const char *name;
+	const u8 *code;
+	u32 size;
+} bench_program_t;
+
+typedef struct bench_result_d {
+	char name[32];
+	char mode[8];
+	f64 ns_per_instruction;
+} bench_result_t;
+
+// Loop counters count up by r2 (1) until they wrap to zero - ADC adds the carry too, so it is cleared before each count
+
+// 256 * 256 ADC/BRA pairs in the inner loop, twice over
+const u8 bench_adc_loop[] = {
+	LDI(2, 1),					// 00
+	LDI(3, 0xFE),				// 02 outer counter (2 trips)
+	LDI(1, 0),					// 04 inner counter
+	ADC(1, 1, 2),				// 06 inner loop
+	BRA(IF_NOT_ZERO, 0x06),		// 08
+	MDF(CLEAR_CARRY),			// 0A
+	ADC(4, 4, 2),				// 0C middle counter
+	BRA(IF_NOT_ZERO, 0x04),		// 0E
+	MDF(CLEAR_CARRY),			// 10
+	ADC(3, 3, 2),				// 12
+	BRA(IF_NOT_ZERO, 0x04),		// 14
+	HLT()						// 16
+};
+
+// Rotates in both directions mixed with XOR/AND, 256 * 256 trips
+const u8 bench_rot[] = {
+	LDI(2, 1),					// 00
+	LDI(5, 0x5A),				// 02 data
+	LDI(6, 0x03),				// 04 rotate left 3
+	LDI(7, 0x0D),				// 06 rotate right 5
+	ROT(5, 5, 6),				// 08 loop
+	ROT(8, 5, 7),				// 0A
+	XOR(5, 5, 8),				// 0C
+	ROT(9, 8, 6),				// 0E
+	ROT(10, 9, 7),				// 10
+	AND(11, 10, 5),				// 12
+	XOR(5, 5, 11),				// 14
+	MDF(CLEAR_CARRY),			// 16
+	ADC(4, 4, 2),				// 18
+	BRA(IF_NOT_ZERO, 0x08),		// 1A
+	MDF(CLEAR_CARRY),			// 1C
+	ADC(3, 3, 2),				// 1E
+	BRA(IF_NOT_ZERO, 0x08),		// 20
+	HLT()						// 22
+};
+
+// Recursion 64 calls deep, 256 * 16 times
+const u8 bench_recursion[] = {
+	LDI(2, 1),					// 00
+	LDI(4, 0xF0),				// 02 outer counter
+	LDI(1, 0xC0),				// 04 depth
+	JSR(0x16),					// 06
+	MDF(CLEAR_CARRY),			// 08
+	ADC(3, 3, 2),				// 0A
+	BRA(IF_NOT_ZERO, 0x04),		// 0C
+	MDF(CLEAR_CARRY),			// 0E
+	ADC(4, 4, 2),				// 10
+	BRA(IF_NOT_ZERO, 0x04),		// 12
+	HLT(),						// 14
+	MDF(CLEAR_CARRY),			// 16 recurse until the depth wraps to zero
+	ADC(1, 1, 2),				// 18
+	BRA(IF_ZERO, 0x1E),			// 1A
+	JSR(0x16),					// 1C
+	RET()						// 1E
+};
+
+// Balanced pushes and pops shuffling registers through the stack, 256 * 256 trips
+const u8 bench_stack[] = {
+	LDI(2, 1),					// 00
+	LDI(1, 0x11),				// 02
+	PSH(1),						// 04 loop
+	PSH(2),						// 06
+	PSH(3),						// 08
+	PSH(5),						// 0A
+	POP(6),						// 0C
+	POP(7),						// 0E
+	PSH(6),						// 10
+	PSH(7),						// 12
+	POP(5),						// 14
+	POP(3),						// 16
+	POP(8),						// 18
+	POP(9),						// 1A
+	MDF(CLEAR_CARRY),			// 1C
+	ADC(10, 10, 2),				// 1E
+	BRA(IF_NOT_ZERO, 0x04),		// 20
+	MDF(CLEAR_CARRY),			// 22
+	ADC(4, 4, 2),				// 24
+	BRA(IF_NOT_ZERO, 0x04),		// 26
+	HLT()						// 28
+};
+
+// The inner counter lives in the LDI's immediate byte, rewritten every trip, 256 * 256 trips
+const u8 bench_self_modifying[] = {
+	LDI(2, 1),					// 00
+	LDI(3, 0),					// 02
+	LDI(5, 0),					// 04 immediate at 05 is the counter
+	MDF(CLEAR_CARRY),			// 06
+	ADC(5, 5, 2),				// 08
+	STO(5, 0x05),				// 0A
+	BRA(IF_NOT_ZERO, 0x04),		// 0C
+	MDF(CLEAR_CARRY),			// 0E
+	ADC(4, 4, 2),				// 10
+	BRA(IF_NOT_ZERO, 0x04),		// 12
+	HLT()						// 14
+};
+
+const bench_program_t bench_programs[] = {
+	{"adc_loop", bench_adc_loop, sizeof(bench_adc_loop)},
+	{"rot", bench_rot, sizeof(bench_rot)},
+	{"recursion", bench_recursion, sizeof(bench_recursion)},
+	{"stack", bench_stack, sizeof(bench_stack)},
+	{"self_modifying", bench_self_modifying, sizeof(bench_self_modifying)}
+};
+
+const char *bench_modes[BENCH_MODES] = {"full", "part"};
+
+f64 bench_seconds() {
+	
+#if defined(_WIN32)
+	LARGE_INTEGER counter, frequency;
+	
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	
+	return (f64)counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+	
+}
+
+// Run the program from a fresh machine through machine_run as many times as fit in min_seconds, returning host nanoseconds per guest instruction
+f64 bench_measure(const rr_machine_t *image, u8 part_step, u64 cycles_per_run, f64 min_seconds, rr_machine_t *machine) {
+	
+	u64 runs = 0;
+	f64 start = bench_seconds();
+	f64 elapsed;
+	
+	do {
+		
+		*machine = *image;
+		machine_run(machine, part_step, 0);
+		runs++;
+		
+		elapsed = bench_seconds() - start;
+		
+	} while(elapsed < min_seconds);
+	
+	return elapsed * 1e9 / (runs * cycles_per_run);
+	
+}
+
+// Measure repeat times and return the median, so one run slowed by the host doesn't decide the result
+f64 bench_median(const rr_machine_t *image, u8 part_step, u64 cycles_per_run, f64 min_seconds, u32 repeat, rr_machine_t *machine) {
+	
+	f64 samples[BENCH_MAX_REPEAT];
+	u32 c = 0;
+	
+	for(; c < repeat; c++) {
+		
+		f64 sample = bench_measure(image, part_step, cycles_per_run, min_seconds, machine);
+		u32 s = c;
+		
+		// Insertion sort as they come in
+		for(; s > 0 && samples[s - 1] > sample; s--)
+			samples[s] = samples[s - 1];
+			
+		samples[s] = sample;
+		
+	}
+	
+	return repeat & 1 ? samples[repeat / 2] : (samples[repeat / 2 - 1] + samples[repeat / 2]) / 2;
+	
+}
+
+// Read "<program> <mode> <ns per instruction>" lines, skipping blank lines and # comments
+u32 bench_load_baseline(const char *baseline_filename, bench_result_t *results) {
+	
+	FILE *baseline = fopen(baseline_filename, "r");
+	char line[128];
+	u32 count = 0;
+	
+	if(!baseline)
+		return 0;
+		
+	while(count < BENCH_MAX_RESULTS && fgets(line, sizeof(line), baseline))
+		if(line[0] != '#' && sscanf(line, "%31s %7s %lf", results[count].name, results[count].mode, &results[count].ns_per_instruction) == 3)
+			count++;
+			
+	fclose(baseline);
+	
+	return count;
+	
+}
+
+u8 bench_save_baseline(const char *baseline_filename, const bench_result_t *results, u32 count) {
+	
+	FILE *baseline = fopen(baseline_filename, "w");
+	u32 c = 0;
+	
+	if(!baseline)
+		return 1;
+		
+	fprintf(baseline, "# program mode ns_per_instruction\n");
+	
+	for(; c < count; c++)
+		fprintf(baseline, "%s %s %.4f\n", results[c].name, results[c].mode, results[c].ns_per_instruction);
+		
+	return fclose(baseline) != 0;
+	
+}
+
+// Benchmark machine_run in full and part cycle mode on a set of representative programs
+// Usage: rr_machine_bench [--baseline <file>] [--save <file>] [--seconds <per measurement>] [--repeat <measurements>] [--threshold <percent>]
+// Each result is the median of repeat measurements, with a baseline each is compared against it and the exit status is 1 if any is slower by more than the threshold
+s32 main(s32 argc, const char **argv) {
+	
+	const char *baseline_filename = NULL;
+	const char *save_filename = NULL;
+	f64 min_seconds = BENCH_DEFAULT_SECONDS;
+	u32 repeat = BENCH_DEFAULT_REPEAT;
+	f64 threshold = BENCH_DEFAULT_THRESHOLD;
+	bench_result_t baseline[BENCH_MAX_RESULTS];
+	bench_result_t results[BENCH_MAX_RESULTS];
+	u32 baseline_count = 0;
+	u32 result_count = 0;
+	u8 regressed = 0;
+	rr_machine_t *image = machine_new();
+	rr_machine_t *machine = machine_new();
+	s32 c;
+	u32 p;
+	
+	for(c = 1; c < argc; c++) {
+		
+		if(!strcmp(argv[c], "--baseline") && c + 1 < argc)
+			baseline_filename = argv[++c];
+		else if(!strcmp(argv[c], "--save") && c + 1 < argc)
+			save_filename = argv[++c];
+		else if(!strcmp(argv[c], "--seconds") && c + 1 < argc)
+			min_seconds = atof(argv[++c]);
+		else if(!strcmp(argv[c], "--repeat") && c + 1 < argc && (repeat = strtoul(argv[c + 1], NULL, 10)) >= 1 && repeat <= BENCH_MAX_REPEAT)
+			c++;
+		else if(!strcmp(argv[c], "--threshold") && c + 1 < argc)
+			threshold = atof(argv[++c]);
+		else {
+			
+			fprintf(stderr, "Usage: %s [--baseline <file>] [--save <file>] [--seconds <per measurement>] [--repeat <1-%u measurements>] [--threshold <percent>]\n", argv[0], BENCH_MAX_REPEAT);
+			return 2;
+			
+		}
+		
+	}
+	
+	if(baseline_filename && !(baseline_count = bench_load_baseline(baseline_filename, baseline)))
+		fprintf(stderr, "No baseline results in %s\n", baseline_filename);
+		
+	fprintf(stdout, "%-16s %-5s %12s %10s %8s %10s\n", "program", "mode", "instructions", "ns/instr", "MIPS", "baseline");
+	
+	for(p = 0; p < sizeof(bench_programs) / sizeof(bench_program_t); p++) {
+		
+		const bench_program_t *program = &bench_programs[p];
+		rr_machine_t full_end;
+		u64 cycles;
+		u8 mode;
+		
+		machine_reset(image);
+		machine_clear_memory(image);
+		memcpy(image->memory, program->code, program->size);
+		
+		// Count the instructions once, and check both modes end in the same state
+		*machine = *image;
+		cycles = machine_run_fast(machine, 0);
+		full_end = *machine;
+		
+		*machine = *image;
+		machine_run(machine, 1, 0);
+		
+		if(memcmp(machine->registers, full_end.registers, 16) || memcmp(machine->memory, full_end.memory, 256) || machine->program_counter != full_end.program_counter) {
+			
+			fprintf(stderr, "%s ends differently in part and full cycle mode\n", program->name);
+			return 1;
+			
+		}
+		
+		for(mode = 0; mode < BENCH_MODES; mode++) {
+			
+			bench_result_t *result = &results[result_count++];
+			u32 b;
+			
+			strcpy(result->name, program->name);
+			strcpy(result->mode, bench_modes[mode]);
+			result->ns_per_instruction = bench_median(image, mode, cycles, min_seconds, repeat, machine);
+			
+			fprintf(stdout, "%-16s %-5s %12" PRIu64 " %10.3f %8.1f", result->name, result->mode, cycles, result->ns_per_instruction, 1e3 / result->ns_per_instruction);
+			
+			for(b = 0; b < baseline_count; b++)
+				if(!strcmp(baseline[b].name, result->name) && !strcmp(baseline[b].mode, result->mode)) {
+					
+					f64 change = (result->ns_per_instruction / baseline[b].ns_per_instruction - 1) * 100;
+					
+					fprintf(stdout, " %+9.1f%%%s", change, change > threshold ? " REGRESSION" : "");
+					regressed |= change > threshold;
+					
+					break;
+					
+				}
+				
+			fprintf(stdout, "\n");
+			
+		}
+		
+	}
+	
+	if(save_filename && bench_save_baseline(save_filename, results, result_count)) {
+		
+		fprintf(stderr, "Unable to write baseline %s\n", save_filename);
+		return 1;
+		
+	}
+	
+	free(image);
+	free(machine);
+	
+	return regressed;
+	
+}
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/rr_machine.h"
+#include "src/rr_server.h"
+
+#if defined(__unix__)
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#define INPUT_BUFFER_SIZE 4096
+
+#if defined(__unix__)
+// Read exactly length bytes, returns 1 if the connection ends first
+u8 read_all(s32 fd, u8 *buffer, u32 length) {
+	
+	while(length) {
+		
+		ssize_t received = read(fd, buffer, length);
+		
+		if(received <= 0) {
+			
+			if(received < 0 && errno == EINTR)
+				continue;
+				
+			return 1;
+			
+		}
+		
+		buffer += received;
+		length -= received;
+		
+	}
+	
+	return 0;
+	
+}
+
+// Print the machine through the binary fast path, laid out like dump
+u8 print_state(s32 fd) {
+	
+	u8 request[SERVER_BINARY_SIZE] = {0, SERVER_READ_STATE, 0, 0};
+	u8 reply[SERVER_BINARY_HEADER_SIZE + SERVER_STATE_SIZE];
+	u8 *state = reply + SERVER_BINARY_HEADER_SIZE;
+	u8 row = 0;
+	u8 column;
+	
+	if(write(fd, request, SERVER_BINARY_SIZE) != SERVER_BINARY_SIZE || read_all(fd, reply, SERVER_BINARY_HEADER_SIZE + SERVER_STATE_SIZE) || reply[2] + (reply[3] << 8) != SERVER_STATE_SIZE)
+		return 1;
+		
+	fprintf(stdout, "PC: [%02X] IR: [%04X] SR: [%02X]\n", state[0], state[2] | (state[3] << 8), state[1]);
+	fprintf(stdout, "    0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F       R\n");
+	
+	for(; row < 0x10; row++) {
+		
+		fprintf(stdout, "%X", row);
+		
+		for(column = 0; column < 0x10; column++)
+			fprintf(stdout, " [%02X]", state[SERVER_REGISTERS_SIZE + row * 0x10 + column]);
+			
+		fprintf(stdout, row < 0xF ? "    [%02X]\n" : "  SP[%02X]\n", state[4 + row]);
+		
+	}
+	
+	return 0;
+	
+}
+#endif
+
+// Send commands to rr_machine_server from stdin (leave a blank line to exit), printing the replies, or print the machine's state with --state
+// Usage: rr_machine_client <socket path> [--state]
+s32 main(s32 argc, const char **argv) {
+	
+#if defined(__unix__)
+	char buffer[INPUT_BUFFER_SIZE];
+	struct sockaddr_un address;
+	// Start of the reply line being read, and its length so far
+	char reply[4];
+	u32 reply_length = 0;
+	// Commands sent but not yet answered
+	u64 pending = 0;
+	u8 input_open = 1;
+	u8 line_start = 1;
+	s32 fd;
+	
+	if(argc < 2 || strlen(argv[1]) >= sizeof(address.sun_path)) {
+		
+		fprintf(stderr, "Usage: %s <socket path> [--state]\n", argv[0]);
+		return 1;
+		
+	}
+	
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, argv[1]);
+	
+	if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+		
+		fprintf(stderr, "Unable to connect to %s\n", argv[1]);
+		return 1;
+		
+	}
+	
+	if(argc > 2 && !strcmp(argv[2], "--state")) {
+		
+		u8 result = print_state(fd);
+		
+		if(result)
+			fprintf(stderr, "Bad reply from %s\n", argv[1]);
+			
+		close(fd);
+		
+		return result;
+		
+	}
+	
+	// Commands go out as they are typed and replies are printed as they come, so a stop can follow a run still going
+	while(input_open || pending) {
+		
+		struct pollfd fds[2] = {{fd, POLLIN, 0}, {input_open ? 0 : -1, POLLIN, 0}};
+		ssize_t length;
+		ssize_t c = 0;
+		
+		if(poll(fds, 2, -1) < 0) {
+			
+			if(errno == EINTR)
+				continue;
+				
+			break;
+			
+		}
+		
+		if(fds[1].revents) {
+			
+			length = read(0, buffer, INPUT_BUFFER_SIZE);
+			
+			// A last line without its newline is still sent as a whole line
+			if(length <= 0) {
+				
+				if(!line_start && write(fd, "\n", 1) == 1)
+					pending++;
+					
+				input_open = 0;
+				length = 0;
+				
+			}
+			
+			// Stop at the first blank line
+			for(; c < length; c++) {
+				
+				if(buffer[c] == '\n') {
+					
+					if(line_start) {
+						
+						input_open = 0;
+						break;
+						
+					}
+					
+					pending++;
+					
+				}
+				
+				line_start = buffer[c] == '\n';
+				
+			}
+			
+			if(c && write(fd, buffer, c) != c)
+				break;
+				
+		}
+		
+		if(fds[0].revents) {
+			
+			if((length = read(fd, buffer, INPUT_BUFFER_SIZE)) <= 0)
+				break;
+				
+			fwrite(buffer, 1, length, stdout);
+			
+			// Every command is answered with its output then an OK or ERR line
+			for(c = 0; c < length; c++) {
+				
+				if(buffer[c] != '\n') {
+					
+					if(reply_length < 4)
+						reply[reply_length] = buffer[c];
+						
+					reply_length++;
+					
+				}
+				else {
+					
+					if((reply_length == 2 && !strncmp(reply, "OK", 2)) || (reply_length >= 4 && !strncmp(reply, "ERR ", 4)))
+						pending--;
+						
+					reply_length = 0;
+					
+				}
+				
+			}
+			
+			fflush(stdout);
+			
+		}
+		
+	}
+	
+	close(fd);
+	
+	return 0;
+#else
+	fprintf(stderr, "Unix domain sockets are not supported on this platform\n");
+	return 1;
+#endif
+	
+}
\ No newline at end of file
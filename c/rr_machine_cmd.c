@@ -3,6 +3,24 @@
 #include <string.h>
 #include <ctype.h>
 #include "src/rr_machine.h"
+#include "src/rr_jit.h"
+#include "src/rr_batch.h"
+#include "src/rr_history.h"
+#include "src/rr_trace.h"
+#include "src/rr_profile.h"
+#include "src/rr_memo.h"
+#include "src/rr_pace.h"
+#include "src/rr_snapshot.h"
+#include "src/rr_isa.h"
+#include "src/rr_observe.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#define STDIN_IS_TERMINAL() _isatty(_fileno(stdin))
+#else
+#include <unistd.h>
+#define STDIN_IS_TERMINAL() isatty(STDIN_FILENO)
+#endif
 
 // Just for use inside the run command function
 // Kind of ugly, but I got tired of copying/typing this stuff
@@ -33,11 +51,51 @@
 
 #define INPUT_BUFFER_SIZE 4096
 #define OP_1_BUFFER_SIZE (INPUT_BUFFER_SIZE - 5)
-#define OP_2_BUFFER_SIZE 7
+// Room for a 64 bit cycle count in decimal
+#define OP_2_BUFFER_SIZE 21
+// Instructions listed by "disasm" when no count is given
+#define DISASSEMBLE_DEFAULT_COUNT 16
+// Entries shown in each ranking of "run profile"
+#define PROFILE_REPORT_TOP 10
+#define OPERAND_COUNT 4
 
-#define COMMAND_SIZE 5
-#define COMMAND_COUNT 10
+#define COMMAND_SIZE 7
+#define COMMAND_COUNT 21
 #define SPECIAL_LOC_COUNT 5
+#define RUN_MODE_COUNT 10
+
+// Command numbers, in the same order as the help text
+#define CMD_SAVE 0
+#define CMD_LOAD 1
+#define CMD_STEP 2
+#define CMD_RUN 3
+#define CMD_POKE 4
+#define CMD_PEEK 5
+#define CMD_DUMP 6
+#define CMD_DIFF 7
+#define CMD_DIS 8
+#define CMD_BREAK 9
+#define CMD_WATCH 10
+#define CMD_UNWATCH 11
+#define CMD_RESET 12
+#define CMD_CLEAR 13
+#define CMD_UNTIL 14
+#define CMD_BATCH 15
+#define CMD_TRACE 16
+#define CMD_SNAP 17
+#define CMD_SEEK 18
+#define CMD_HISTORY 19
+#define CMD_HELP 20
+#define CMD_UNKNOWN 0xFF
+
+// Slots in the command hash table - COMMAND_HASH is collision free over the command names at this size
+#define COMMAND_HASH_SIZE 64
+#define COMMAND_HASH(name, length) (((name)[0] + ((name)[1] << 3) + (length) * 5) & (COMMAND_HASH_SIZE - 1))
+
+// Output of a script is collected in a buffer this size and written out whenever it fills
+#define SCRIPT_OUTPUT_BUFFER_SIZE (1 << 22)
+// Commands a script's command list starts with room for, doubling as needed
+#define SCRIPT_INITIAL_COMMANDS 1024
 
 const char *state_names[4] = {
 	"Fetch\0",
@@ -46,48 +104,92 @@ const char *state_names[4] = {
 	"Halt\0"
 };
 
-const char instruction_mnemonics[16][4] = {
-	"HLT\0",
-	"ADC\0",
-	"AND\0",
-	"XOR\0",
-	"ROT\0",
-	"LDI\0",
-	"LDM\0",
-	"LDR\0",
-	"STO\0",
-	"STR\0",
-	"PSH\0",
-	"POP\0",
-	"JSR\0",
-	"RET\0",
-	"BRA\0",
-	"MDF\0"
+// One parsed line of a script
+typedef struct script_command_d {
+	u8 command;
+	// Point into the script's text, or at an empty string when not given
+	char *operands[OPERAND_COUNT];
+} script_command_t;
+
+const char *command_names[COMMAND_COUNT] = {
+	"save", "load", "step", "run", "poke", "peek", "dump", "diff", "disasm", "break",
+	"watch", "unwatch", "reset", "clear", "until", "batch", "trace", "snap", "seek", "history", "help"
 };
 
+// Command number + 1 for each hash slot a command name lands in, 0 for empty slots
+u8 command_hash[COMMAND_HASH_SIZE];
+
+// Holds stdout's output while a script runs
+char script_output[SCRIPT_OUTPUT_BUFFER_SIZE];
+
 const char *command_helptext[COMMAND_COUNT << 1] = {
-	"save <file path>\0",
-	"saves the current main memory contents to a binary file\0",
-	"load <file path>\0",
-	"loads main memory with the contents of a 256 byte binary file\0",
-	"step [<part|full>,<number of steps>]\0",
-	"steps the machine in parts or full steps (full if not specified), number of steps defaults to 1 if not specified\0",
-	"run [<part|full>,<delay>]\0",
-	"runs the machine in partial or full steps (full if not specified) with an optional delay in milliseconds\0",
+	"save <file path>[,state]\0",
+	"saves the current main memory contents to a binary file, or with state the whole machine state to a snapshot file\0",
+	"load <file path>[,state]\0",
+	"loads main memory with the contents of a 256 byte binary file, or with state the whole machine state from a snapshot file\0",
+	"step [<part|full|back>,<number of steps>]\0",
+	"steps the machine in parts or full steps (full if not specified), or back through earlier full steps while history is on, number of steps defaults to 1 if not specified\0",
+	"run [<mode+>]\0",
+	"runs the machine in the given mode (full if not specified), an undelayed full run stops at any breakpoints and watchpoints set\0",
 	"poke <location^>,<value>\0",
 	"sets a given memory location to the specified value\0",
 	"peek <location^>\0",
 	"view a given memory location's value\0",
 	"dump\0",
 	"print all machine contents (main memory, general purpose registers, status register, instruction register, program counter\0",
+	"diff\0",
+	"print only the machine contents written since the last diff (everything loaded, stepped, run or poked in the meantime)\0",
+	"disasm [<address>[,<count>]]\0",
+	"disassembles count instructions (16 if not specified) starting from the address, or the program counter if not specified\0",
+	"break [<address>]\0",
+	"sets a breakpoint, so undelayed full runs, full steps and until stop before running the instruction at the address (part steps as they are about to fetch it), or lists the breakpoints and watchpoints set if no address is given\0",
+	"watch <address>[,<r|w|rw>]\0",
+	"sets a watchpoint, so undelayed full runs, full steps and until stop after an instruction reads and/or writes the memory cell at the address (both if not specified)\0",
+	"unwatch <address|all>\0",
+	"removes the breakpoint and watchpoints at the address, or all of them\0",
 	"reset\0",
 	"resets machine registers\0",
 	"clear\0",
-	"clears machine memory\0"
+	"clears machine memory\0",
+	"until <condition>[|<condition>...][,<max cycles>]\0",
+	"runs full cycles until a halt, the cycle limit or just before a cycle where any of the conditions holds: pc=<address>, r<0-15>=<value>, sp=<value>, m<address>=<value>, m<address> (changes), depth><count> (stack elements)\0",
+	"batch <manifest path>\0",
+	"runs every image listed in a manifest on worker threads, writing final memory images and stats.csv to the manifest's output directory\0",
+	"trace <file path>[,<max cycles>]\0",
+	"runs full cycles until a halt or the cycle limit, recording every cycle to a binary trace file (read it back with rr_trace_read)\0",
+	"snap <file path>,<interval>[,<max cycles>]\0",
+	"runs full cycles until a halt or the cycle limit, writing the machine state to a delta-encoded snapshot stream every interval cycles\0",
+	"seek <file path>,<cycle>\0",
+	"restores the machine state from the last snapshot in a stream at or before the given cycle\0",
+	"history [<on|off>]\0",
+	"turns recording for step back and run back on or off (off to start with, as recording slows step, run and until down), or reports whether it is on and the cycles recorded\0",
 	"help\0",
 	"display all valid commands\0"
 };
 
+const char *run_mode_helptext[RUN_MODE_COUNT << 1] = {
+	"part[,<delay>]\0",
+	"runs part steps with an optional delay in milliseconds between them, kept to deadlines from the start of the run\0",
+	"full[,<delay>]\0",
+	"the same in full steps\0",
+	"fast[,<max cycles>]\0",
+	"times an undelayed run through the threaded interpreter\0",
+	"jit[,<max cycles>]\0",
+	"times an undelayed run through translated code\0",
+	"detect[,<max cycles>]\0",
+	"stops at an infinite loop, reporting where it starts and its period\0",
+	"profile[,<max cycles>]\0",
+	"reports hot loops, calls, opcodes and memory use\0",
+	"memo[,<max cycles>]\0",
+	"serves repeated subroutine calls from earlier runs of them, reporting hits and misses\0",
+	"observe[,<max cycles>]\0",
+	"sends every cycle to a batched observer, reporting the events and rate\0",
+	"pace,<hz>[,part|full][,<max steps>]\0",
+	"steps at a fixed rate (fractions of a Hz included), reporting the rate achieved and timing jitter\0",
+	"back[,until <condition>[|<condition>...][,<max cycles>]]\0",
+	"steps back while history is on, to the start of the history or the first earlier state where a condition held\0"
+};
+
 const char *location_helptext[SPECIAL_LOC_COUNT << 1] = {
 	"r[0-15]\0",
 	"(registers)\0",
@@ -101,74 +203,295 @@ const char *location_helptext[SPECIAL_LOC_COUNT << 1] = {
 	"(status register) - poking may lead to undefined behavior\0"
 };
 
+// Translated code for "run jit", created on first use
+rr_jit_t *user_jit = NULL;
+
+// Undo log for "step back" and "run back", kept for every step, run and until from "history on" to "history off" (NULL in between)
+// Off by default, so run and until keep the threaded interpreter and compiled conditions and no records are allocated
+rr_history_t *user_history = NULL;
+
+// Recorded calls for "run memo", created on first use and kept across runs and loads
+rr_memo_t *user_memo = NULL;
+
+// Breakpoints and watchpoints for full cycle runs, kept across loads
+rr_watch_t user_watch;
+
+// Paths and condition lists can be long, counts and values are short - "run back until <conditions>,<max cycles>" uses all four
+const u16 operand_sizes[OPERAND_COUNT] = {
+	OP_1_BUFFER_SIZE,
+	OP_2_BUFFER_SIZE,
+	OP_1_BUFFER_SIZE,
+	OP_2_BUFFER_SIZE
+};
+
 u8 string_to_unsigned(char *str, void *value_ptr, u8 value_bytes);
+f64 seconds_now();
 void string_to_lower(char *dest, char *src);
 void help_command(char *cmd);
+void display_run_modes();
 void display_helptext();
-u8 run_command(rr_machine_t *machine, char *cmd, char **operands);
+u8 command_lookup(const char *name);
+u8 run_command(rr_machine_t *machine, u8 command, char **operands);
+u8 run_script(rr_machine_t *machine, FILE *script);
+void print_dump(rr_machine_t *machine);
+void print_changes(rr_machine_t *machine);
+u8 parse_conditions(char *condition, rr_conditions_t *conditions);
+void print_stop(rr_machine_t *machine, rr_stop_t *stop);
+void count_events(const rr_event_t *events, u32 count, void *context);
+u64 record_steps(rr_machine_t *machine, u8 part_step, u64 steps, void *context);
 
+// Usage: rr_machine_cmd [--script <file>]
+// Commands are read from the terminal a line at a time, or run as a script from the file or from stdin when it isn't a terminal
 s32 main(s32 argc, const char **argv) {
-	
+
 	// User input buffer
 	char input_buffer[INPUT_BUFFER_SIZE];
 	char *token_str;
 	char command_buffer[COMMAND_SIZE + 1];
-	char *operand_buffers[2];
-	
-	// Allocate space for 4090 character file path
-	operand_buffers[0] = (char *)malloc(OP_1_BUFFER_SIZE);
-	// Allocate space for delay/step count/value - works with just hexadecimal
-	operand_buffers[1] = (char *)malloc(OP_2_BUFFER_SIZE);
-	
+	char *operand_buffers[OPERAND_COUNT];
+	FILE *script = NULL;
+	u8 c;
+
+	if(argc == 3 && !strcmp(argv[1], "--script")) {
+		
+		if(!(script = fopen(argv[2], "rb"))) {
+			fprintf(stderr, "Could not open script %s\n", argv[2]);
+			return 1;
+		}
+		
+	}
+	else if(argc > 1) {
+		fprintf(stderr, "Usage: %s [--script <file>]\n", argv[0]);
+		return 1;
+	}
+	else if(!STDIN_IS_TERMINAL())
+		script = stdin;
+
+	// Has to come before anything is written
+	if(script)
+		setvbuf(stdout, script_output, _IOFBF, SCRIPT_OUTPUT_BUFFER_SIZE);
+
+	for(c = 0; c < COMMAND_COUNT; c++)
+		command_hash[COMMAND_HASH(command_names[c], strlen(command_names[c]))] = c + 1;
+
+	// Allocate space for 4090 character file paths and delay/step count/value
+	for(c = 0; c < OPERAND_COUNT; c++)
+		operand_buffers[c] = (char *)calloc(1, operand_sizes[c]);
+
 	rr_machine_t *user_machine = machine_new();
-	
-	fprintf(stdout, "Issue commands to the machine (leave blank to exit):\n");
-	
-	while(1) {
+
+	if(script) {
+		
+		run_script(user_machine, script);
+		
+		if(script != stdin)
+			fclose(script);
+			
+	}
+	else {
+		
+		fprintf(stdout, "Issue commands to the machine (leave blank to exit):\n");
+		
+		while(1) {
+			
+			u8 op_counter = 0;
+			
+			// Get a line of input and remove the newline
+			if(!fgets(input_buffer, INPUT_BUFFER_SIZE, stdin))
+				exit(1);
+				
+			input_buffer[strcspn(input_buffer, "\n")] = 0;
+			
+			// Exit if nothing was input
+			if(!input_buffer[0])
+				break;
+				
+			string_to_lower(input_buffer, input_buffer);
+			
+			token_str = strtok(input_buffer, " ");
+			strncpy(command_buffer, token_str, COMMAND_SIZE);
+			
+			// Extra operands are dropped rather than overflowing the buffers
+			while(op_counter < OPERAND_COUNT && (token_str = strtok(NULL, ", "))) {
+				
+				strncpy(operand_buffers[op_counter], token_str, operand_sizes[op_counter] - 1);
+				op_counter++;
+				
+			}
+			
+			run_command(user_machine, command_lookup(command_buffer), operand_buffers);
+			
+			for(c = 0; c < OPERAND_COUNT; c++)
+				memset(operand_buffers[c], 0, operand_sizes[c]);
+				
+		}
 		
-		u8 op_counter = 0;
+	}
+
+	for(c = 0; c < OPERAND_COUNT; c++)
+		free(operand_buffers[c]);
+
+	free(user_machine);
+	jit_free(user_jit);
+	history_free(user_history);
+	memo_free(user_memo);
+
+	return 0;
+
+}
+
+// Read a whole script, then run it - it is lower cased and split into a list of command numbers and operands before anything runs, so running it is only the commands themselves
+// A blank line ends the script, as it ends an interactive session
+u8 run_script(rr_machine_t *machine, FILE *script) {
+
+	static char empty[1];
+	script_command_t *commands = NULL;
+	u32 command_count = 0;
+	u32 command_capacity = 0;
+	char *text = NULL;
+	size_t length = 0;
+	size_t capacity = 0;
+	char *line;
+	char *next;
+	u32 c;
+
+	while(1) {
 		
-		// Get a line of input and remove the newline
-		if(!fgets(input_buffer, INPUT_BUFFER_SIZE, stdin))
-			exit(1);
+		size_t read;
 		
-		input_buffer[strcspn(input_buffer, "\n")] = 0;
+		if(length == capacity) {
+			
+			char *grown;
+			
+			capacity = capacity ? capacity << 1 : 1 << 16;
+			
+			// One spare byte for the NUL
+			if(!(grown = (char *)realloc(text, capacity + 1))) {
+				
+				fprintf(stderr, "Unable to allocate the script\n");
+				free(text);
+				
+				return 1;
+				
+			}
+			
+			text = grown;
+			
+		}
 		
-		// Exit if nothing was input
-		if(!input_buffer[0])
+		if(!(read = fread(text + length, 1, capacity - length, script)))
 			break;
+			
+		length += read;
+		
+	}
 
-		string_to_lower(input_buffer, input_buffer);
+	text[length] = 0;
+	string_to_lower(text, text);
 
-		token_str = strtok(input_buffer, " ");
-		strncpy(command_buffer, token_str, COMMAND_SIZE);
+	for(line = text; line; line = next) {
 		
-		while((token_str = strtok(NULL, ", ")))
-			strcpy(operand_buffers[op_counter++], token_str); 
+		script_command_t *entry;
+		char *token;
+		u8 o = 0;
 		
-		run_command(user_machine, command_buffer, operand_buffers);
+		if((next = strchr(line, '\n')))
+			*next++ = 0;
+			
+		line[strcspn(line, "\r")] = 0;
+		
+		if(!line[0])
+			break;
+			
+		if(!(token = strtok(line, " ")))
+			continue;
+			
+		if(command_count == command_capacity) {
+			
+			script_command_t *grown;
+			
+			command_capacity = command_capacity ? command_capacity << 1 : SCRIPT_INITIAL_COMMANDS;
+			
+			if(!(grown = (script_command_t *)realloc(commands, command_capacity * sizeof(script_command_t)))) {
+				
+				fprintf(stderr, "Unable to allocate the script\n");
+				free(commands);
+				free(text);
+				
+				return 1;
+				
+			}
+			
+			commands = grown;
+			
+		}
 		
-		memset(operand_buffers[0], 0, OP_1_BUFFER_SIZE);
-		memset(operand_buffers[1], 0, OP_2_BUFFER_SIZE);
+		entry = &commands[command_count++];
+		entry->command = command_lookup(token);
 		
+		// Extra operands are dropped, as for commands typed in
+		while(o < OPERAND_COUNT && (token = strtok(NULL, ", ")))
+			entry->operands[o++] = token;
+			
+		while(o < OPERAND_COUNT)
+			entry->operands[o++] = empty;
+			
 	}
-	
-	free(operand_buffers[0]);
-	free(operand_buffers[1]);
-	
-	free(user_machine);
-	
+
+	for(c = 0; c < command_count; c++)
+		run_command(machine, commands[c].command, commands[c].operands);
+
+	fflush(stdout);
+
+	free(commands);
+	free(text);
+
 	return 0;
-	
+
+}
+
+// Find a command's number from its name with one hash lookup and one compare, CMD_UNKNOWN if it isn't one
+u8 command_lookup(const char *name) {
+
+	size_t length = strlen(name);
+	u8 slot;
+
+	if(!length)
+		return CMD_UNKNOWN;
+
+	slot = command_hash[COMMAND_HASH(name, length)];
+
+	return slot && !strcmp(command_names[slot - 1], name) ? slot - 1 : CMD_UNKNOWN;
+
+}
+
+// Monotonic time in seconds, for timing runs
+f64 seconds_now() {
+
+#if defined(_WIN32)
+	LARGE_INTEGER counter, frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (f64)counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+
 }
 
 u8 string_to_unsigned(char *str, void *value_ptr, u8 value_bytes) {
-	
+
 	u8 base;
 	u64 value;
 	char *end_ptr;
 	char prefix;
-	
+
 	// Quick validation to ensure this is a standard primitive-sized integer
 	switch(value_bytes) {
 		
@@ -177,21 +500,23 @@ u8 string_to_unsigned(char *str, void *value_ptr, u8 value_bytes) {
 		case 4:
 		case 8:
 			break;
-		
+			
 		// Bad value size
 		default:
 			return 1;
-		
+			
 	}
-	
+
 	switch((prefix = *(str++))) {
 		
 		case '%':
 			base = 2;
 			break;
 			
+		// The leading 0 is left in place so a lone "0" still converts
 		case '0':
 			base = 8;
+			str--;
 			break;
 			
 		case '1':
@@ -214,141 +539,180 @@ u8 string_to_unsigned(char *str, void *value_ptr, u8 value_bytes) {
 		// Base error
 		default:
 			return 2;
-		
+			
 	}
-	
+
 	value = strtoul(str, &end_ptr, base);
-	
+
 	// Unable to convert
 	if(str == end_ptr)
 		return 3;
-	
+
 	switch(value_bytes) {
 		
 		case 1:
 			*(u8 *)value_ptr = (u8)value;
 			break;
-		
+			
 		case 2:
 			*(u16 *)value_ptr = (u16)value;
 			break;
-		
+			
 		case 4:
 			*(u32 *)value_ptr = (u32)value;
 			break;
-		
+			
 		case 8:
 			*(u64 *)value_ptr = value;
 			break;
-		
+			
 	}
-	
+
 	return 0;
-	
+
 }
 
 // dest = src.to_lower()
 void string_to_lower(char *dest, char *src) {
-	
+
 	size_t c = strlen(src);
-	
+
 	do
 		dest[c] = tolower(src[c]);
 	while(c--);
-	
+
 }
 
 void help_command(char *cmd) {
-	
+
 	u8 cmd_num = 0;
-	
+
 	char *temp;
 	char buffer[1000];
-	
+
 	for(; cmd_num < (COMMAND_COUNT << 1); cmd_num += 2) {
 		
 		strcpy(buffer, command_helptext[cmd_num]);
 		temp = strtok(buffer, " ");
 		
 		if(!strcmp(temp, cmd)) {
+			
 			fprintf(stdout, "%s\n%s\n", command_helptext[cmd_num], command_helptext[cmd_num + 1]);
+			
+			if(cmd_num == CMD_RUN << 1)
+				display_run_modes();
+				
 			return;
+			
 		}
 		
 	}
-	
+
 	fprintf(stderr, "Unknown command\n");
 	display_helptext();
-	
+
+}
+
+void display_run_modes() {
+
+	u8 c = 0;
+
+	fprintf(stdout, "\n+Run modes include the following:\n");
+
+	for(; c < RUN_MODE_COUNT; c++)
+		fprintf(stdout, "%-36s - %s\n", run_mode_helptext[c << 1], run_mode_helptext[(c << 1) + 1]);
+
 }
 
 void display_helptext() {
-	
+
 	u8 c = 0;
-		
+
 	for(; c < COMMAND_COUNT; c++)
 		fprintf(stdout, "%-36s - %s\n", command_helptext[c << 1], command_helptext[(c << 1) + 1]);
-	
+
+	display_run_modes();
+
 	fprintf(stdout, "\n^Special locations include the following:\n");
-	
+
 	for(c = 0; c < SPECIAL_LOC_COUNT; c++)
 		fprintf(stdout, "%-7s - %s\n", location_helptext[c << 1], location_helptext[(c << 1) + 1]);
-	
+
 }
 
-u8 run_command(rr_machine_t *machine, char *cmd, char **operands) {
-	
+u8 run_command(rr_machine_t *machine, u8 command, char **operands) {
+
 	fprintf(stdout, "\n");
-	
-	if(!strcmp(cmd, "save")) {
+
+	if(command == CMD_SAVE) {
+		
+		u8 whole_state = !strcmp(operands[1], "state");
 		
 		if(!operands[0][0]) {
 			fprintf(stderr, "Missing parameter for save\n");
 			return 1;
 		}
 		
-		switch(machine_save(machine, operands[0])) {
+		if(operands[1][0] && !whole_state) {
+			fprintf(stderr, "Expected state after the file path for save\n");
+			return 1;
+		}
+		
+		switch(whole_state ? machine_save_state(machine, operands[0]) : machine_save(machine, operands[0])) {
 			
 			case 0:
-				fprintf(stdout, "Memory contents saved to file\n");
+				fprintf(stdout, whole_state ? "Machine state saved to file\n" : "Memory contents saved to file\n");
 				break;
 				
 			case 1:
 				fprintf(stderr, "Could not open file for saving\n");
 				break;
-			
+				
 			case 2:
 				fprintf(stderr, "Could not write to file\n");
 				break;
-			
+				
 		}
 		
 	}
-	else if(!strcmp(cmd, "load")) {
+	else if(command == CMD_LOAD) {
+		
+		u8 whole_state = !strcmp(operands[1], "state");
 		
 		if(!operands[0][0]) {
 			fprintf(stderr, "Missing parameter for load\n");
 			return 1;
 		}
 		
-		switch(machine_load(machine, (const char *)operands[0])) {
+		if(operands[1][0] && !whole_state) {
+			fprintf(stderr, "Expected state after the file path for load\n");
+			return 1;
+		}
+		
+		history_clear(user_history);
+		
+		switch(whole_state ? machine_load_state(machine, operands[0]) : machine_load(machine, (const char *)operands[0])) {
 			
 			case 0:
-				fprintf(stdout, "Loaded memory from file\n");
+				fprintf(stdout, whole_state ? "Loaded machine state from file\n" : "Loaded memory from file\n");
 				break;
-			
+				
 			case 1:
 				fprintf(stderr, "Could not open file for loading\n");
 				break;
-			
+				
 			case 2:
 				fprintf(stderr, "Could not read from file\n");
 				break;
-			
+				
+			case 3:
+				fprintf(stderr, "Not a version %u snapshot file\n", SNAPSHOT_VERSION);
+				break;
+				
 		}
 		
 	}
-	else if(!strcmp(cmd, "step")) {
+	else if(command == CMD_STEP) {
 		
 		u8 op0_specified = 0;
 		u8 part_run = 0;
@@ -362,19 +726,70 @@ u8 run_command(rr_machine_t *machine, char *cmd, char **operands) {
 		}
 		else if(!strcmp(operands[0], "full"))
 			op0_specified = 1;
+		// Undo whole cycles, a cycle left partway through goes back to its start first
+		else if(!strcmp(operands[0], "back")) {
+			
+			u64 back_count = 1;
+			u64 done;
+			
+			if(!user_history) {
+				fprintf(stderr, "History is off, turn it on with history on before stepping\n");
+				return 1;
+			}
+			
+			if(operands[1][0])
+				STR_TO_UINT(operands[1], back_count);
+				
+			if((done = history_step_back(user_history, machine, back_count)) < back_count)
+				fprintf(stdout, "Reached the start of the history after %" PRIu64 " steps back\n", done);
+				
+			return 0;
+			
+		}
 		
 		if(operands[op0_specified][0])
 			STR_TO_UINT(operands[op0_specified], step_count);
-		
-		while(step_count--)
-			machine_step(machine, part_run);
+			
+		// Full steps stop at breakpoints and watchpoints as a run does
+		if(!part_run && step_count && watch_active(&user_watch)) {
+			
+			rr_stop_t stop;
+			
+			history_run(user_history, machine, step_count, NULL, &user_watch, &stop);
+			
+			if(stop.reason == RUN_BREAKPOINT || stop.reason == RUN_WATCHPOINT)
+				print_stop(machine, &stop);
+				
+		}
+		else {
+			
+			u16 steps = 0;
+			
+			for(; steps < step_count; steps++) {
+				
+				// Part steps stop at a breakpoint as the cycle starting there is about to be fetched
+				if(part_run && steps && !CURRENT_STATE(machine) && BITMAP_TEST(user_watch.breaks, machine->program_counter)) {
+					
+					fprintf(stdout, "Stopped at breakpoint [%02X] after %u steps\n", machine->program_counter, steps);
+					break;
+					
+				}
+				
+				if(user_history)
+					history_step(user_history, machine, part_run);
+				else
+					machine_step(machine, part_run);
+					
+			}
+			
+		}
 		
 	}
-	else if(!strcmp(cmd, "run")) {
-
+	else if(command == CMD_RUN) {
+		
 		u8 op0_specified = 0;
 		u8 part_run = 0;
-		u16 delay_ms = 0;
+		u32 delay_ms = 0;
 		
 		if(!strcmp(operands[0], "part")) {
 			
@@ -384,52 +799,291 @@ u8 run_command(rr_machine_t *machine, char *cmd, char **operands) {
 		}
 		else if(!strcmp(operands[0], "full"))
 			op0_specified = 1;
-		
-		if(operands[op0_specified][0])
-			STR_TO_UINT(operands[op0_specified], delay_ms);
-		
-		machine_run(machine, part_run, delay_ms);
-		
-	}
-	else if(!strcmp(cmd, "poke")) {
-		
-		u16 new_value; 
-		
-		if(!operands[0][0] || !operands[1][0]) {
-			fprintf(stderr, "Missing parameter for poke\n");
-			return 1;
-		}
-		
-		STR_TO_UINT(operands[1], new_value);
-		
-		switch(operands[0][0]) {
+		else if(!strcmp(operands[0], "back")) {
 			
-			// Main memory
-			case '%':
-			case '$':
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
+			rr_conditions_t conditions;
+			rr_stop_t stop;
+			u64 max_cycles = 0;
 			
-			{
-				
-				u8 mem_location;
-				STR_TO_UINT(operands[1], mem_location);
+			if(!user_history) {
+				fprintf(stderr, "History is off, turn it on with history on before running\n");
+				return 1;
+			}
+			
+			conditions_clear(&conditions);
+			
+			// Without conditions, back to the oldest recorded state
+			if(!strcmp(operands[1], "until")) {
 				
-				MEM(machine, mem_location) = new_value;
+				if(!operands[2][0]) {
+					fprintf(stderr, "Missing conditions for run back until\n");
+					return 1;
+				}
 				
+				if(parse_conditions(operands[2], &conditions))
+					return 1;
+					
+				if(operands[3][0])
+					STR_TO_UINT(operands[3], max_cycles);
+					
+			}
+			else if(operands[1][0]) {
+				fprintf(stderr, "Expected until after run back\n");
+				return 1;
 			}
 			
-				break;
+			history_run_back(user_history, machine, max_cycles, &conditions, &stop);
+			print_stop(machine, &stop);
 			
-			// Registers
+			return 0;
+			
+		}
+		// Timed runs with no delay, to compare the interpreter and translated code on the same image, with an optional cycle limit in place of the delay
+		else if(!strcmp(operands[0], "fast") || !strcmp(operands[0], "jit")) {
+			
+			u64 max_cycles = 0;
+			u64 cycles;
+			f64 elapsed;
+			
+			if(operands[1][0])
+				STR_TO_UINT(operands[1], max_cycles);
+				
+			// Neither run keeps an undo log
+			history_clear(user_history);
+			elapsed = seconds_now();
+			
+			if(operands[0][0] == 'j') {
+				
+				if(!user_jit && !(user_jit = jit_new()))
+					fprintf(stderr, "JIT not available on this platform, using the interpreter\n");
+					
+				cycles = machine_run_jit(machine, user_jit, max_cycles);
+				
+			}
+			else
+				cycles = machine_run_fast(machine, max_cycles);
+				
+			elapsed = seconds_now() - elapsed;
+			
+			fprintf(stdout, "Ran %" PRIu64 " cycles in %.3f ms (%.2f MIPS)\n", cycles, elapsed * 1000, elapsed > 0 ? cycles / elapsed / 1e6 : 0);
+			
+			return 0;
+			
+		}
+		// Undelayed run that gives up on programs stuck repeating themselves, with an optional cycle limit in place of the delay
+		else if(!strcmp(operands[0], "detect")) {
+			
+			rr_loop_t loop;
+			u64 max_cycles = 0;
+			
+			history_clear(user_history);
+			
+			if(operands[1][0])
+				STR_TO_UINT(operands[1], max_cycles);
+				
+			switch(machine_run_detect(machine, max_cycles, &loop)) {
+				
+				case RUN_HALTED:
+					fprintf(stdout, "Halted after %" PRIu64 " cycles\n", loop.cycles);
+					break;
+					
+				case RUN_CYCLE_LIMIT:
+					fprintf(stdout, "Stopped at the cycle limit after %" PRIu64 " cycles\n", loop.cycles);
+					break;
+					
+				case RUN_INFINITE_LOOP:
+					fprintf(stdout, "Infinite loop detected after %" PRIu64 " cycles: entered at $%02X after %" PRIu64 " cycles, repeats every %" PRIu64 " cycles\n", loop.cycles, loop.entry_pc, loop.entry_cycle, loop.period);
+					break;
+					
+			}
+			
+			return 0;
+			
+		}
+		// Undelayed run counting where the time goes, with an optional cycle limit in place of the delay
+		else if(!strcmp(operands[0], "profile")) {
+			
+			rr_profile_t *profile;
+			u64 max_cycles = 0;
+			
+			if(operands[1][0])
+				STR_TO_UINT(operands[1], max_cycles);
+				
+			if(!(profile = (rr_profile_t *)malloc(sizeof(rr_profile_t))))
+				return 1;
+				
+			history_clear(user_history);
+			profile_clear(profile);
+			
+			machine_run_profile(machine, max_cycles, profile);
+			profile_report(profile, stdout, PROFILE_REPORT_TOP);
+			
+			free(profile);
+			
+			return 0;
+			
+		}
+		// Undelayed run replaying calls seen before, with an optional cycle limit in place of the delay
+		else if(!strcmp(operands[0], "memo")) {
+			
+			u64 max_cycles = 0;
+			u64 cycles;
+			
+			if(operands[1][0])
+				STR_TO_UINT(operands[1], max_cycles);
+				
+			if(!user_memo && !(user_memo = memo_new(MEMO_DEFAULT_ENTRIES)))
+				return 1;
+				
+			history_clear(user_history);
+			
+			cycles = machine_run_memo(machine, max_cycles, user_memo);
+			
+			fprintf(stdout, "Ran %" PRIu64 " cycles\n", cycles);
+			memo_report(user_memo, stdout);
+			
+			return 0;
+			
+		}
+		// Undelayed run sending every cycle to an observer as batched events, with an optional cycle limit in place of the delay
+		else if(!strcmp(operands[0], "observe")) {
+			
+			u64 counts[OBSERVE_HALT + 1] = {0};
+			rr_observer_t *observer;
+			u64 max_cycles = 0;
+			u64 cycles;
+			f64 elapsed;
+			
+			if(operands[1][0])
+				STR_TO_UINT(operands[1], max_cycles);
+				
+			if(!(observer = observer_new(0, OBSERVE_ALL, count_events, counts)))
+				return 1;
+				
+			history_clear(user_history);
+			elapsed = seconds_now();
+			
+			cycles = machine_run_observe(machine, max_cycles, observer);
+			
+			elapsed = seconds_now() - elapsed;
+			
+			fprintf(stdout, "Ran %" PRIu64 " cycles in %.3f ms (%.2f MIPS), %" PRIu64 " events in %" PRIu64 " batches\n", cycles, elapsed * 1000, elapsed > 0 ? cycles / elapsed / 1e6 : 0, observer->delivered, observer->batches);
+			fprintf(stdout, "Fetches: %" PRIu64 ", decodes: %" PRIu64 ", register writes: %" PRIu64 ", memory writes: %" PRIu64 ", flag changes: %" PRIu64 ", halts: %" PRIu64 "\n", counts[OBSERVE_FETCH], counts[OBSERVE_DECODE], counts[OBSERVE_REGISTER], counts[OBSERVE_MEMORY], counts[OBSERVE_FLAGS], counts[OBSERVE_HALT]);
+			
+			observer_free(observer);
+			
+			return 0;
+			
+		}
+		// Steps at a steady rate in Hz, reporting how closely it was kept
+		else if(!strcmp(operands[0], "pace")) {
+			
+			rr_pace_t pace;
+			f64 hz;
+			u64 max_steps = 0;
+			u8 mode_given = !strcmp(operands[2], "part") || !strcmp(operands[2], "full");
+			char *end;
+			
+			if(!operands[1][0]) {
+				fprintf(stderr, "Missing rate for run pace\n");
+				return 1;
+			}
+			
+			// Fractional rates are fine, one step every 2 seconds is 0.5
+			hz = strtod(operands[1], &end);
+			
+			if(*end || !(hz > 0 && hz <= PACE_MAX_HZ)) {
+				fprintf(stderr, "Expected a rate in Hz above 0 and at most %g for run pace\n", PACE_MAX_HZ);
+				return 1;
+			}
+			
+			// The step limit can follow the rate straight away or come after part/full
+			if(operands[2 + mode_given][0])
+				STR_TO_UINT(operands[2 + mode_given], max_steps);
+				
+			// Paced steps are recorded like any other while history is on
+			if(user_history)
+				machine_run_paced_by(machine, !strcmp(operands[2], "part"), hz, max_steps, record_steps, NULL, &pace);
+			else
+				machine_run_paced(machine, !strcmp(operands[2], "part"), hz, max_steps, &pace);
+				
+			pace_report(&pace, stdout);
+			
+			return 0;
+			
+		}
+		
+		if(operands[op0_specified][0])
+			STR_TO_UINT(operands[op0_specified], delay_ms);
+			
+		// Full cycles with no delay can go in one call, otherwise each part/cycle is paced
+		// With breakpoints or watchpoints set the run goes through the interpreter built to check them, or checks them as it records while history is on
+		if(!part_run && !delay_ms && watch_active(&user_watch)) {
+			
+			rr_stop_t stop;
+			
+			if(user_history)
+				history_run(user_history, machine, 0, NULL, &user_watch, &stop);
+			else
+				machine_run_watch(machine, 0, &user_watch, &stop);
+				
+			print_stop(machine, &stop);
+			
+		}
+		else if(!part_run && !delay_ms && user_history)
+			history_run(user_history, machine, 0, NULL, NULL, NULL);
+		else if(!part_run && !delay_ms)
+			machine_run_fast(machine, 0);
+		else if(!delay_ms)
+			while((user_history ? history_step(user_history, machine, 1) : machine_step(machine, 1)) < 0b11);
+		// Each step gets a deadline worked out from the start of the run, so time spent stepping and late wakeups don't push back the steps after them
+		else if(user_history)
+			machine_run_paced_by(machine, part_run, 1000.0 / delay_ms, 0, record_steps, NULL, NULL);
+		else
+			machine_run_paced(machine, part_run, 1000.0 / delay_ms, 0, NULL);
+			
+	}
+	else if(command == CMD_POKE) {
+		
+		u16 new_value; 
+		
+		if(!operands[0][0] || !operands[1][0]) {
+			fprintf(stderr, "Missing parameter for poke\n");
+			return 1;
+		}
+		
+		STR_TO_UINT(operands[1], new_value);
+		
+		history_clear(user_history);
+		
+		switch(operands[0][0]) {
+			
+			// Main memory
+			case '%':
+			case '$':
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+			
+			{
+				
+				u8 mem_location;
+				STR_TO_UINT(operands[0], mem_location);
+				
+				machine_poke(machine, mem_location, new_value);
+				
+			}
+				
+				break;
+				
+			// Registers
 			case 'r':
 			
 			{
@@ -438,38 +1092,56 @@ u8 run_command(rr_machine_t *machine, char *cmd, char **operands) {
 				STR_TO_UINT(operands[0] + 1, reg_location);
 				
 				REG(machine, reg_location) = new_value;
+				MARK_REGISTER(machine, reg_location);
 				
 			}
-			
+				
 				break;
-			
+				
 			// Special - these really *shouldn't* be poked, but could be educational to mess with
 			case 's':
 			case 'i':
 			case 'p':
-			
-				if(!strcmp(operands[0], "sr"))
+				
+				if(!strcmp(operands[0], "sr")) {
+					
 					machine->status_register = new_value & 0x0F;
-				else if(!strcmp(operands[0], "sp"))
+					MARK_STATE(machine, CHANGED_SR);
+					
+				}
+				else if(!strcmp(operands[0], "sp")) {
+					
 					STACK_POINTER(machine) = new_value & 0xFF;
-				else if(!strcmp(operands[0], "ir"))
+					MARK_REGISTER(machine, 15);
+					
+				}
+				else if(!strcmp(operands[0], "ir")) {
+					
 					machine->instruction_register = new_value;
-				else if(!strcmp(operands[0], "pc"))
+					MARK_STATE(machine, CHANGED_IR);
+					
+				}
+				else if(!strcmp(operands[0], "pc")) {
+					
 					machine->program_counter = new_value & 0xFF;
-			
+					MARK_STATE(machine, CHANGED_PC);
+					
+				}
+				
+
 				break;
-			
+				
 		}
 		
 		
 	}
-	else if(!strcmp(cmd, "peek")) {
+	else if(command == CMD_PEEK) {
 		
 		if(!operands[0][0]) {
 			fprintf(stderr, "Missing parameter for peek\n");
 			return 1;
 		}
-	
+		
 		switch(operands[0][0]) {
 			
 			// Main memory
@@ -489,14 +1161,14 @@ u8 run_command(rr_machine_t *machine, char *cmd, char **operands) {
 			{
 				
 				u8 mem_location;
-				STR_TO_UINT(operands[1], mem_location);
+				STR_TO_UINT(operands[0], mem_location);
 				
 				fprintf(stdout, "[%02X]: $%02X\n", mem_location, MEM(machine, mem_location));
 				
 			}
-			
+				
 				break;
-			
+				
 			// Registers
 			case 'r':
 			
@@ -508,14 +1180,14 @@ u8 run_command(rr_machine_t *machine, char *cmd, char **operands) {
 				fprintf(stdout, "Register %X: $%02X\n", reg_location, REG(machine, reg_location));
 				
 			}
-			
+				
 				break;
-			
+				
 			// Special
 			case 's':
 			case 'i':
 			case 'p':
-			
+				
 				if(!strcmp(operands[0], "sr"))
 					fprintf(stdout, "Status register: %X (State: %s, Zero: %c, Carry: %c)\n", machine->status_register, state_names[CURRENT_STATE(machine)], (ZERO_SET(machine) ? 'Y' : 'N'), (CARRY_SET(machine) ? 'Y' : 'N'));
 				else if(!strcmp(operands[0], "sp"))
@@ -523,48 +1195,359 @@ u8 run_command(rr_machine_t *machine, char *cmd, char **operands) {
 				else if(!strcmp(operands[0], "ir")) {
 					
 					if(machine->status_register & 0b1000)
-						fprintf(stdout, "Instruction register: $%04X (%s, %02X, %02X, %02X)\n", machine->instruction_register, instruction_mnemonics[machine->operands[0]], machine->operands[1], machine->operands[2], machine->operands[3]);
+						fprintf(stdout, "Instruction register: $%04X (%s, %02X, %02X, %02X)\n", machine->instruction_register, isa_mnemonics[machine->operands[0]], machine->operands[1], machine->operands[2], machine->operands[3]);
 					else
 						fprintf(stdout, "Instruction register: $%04X\n", machine->instruction_register);
-					
+						
 				}
 				else if(!strcmp(operands[0], "pc"))
 					fprintf(stdout, "Program counter: %02X\n", machine->program_counter);
-			
+					
 				break;
+				
+		}
+		
+	}
+	else if(command == CMD_DUMP) {
+		
+		print_dump(machine);
+		
+	}
+	else if(command == CMD_DIFF) {
+		
+		print_changes(machine);
+		
+	}
+	else if(command == CMD_DIS) {
+		
+		u8 address = machine->program_counter;
+		u16 count = DISASSEMBLE_DEFAULT_COUNT;
+		
+		if(operands[0][0])
+			STR_TO_UINT(operands[0], address);
+			
+		if(operands[1][0])
+			STR_TO_UINT(operands[1], count);
+			
+		machine_disassemble_range(machine, address, count, stdout);
+		
+	}
+	else if(command == CMD_BREAK) {
+		
+		u8 address;
+		u16 c = 0;
+		
+		if(operands[0][0]) {
+			
+			STR_TO_UINT(operands[0], address);
+			watch_add(&user_watch, WATCH_BREAK, address);
+			
+			return 0;
 			
 		}
 		
+		for(; c < 256; c++) {
+			
+			if(BITMAP_TEST(user_watch.breaks, c))
+				fprintf(stdout, "Break [%02X]\n", c);
+				
+			if(BITMAP_TEST(user_watch.reads, c) || BITMAP_TEST(user_watch.writes, c))
+				fprintf(stdout, "Watch [%02X] (%s%s)\n", c, BITMAP_TEST(user_watch.reads, c) ? "r" : "", BITMAP_TEST(user_watch.writes, c) ? "w" : "");
+				
+		}
+		
 	}
-	else if(!strcmp(cmd, "dump")) {
+	else if(command == CMD_WATCH) {
+		
+		u8 address;
+		u8 kinds = WATCH_READ | WATCH_WRITE;
+		
+		if(!operands[0][0]) {
+			fprintf(stderr, "Missing parameter for watch\n");
+			return 1;
+		}
+		
+		STR_TO_UINT(operands[0], address);
+		
+		if(!strcmp(operands[1], "r"))
+			kinds = WATCH_READ;
+		else if(!strcmp(operands[1], "w"))
+			kinds = WATCH_WRITE;
+		else if(operands[1][0] && strcmp(operands[1], "rw")) {
+			fprintf(stderr, "Expected r, w or rw after the address\n");
+			return 1;
+		}
 		
-		u8 c = 0;
+		watch_add(&user_watch, kinds, address);
 		
-		fprintf(stdout, "PC: [%02X] IR: [%04X] SR: [%02X]\n", machine->program_counter, machine->instruction_register, machine->status_register);
+	}
+	else if(command == CMD_UNWATCH) {
 		
-		fprintf(stdout, "    0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F       R\n");
+		u8 address;
 		
-		for(; c < 0xF; c++) {
-			fprintf(stdout, "%X [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X]    [%02X]\n", c, MEM(machine, c * 0x10), MEM(machine, c * 0x10 + 1), MEM(machine, c * 0x10 + 2), MEM(machine, c * 0x10 + 3), MEM(machine, c * 0x10 + 4), MEM(machine, c * 0x10 + 5), MEM(machine, c * 0x10 + 6), MEM(machine, c * 0x10 + 7), MEM(machine, c * 0x10 + 8), MEM(machine, c * 0x10 + 9), MEM(machine, c * 0x10 + 10), MEM(machine, c * 0x10 + 11), MEM(machine, c * 0x10 + 12), MEM(machine, c * 0x10 + 13), MEM(machine, c * 0x10 + 14), MEM(machine, c * 0x10 + 15), REG(machine, c));
+		if(!operands[0][0]) {
+			fprintf(stderr, "Missing parameter for unwatch\n");
+			return 1;
+		}
+		
+		if(!strcmp(operands[0], "all")) {
+			
+			watch_clear(&user_watch);
+			
+			return 0;
 			
 		}
 		
-		fprintf(stdout, "%X [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X] [%02X]  SP[%02X]\n", 0xF, MEM(machine, 0xF0), MEM(machine, 0xF1), MEM(machine, 0xF2), MEM(machine, 0xF3), MEM(machine, 0xF4), MEM(machine, 0xF5), MEM(machine, 0xF6), MEM(machine, 0xF7), MEM(machine, 0xF8), MEM(machine, 0xF9), MEM(machine, 0xFA), MEM(machine, 0xFB), MEM(machine, 0xFC), MEM(machine, 0xFD), MEM(machine, 0xFE), MEM(machine, 0xFF), REG(machine, 0xF));
+		STR_TO_UINT(operands[0], address);
+		watch_remove(&user_watch, WATCH_BREAK | WATCH_READ | WATCH_WRITE, address);
 		
 	}
-	else if(!strcmp(cmd, "reset"))
+	else if(command == CMD_RESET) {
+		
 		machine_reset(machine);
-	else if(!strcmp(cmd, "clear"))
+		history_clear(user_history);
+		
+	}
+	else if(command == CMD_CLEAR) {
+		
 		machine_clear_memory(machine);
-	else if(!strcmp(cmd, "help")) {
-	
+		history_clear(user_history);
+		
+	}
+	else if(command == CMD_UNTIL) {
+		
+		rr_conditions_t conditions;
+		rr_stop_t stop;
+		u64 max_cycles = 0;
+		char *condition = operands[0];
+		
+		if(!operands[0][0]) {
+			fprintf(stderr, "Missing parameter for until\n");
+			return 1;
+		}
+		
+		if(operands[1][0])
+			STR_TO_UINT(operands[1], max_cycles);
+			
+		if(parse_conditions(condition, &conditions))
+			return 1;
+			
+		// No single fast run checks conditions together with breakpoints and watchpoints, so with any set they are checked a cycle at a time
+		if(user_history || watch_active(&user_watch))
+			history_run(user_history, machine, max_cycles, &conditions, &user_watch, &stop);
+		else
+			machine_run_until(machine, max_cycles, &conditions, &stop);
+			
+		print_stop(machine, &stop);
+		
+	}
+	else if(command == CMD_BATCH) {
+		
+		rr_batch_t *batch;
+		
+		if(!operands[0][0]) {
+			fprintf(stderr, "Missing parameter for batch\n");
+			return 1;
+		}
+		
+		if(!(batch = batch_new()))
+			return 1;
+			
+		switch(batch_load_manifest(batch, operands[0])) {
+			
+			case 1:
+				fprintf(stderr, "Unable to open manifest %s\n", operands[0]);
+				batch_free(batch);
+				return 1;
+				
+			case 2:
+				fprintf(stderr, "Unable to allocate batch jobs\n");
+				batch_free(batch);
+				return 1;
+				
+			case 3:
+				fprintf(stderr, "Unable to open the corpus listed in %s\n", operands[0]);
+				batch_free(batch);
+				return 1;
+				
+		}
+		
+		if(batch_run(batch))
+			fprintf(stderr, "Unable to write results to %s\n", batch->output_dir);
+		else {
+			
+			u32 c = 0;
+			u32 halted = 0;
+			u32 not_run = 0;
+			u64 cycles = 0;
+			
+			for(; c < batch->job_count; c++) {
+				
+				halted += batch->jobs[c].result == BATCH_HALTED;
+				not_run += batch->jobs[c].result == BATCH_NOT_RUN;
+				cycles += batch->jobs[c].cycles;
+				
+			}
+			
+			if(not_run)
+				fprintf(stderr, "%u jobs were not run, no worker could be started for them\n", not_run);
+				
+			fprintf(stdout, "Ran %u jobs (%u halted) on %u threads in %.3f ms, %" PRIu64 " cycles (%.2f MIPS), %" PRIu64 " steals\n", batch->job_count, halted, batch->threads_used, batch->seconds * 1000, cycles, batch->seconds > 0 ? cycles / batch->seconds / 1e6 : 0, batch->steals);
+			fprintf(stdout, "Results written to %s\n", batch->output_dir);
+			
+		}
+		
+		batch_free(batch);
+		
+	}
+	else if(command == CMD_TRACE) {
+		
+		rr_trace_t *trace;
+		u64 max_cycles = 0;
+		u64 cycles;
+		f64 elapsed;
+		
+		if(!operands[0][0]) {
+			fprintf(stderr, "Missing parameter for trace\n");
+			return 1;
+		}
+		
+		if(operands[1][0])
+			STR_TO_UINT(operands[1], max_cycles);
+			
+		if(!(trace = trace_open(operands[0], machine))) {
+			fprintf(stderr, "Unable to create trace file %s\n", operands[0]);
+			return 1;
+		}
+		
+		// Traced runs don't keep an undo log
+		history_clear(user_history);
+		elapsed = seconds_now();
+		
+		cycles = machine_run_trace(machine, max_cycles, trace);
+		
+		elapsed = seconds_now() - elapsed;
+		
+		if(trace_close(trace)) {
+			fprintf(stderr, "Unable to write the whole trace to %s\n", operands[0]);
+			return 1;
+		}
+		
+		fprintf(stdout, "Traced %" PRIu64 " cycles in %.3f ms (%.2f MIPS)\n", cycles, elapsed * 1000, elapsed > 0 ? cycles / elapsed / 1e6 : 0);
+		
+	}
+	else if(command == CMD_SNAP) {
+		
+		rr_snapshot_stream_t *stream;
+		u64 interval = 0;
+		u64 max_cycles = 0;
+		u64 cycles;
+		
+		if(!operands[0][0] || !operands[1][0]) {
+			fprintf(stderr, "Missing parameter for snap\n");
+			return 1;
+		}
+		
+		STR_TO_UINT(operands[1], interval);
+		
+		if(operands[2][0])
+			STR_TO_UINT(operands[2], max_cycles);
+			
+		if(!(stream = snapshot_stream_create(operands[0], 0))) {
+			fprintf(stderr, "Unable to create snapshot stream %s\n", operands[0]);
+			return 1;
+		}
+		
+		// Snapshot runs don't keep an undo log
+		history_clear(user_history);
+		
+		cycles = machine_run_snapshots(machine, max_cycles, interval, stream);
+		
+		fprintf(stdout, "Ran %" PRIu64 " cycles, %" PRIu64 " snapshots (%" PRIu64 " keyframes) in %" PRIu64 " bytes\n", cycles, stream->frame_count, stream->keyframe_count, stream->bytes);
+		
+		if(snapshot_stream_close(stream)) {
+			fprintf(stderr, "Unable to write the whole stream to %s\n", operands[0]);
+			return 1;
+		}
+		
+	}
+	else if(command == CMD_SEEK) {
+		
+		rr_snapshot_stream_t *stream;
+		u64 cycle;
+		u64 found;
+		
+		if(!operands[0][0] || !operands[1][0]) {
+			fprintf(stderr, "Missing parameter for seek\n");
+			return 1;
+		}
+		
+		STR_TO_UINT(operands[1], cycle);
+		
+		if(!(stream = snapshot_stream_open(operands[0]))) {
+			fprintf(stderr, "Unable to open snapshot stream %s\n", operands[0]);
+			return 1;
+		}
+		
+		if(snapshot_stream_seek(stream, cycle, machine, &found))
+			fprintf(stderr, "No snapshot at or before cycle %" PRIu64 " in %s\n", cycle, operands[0]);
+		else {
+			
+			history_clear(user_history);
+			fprintf(stdout, "Restored the snapshot at cycle %" PRIu64 "\n", found);
+			
+		}
+		
+		snapshot_stream_close(stream);
+		
+	}
+	else if(command == CMD_HISTORY) {
+		
+		if(!operands[0][0]) {
+			
+			if(user_history)
+				fprintf(stdout, "History is on, %" PRIu64 " cycles recorded\n", user_history->cycle);
+			else
+				fprintf(stdout, "History is off\n");
+				
+		}
+		else if(!strcmp(operands[0], "on") || !strcmp(operands[0], "off")) {
+			
+			// Either way what was recorded so far no longer lines up with what comes next
+			// The records are only allocated while recording, and given back when it's turned off
+			if(operands[0][1] == 'n') {
+				
+				if(!user_history && !(user_history = history_new(HISTORY_DEFAULT_RECORDS))) {
+					fprintf(stderr, "Unable to allocate the history, it stays off\n");
+					return 1;
+				}
+				
+				history_clear(user_history);
+				
+			}
+			else {
+				
+				history_free(user_history);
+				user_history = NULL;
+				
+			}
+			
+		}
+		else {
+			fprintf(stderr, "Expected on or off after history\n");
+			return 1;
+		}
+		
+	}
+	else if(command == CMD_HELP) {
+		
 		if(operands[0][0])
 			help_command(operands[0]);
 		else
 			display_helptext();
-		
+			
 		fprintf(stdout, "\n");
-	
+		
 	}
 	else {
 		
@@ -575,7 +1558,245 @@ u8 run_command(rr_machine_t *machine, char *cmd, char **operands) {
 		fprintf(stdout, "\n");
 		
 	}
-	
+
+	return 0;
+
+}
+
+// Compile "<condition>[|<condition>...]" for machine_run_until/history_run/history_run_back, the runs themselves never look at the text
+u8 parse_conditions(char *condition, rr_conditions_t *conditions) {
+
+	conditions_clear(conditions);
+
+	while(condition) {
+		
+		char *next = strchr(condition, '|');
+		char *value_str;
+		u8 kind;
+		u8 index = 0;
+		u8 value = 0;
+		
+		if(next)
+			*next++ = 0;
+			
+		if((value_str = strchr(condition, '=')))
+			*value_str++ = 0;
+			
+		if(!strcmp(condition, "pc") && value_str) {
+			
+			kind = STOP_PC_EQUAL;
+			STR_TO_UINT(value_str, value);
+			
+		}
+		else if(!strcmp(condition, "sp") && value_str) {
+			
+			kind = STOP_REGISTER_EQUAL;
+			index = 15;
+			STR_TO_UINT(value_str, value);
+			
+		}
+		else if(condition[0] == 'r' && condition[1] && value_str) {
+			
+			kind = STOP_REGISTER_EQUAL;
+			STR_TO_UINT(condition + 1, index);
+			STR_TO_UINT(value_str, value);
+			
+		}
+		else if(condition[0] == 'm' && condition[1]) {
+			
+			kind = value_str ? STOP_MEMORY_EQUAL : STOP_MEMORY_CHANGED;
+			STR_TO_UINT(condition + 1, index);
+			
+			if(value_str)
+				STR_TO_UINT(value_str, value);
+				
+		}
+		else if(!strncmp(condition, "depth>", 6) && condition[6] && !value_str) {
+			
+			kind = STOP_STACK_DEPTH_ABOVE;
+			STR_TO_UINT(condition + 6, value);
+			
+		}
+		else {
+			
+			fprintf(stderr, "Unrecognized condition %s\n", condition);
+			return 1;
+			
+		}
+		
+		switch(conditions_add(conditions, kind, index, value)) {
+			
+			case 1:
+				fprintf(stderr, "Too many conditions (at most %u)\n", STOP_MAX_CONDITIONS);
+				return 1;
+				
+			case 2:
+				fprintf(stderr, "Invalid register in condition\n");
+				return 1;
+				
+		}
+		
+		condition = next;
+		
+	}
+
 	return 0;
-	
+
+}
+
+// Build the whole dump as text and write it out at once, rather than formatting every cell with printf
+void print_dump(rr_machine_t *machine) {
+
+	static const char hex_digits[] = "0123456789ABCDEF";
+	// Header lines, then 16 rows of a row number, 16 cells and a register
+	char text[128 + 16 * 96];
+	char *out = text;
+	u8 row = 0;
+
+	out += sprintf(out, "PC: [%02X] IR: [%04X] SR: [%02X]\n", machine->program_counter, machine->instruction_register, machine->status_register);
+	out += sprintf(out, "    0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F       R\n");
+
+	for(; row < 16; row++) {
+		
+		u8 column = 0;
+		
+		*out++ = hex_digits[row];
+		
+		for(; column < 16; column++) {
+			
+			u8 value = MEM(machine, (row << 4) | column);
+			
+			out[0] = ' ';
+			out[1] = '[';
+			out[2] = hex_digits[value >> 4];
+			out[3] = hex_digits[value & 0xF];
+			out[4] = ']';
+			out += 5;
+			
+		}
+		
+		// The last row's register is the stack pointer
+		memcpy(out, row < 0xF ? "    [" : "  SP[", 5);
+		out[5] = hex_digits[REG(machine, row) >> 4];
+		out[6] = hex_digits[REG(machine, row) & 0xF];
+		out[7] = ']';
+		out[8] = '\n';
+		out += 9;
+		
+	}
+
+	fwrite(text, 1, out - text, stdout);
+
+}
+
+// Print what has been written since the last call in the same notation as the dump - changed parts of PC/IR/SR on one line, registers on the next, then memory cells 8 to a line
+void print_changes(rr_machine_t *machine) {
+
+	rr_changes_t changes;
+	// Room for the PC/IR/SR line and 9 characters for every register and every cell
+	char text[64 + (16 + 256) * 9];
+	char *out = text;
+	u16 c = 0;
+	u8 cells = 0;
+
+	if(!machine_collect_changes(machine, &changes)) {
+		fprintf(stdout, "No changes since the last diff\n");
+		return;
+	}
+
+	if(changes.state) {
+		
+		if(changes.state & CHANGED_PC)
+			out += sprintf(out, "PC: [%02X] ", machine->program_counter);
+		if(changes.state & CHANGED_IR)
+			out += sprintf(out, "IR: [%04X] ", machine->instruction_register);
+		if(changes.state & CHANGED_SR)
+			out += sprintf(out, "SR: [%02X] ", machine->status_register);
+			
+		out[-1] = '\n';
+		
+	}
+
+	if(changes.registers) {
+		
+		for(; c < 16; c++)
+			if((changes.registers >> c) & 1)
+				out += c < 0xF ? sprintf(out, "R%X: [%02X] ", c, REG(machine, c)) : sprintf(out, "SP: [%02X] ", STACK_POINTER(machine));
+				
+		out[-1] = '\n';
+		
+	}
+
+	for(c = 0; c < 256; c++)
+		if(BITMAP_TEST(changes.memory, c))
+			out += sprintf(out, "%02X: [%02X]%c", c, MEM(machine, c), ++cells % 8 ? ' ' : '\n');
+			
+
+	if(cells % 8)
+		out[-1] = '\n';
+
+	fwrite(text, 1, out - text, stdout);
+
+}
+
+// Observer callback for "run observe", adding each batch to counts indexed by event kind
+void count_events(const rr_event_t *events, u32 count, void *context) {
+
+	u64 *counts = (u64 *)context;
+	u32 c = 0;
+
+	for(; c < count; c++)
+		counts[events[c].kind]++;
+
+}
+
+// Pace callback for delayed runs and "run pace" while history is on, stepping through the history so the steps can be undone
+u64 record_steps(rr_machine_t *machine, u8 part_step, u64 steps, void *context) {
+
+	u64 done = 0;
+
+	while(done < steps) {
+		
+		done++;
+		
+		if(history_step(user_history, machine, part_step) == 0b11)
+			break;
+			
+	}
+
+	return done;
+
+}
+
+// Report why a run (forwards or back) stopped
+void print_stop(rr_machine_t *machine, rr_stop_t *stop) {
+
+	switch(stop->reason) {
+		
+		case RUN_HALTED:
+			fprintf(stdout, "Halted after %" PRIu64 " cycles\n", stop->cycles);
+			break;
+			
+		case RUN_CYCLE_LIMIT:
+			fprintf(stdout, "Stopped at the cycle limit after %" PRIu64 " cycles\n", stop->cycles);
+			break;
+			
+		case RUN_CONDITION:
+			fprintf(stdout, "Stopped on condition %u after %" PRIu64 " cycles, PC: [%02X]\n", stop->condition + 1, stop->cycles, machine->program_counter);
+			break;
+			
+		case RUN_BREAKPOINT:
+			fprintf(stdout, "Stopped at breakpoint [%02X] after %" PRIu64 " cycles\n", user_watch.address, stop->cycles);
+			break;
+			
+		case RUN_WATCHPOINT:
+			fprintf(stdout, "Stopped after %s [%02X] by the instruction at [%02X] after %" PRIu64 " cycles, PC: [%02X]\n", user_watch.stopped == WATCH_READ ? "a read of" : "a write to", user_watch.address, user_watch.pc, stop->cycles, machine->program_counter);
+			break;
+			
+		case RUN_HISTORY_START:
+			fprintf(stdout, "Reached the start of the history after %" PRIu64 " cycles back\n", stop->cycles);
+			break;
+			
+	}
+
 }
\ No newline at end of file
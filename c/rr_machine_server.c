@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "src/rr_machine.h"
+#include "src/rr_server.h"
+
+rr_server_t *server = NULL;
+
+void stop_server(s32 signal_number) {
+	
+	server_stop(server);
+	
+}
+
+// Serve machines to many clients from one process, each connection getting its own machine (see rr_server.h for the protocol)
+// Usage: rr_machine_server <socket path> [--sessions <count>] [--slice <cycles>] [--files <directory>]
+s32 main(s32 argc, const char **argv) {
+	
+	u32 max_sessions = 0;
+	u64 slice_cycles = 0;
+	const char *files = NULL;
+	s32 a = 2;
+	u8 result;
+	
+	if(argc < 2) {
+		
+		fprintf(stderr, "Usage: %s <socket path> [--sessions <count>] [--slice <cycles>] [--files <directory>]\n", argv[0]);
+		return 1;
+		
+	}
+	
+	for(; a + 1 < argc; a += 2) {
+		
+		if(!strcmp(argv[a], "--sessions"))
+			max_sessions = strtoul(argv[a + 1], NULL, 0);
+		else if(!strcmp(argv[a], "--slice"))
+			slice_cycles = strtoull(argv[a + 1], NULL, 0);
+		else if(!strcmp(argv[a], "--files"))
+			files = argv[a + 1];
+		else {
+			
+			fprintf(stderr, "Unknown option %s\n", argv[a]);
+			return 1;
+			
+		}
+		
+	}
+	
+	if(!(server = server_new(argv[1], max_sessions, slice_cycles))) {
+		
+		fprintf(stderr, "Unable to listen on %s\n", argv[1]);
+		return 1;
+		
+	}
+	
+	if(server_files(server, files)) {
+		
+		fprintf(stderr, "Unusable file directory %s\n", files);
+		server_free(server);
+		return 1;
+		
+	}
+	
+	signal(SIGINT, stop_server);
+	signal(SIGTERM, stop_server);
+	
+	fprintf(stdout, "Serving up to %u sessions on %s, %" PRIu64 " cycles per slice\n", server->max_sessions, argv[1], server->slice_cycles);
+	fflush(stdout);
+	
+	result = server_run(server);
+	server_free(server);
+	
+	return result;
+	
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/rr_machine.h"
+#include "src/rr_trace.h"
+#include "src/rr_isa.h"
+
+// Records decoded per read
+#define READ_RECORDS 4096
+
+// Print a trace file written by machine_run_trace as text, one line per cycle:
+// <cycle> <address>: <instruction> <mnemonic> <operands> -> <register or memory written> SR <status register> SP <stack pointer>
+// Usage: rr_trace_read <trace file> [<first cycle> [<cycle count>]]
+s32 main(s32 argc, const char **argv) {
+	
+	FILE *file;
+	rr_trace_header_t header;
+	rr_trace_record_t *records;
+	u64 first = 0;
+	u64 count = UINT64_MAX;
+	u64 cycle = 0;
+	u32 read_count;
+	u32 c;
+	
+	if(argc < 2) {
+		
+		fprintf(stderr, "Usage: %s <trace file> [<first cycle> [<cycle count>]]\n", argv[0]);
+		return 1;
+		
+	}
+	
+	if(argc > 2)
+		first = strtoull(argv[2], NULL, 0);
+		
+	if(argc > 3)
+		count = strtoull(argv[3], NULL, 0);
+		
+	if(!(file = fopen(argv[1], "rb"))) {
+		
+		fprintf(stderr, "Unable to open %s\n", argv[1]);
+		return 1;
+		
+	}
+	
+	if(trace_read_header(file, &header)) {
+		
+		fprintf(stderr, "%s is not a version %u trace\n", argv[1], TRACE_VERSION);
+		fclose(file);
+		return 1;
+		
+	}
+	
+	fprintf(stdout, "Trace starting at PC %02X, SR %X, SP %02X\n", header.program_counter, header.status_register, header.registers[15]);
+	
+	// Skip straight to the first cycle asked for, records are all the same size
+	if(first && !fseek(file, first * sizeof(rr_trace_record_t), SEEK_CUR))
+		cycle = first;
+		
+	if(!(records = (rr_trace_record_t *)malloc(READ_RECORDS * sizeof(rr_trace_record_t)))) {
+		
+		fprintf(stderr, "Unable to allocate the record buffer\n");
+		fclose(file);
+		return 1;
+		
+	}
+	
+	while(count && (read_count = trace_read_records(file, records, READ_RECORDS))) {
+		
+		for(c = 0; c < read_count && count; c++, cycle++) {
+			
+			rr_trace_record_t *record = &records[c];
+			u16 instruction = (record->instruction[0] << 8) | record->instruction[1];
+			u8 operands[4];
+			
+			if(cycle < first)
+				continue;
+				
+			count--;
+			machine_decode_instruction(instruction, operands);
+			
+			fprintf(stdout, "%10" PRIu64 " %02X: %04X %s %X %02X %02X", cycle, record->program_counter, instruction, isa_mnemonics[operands[0]], operands[1], operands[2], operands[3]);
+			
+			switch(record->kind) {
+				
+				case TRACE_WRITE_REGISTER:
+					fprintf(stdout, " -> r%u = $%02X", record->location, record->value);
+					break;
+					
+				case TRACE_WRITE_MEMORY:
+					fprintf(stdout, " -> m%02X = $%02X", record->location, record->value);
+					break;
+					
+			}
+			
+			fprintf(stdout, " SR %X SP %02X\n", record->status_register, record->stack_pointer);
+			
+		}
+		
+	}
+	
+	free(records);
+	fclose(file);
+	
+	return 0;
+	
+}
\ No newline at end of file
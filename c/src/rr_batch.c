@@ -0,0 +1,579 @@
+#include "rr_batch.h"
+#include "rr_pool.h"
+
+#include <stdatomic.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0777)
+#endif
+
+// Returned by the deque when there is nothing to take, or when a steal lost a race and should be retried
+#define DEQUE_EMPTY -1
+#define DEQUE_RETRY -2
+
+// Chase-Lev work-stealing deque of job numbers - the owner pushes and pops at the bottom, other workers steal from the top
+// Each deque sits on its own cache line so workers never write to a line another worker is polling
+typedef struct rr_deque_d {
+	_Alignas(64) _Atomic s64 top;
+	_Atomic s64 bottom;
+	u32 *items;
+	u32 mask;
+} rr_deque_t;
+
+typedef struct rr_worker_d {
+	rr_deque_t deque;
+	rr_batch_t *batch;
+	struct rr_worker_d *workers;
+	u32 index;
+	u64 steals;
+} rr_worker_t;
+
+static u8 deque_init(rr_deque_t *deque, u32 capacity) {
+	
+	u32 size = 1;
+	
+	while(size < capacity)
+		size <<= 1;
+		
+	deque->items = (u32 *)malloc(size * sizeof(u32));
+	deque->mask = size - 1;
+	atomic_init(&deque->top, 0);
+	atomic_init(&deque->bottom, 0);
+	
+	return deque->items == NULL;
+	
+}
+
+static void deque_push(rr_deque_t *deque, u32 item) {
+	
+	s64 bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	
+	deque->items[bottom & deque->mask] = item;
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	
+}
+
+static s64 deque_pop(rr_deque_t *deque) {
+	
+	s64 bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	s64 top;
+	s64 item = DEQUE_EMPTY;
+	
+	atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+	
+	if(top <= bottom) {
+		
+		item = deque->items[bottom & deque->mask];
+		
+		// Last item - race any thieves for it
+		if(top == bottom) {
+			
+			if(!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+				item = DEQUE_EMPTY;
+				
+			atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+			
+		}
+		
+	}
+	else
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+		
+	return item;
+	
+}
+
+static s64 deque_steal(rr_deque_t *deque) {
+	
+	s64 top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	s64 bottom;
+	s64 item;
+	
+	atomic_thread_fence(memory_order_seq_cst);
+	bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+	
+	if(top >= bottom)
+		return DEQUE_EMPTY;
+		
+	item = deque->items[top & deque->mask];
+	
+	if(!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+		return DEQUE_RETRY;
+		
+	return item;
+	
+}
+
+// Run one job start to finish on the worker's own machine
+static void batch_run_job(rr_batch_t *batch, rr_pool_t *pool, rr_machine_t *machine, u32 job_number) {
+	
+	rr_batch_job_t *job = &batch->jobs[job_number];
+	char output_path[4096];
+	
+	// Back to a blank machine in one copy, instead of a reset and a clear
+	pool_reset(pool, machine);
+	
+	if(job->input_path ? machine_load(machine, job->input_path) : machine_load_corpus(machine, batch->corpus, job->corpus_index)) {
+		
+		job->result = BATCH_LOAD_FAILED;
+		return;
+		
+	}
+	
+	if(batch->detect_loops) {
+		
+		rr_loop_t loop;
+		
+		switch(machine_run_detect(machine, job->max_cycles ? job->max_cycles : batch->max_cycles, &loop)) {
+			
+			case RUN_HALTED:
+				job->result = BATCH_HALTED;
+				break;
+				
+			case RUN_CYCLE_LIMIT:
+				job->result = BATCH_CYCLE_LIMIT;
+				break;
+				
+			case RUN_INFINITE_LOOP:
+				job->result = BATCH_INFINITE_LOOP;
+				job->loop_entry_pc = loop.entry_pc;
+				job->loop_period = loop.period;
+				break;
+				
+		}
+		
+		job->cycles = loop.cycles;
+		
+	}
+	else {
+		
+		job->cycles = machine_run_fast(machine, job->max_cycles ? job->max_cycles : batch->max_cycles);
+		job->result = CURRENT_STATE(machine) == 0b11 ? BATCH_HALTED : BATCH_CYCLE_LIMIT;
+		
+	}
+	
+	snprintf(output_path, sizeof(output_path), "%s/%06u.bin", batch->output_dir, job_number);
+	
+	if(machine_save(machine, output_path))
+		job->result = BATCH_SAVE_FAILED;
+		
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI batch_worker(LPVOID argument) {
+#else
+static void *batch_worker(void *argument) {
+#endif
+	
+	rr_worker_t *worker = (rr_worker_t *)argument;
+	rr_batch_t *batch = worker->batch;
+	// Each worker's machine comes from its own pool, on cache lines no other worker's touches
+	rr_pool_t *pool = pool_new(1, 0);
+	rr_machine_t *machine = pool ? pool_acquire(pool) : NULL;
+	
+	// Jobs left in this worker's deque are stolen by the others
+	if(!machine) {
+		
+		pool_free(pool);
+		return 0;
+		
+	}
+	
+	while(1) {
+		
+		s64 job = deque_pop(&worker->deque);
+		
+		// Out of local work, look for some elsewhere - nothing new is ever queued, so once every deque is empty the batch is done
+		if(job == DEQUE_EMPTY) {
+			
+			u32 victim = 1;
+			u8 contended = 0;
+			
+			for(; victim < batch->threads_used && job < 0; victim++) {
+				
+				job = deque_steal(&worker->workers[(worker->index + victim) % batch->threads_used].deque);
+				
+				if(job == DEQUE_RETRY)
+					contended = 1;
+					
+			}
+			
+			if(job < 0) {
+				
+				if(contended)
+					continue;
+					
+				break;
+				
+			}
+			
+			worker->steals++;
+			
+		}
+		
+		batch_run_job(batch, pool, machine, (u32)job);
+		
+	}
+	
+	pool_free(pool);
+	
+	return 0;
+	
+}
+	
+// Number of processors available to run workers on
+static u32 batch_processor_count() {
+	
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	
+	GetSystemInfo(&info);
+	
+	return info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	return count > 0 ? (u32)count : 1;
+#endif
+	
+}
+	
+static f64 batch_seconds() {
+	
+#if defined(_WIN32)
+	LARGE_INTEGER counter, frequency;
+	
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	
+	return (f64)counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+	
+}
+	
+rr_batch_t *batch_new() {
+	
+	rr_batch_t *batch = (rr_batch_t *)calloc(1, sizeof(rr_batch_t));
+	
+	if(batch) {
+		
+		batch->max_cycles = BATCH_DEFAULT_CYCLES;
+		batch->detect_loops = 1;
+		
+	}
+	
+	return batch;
+	
+}
+	
+void batch_free(rr_batch_t *batch) {
+	
+	u32 c = 0;
+	
+	if(!batch)
+		return;
+		
+	for(; c < batch->job_count; c++)
+		free(batch->jobs[c].input_path);
+		
+	corpus_close(batch->corpus);
+	free(batch->jobs);
+	free(batch->output_dir);
+	free(batch);
+	
+}
+	
+u8 batch_add_job(rr_batch_t *batch, const char *input_path, u64 max_cycles) {
+	
+	rr_batch_job_t *job;
+	
+	if(batch->job_count == batch->job_capacity) {
+		
+		u32 capacity = batch->job_capacity ? batch->job_capacity << 1 : 64;
+		rr_batch_job_t *jobs = (rr_batch_job_t *)realloc(batch->jobs, capacity * sizeof(rr_batch_job_t));
+		
+		if(!jobs)
+			return 1;
+			
+		batch->jobs = jobs;
+		batch->job_capacity = capacity;
+		
+	}
+	
+	job = &batch->jobs[batch->job_count];
+	memset(job, 0, sizeof(rr_batch_job_t));
+	
+	if(input_path && !(job->input_path = strdup(input_path)))
+		return 1;
+		
+	job->max_cycles = max_cycles;
+	batch->job_count++;
+	
+	return 0;
+	
+}
+	
+u8 batch_add_corpus(rr_batch_t *batch, const char *corpus_filename) {
+	
+	u32 c = 0;
+	
+	if(batch->corpus || !(batch->corpus = corpus_open(corpus_filename)))
+		return 1;
+		
+	for(; c < corpus_count(batch->corpus); c++) {
+		
+		if(batch_add_job(batch, NULL, 0))
+			return 2;
+			
+		batch->jobs[batch->job_count - 1].corpus_index = c;
+		
+	}
+	
+	return 0;
+	
+}
+	
+u8 batch_load_manifest(rr_batch_t *batch, const char *manifest_filename) {
+	
+	char line[4096];
+	FILE *manifest = fopen(manifest_filename, "r");
+	
+	if(!manifest)
+		return 1;
+		
+	while(fgets(line, sizeof(line), manifest)) {
+		
+		char *path = line;
+		char *argument;
+		
+		line[strcspn(line, "\r\n")] = 0;
+		
+		while(*path == ' ' || *path == '\t')
+			path++;
+			
+		if(!*path || *path == '#')
+			continue;
+			
+		// Split off the last word, either a directive's argument or a job's cycle limit
+		argument = path + strcspn(path, " \t");
+		
+		if(*argument) {
+			
+			*argument++ = 0;
+			
+			while(*argument == ' ' || *argument == '\t')
+				argument++;
+				
+		}
+		
+		if(!strcmp(path, "output") && *argument) {
+			
+			free(batch->output_dir);
+			batch->output_dir = strdup(argument);
+			
+		}
+		else if(!strcmp(path, "threads") && *argument)
+			batch->thread_count = (u32)strtoul(argument, NULL, 0);
+		else if(!strcmp(path, "cycles") && *argument)
+			batch->max_cycles = strtoull(argument, NULL, 0);
+		else if(!strcmp(path, "detect") && *argument)
+			batch->detect_loops = strtoul(argument, NULL, 0) != 0;
+		else if(!strcmp(path, "corpus") && *argument) {
+			
+			u8 result = batch_add_corpus(batch, argument);
+			
+			if(result) {
+				
+				fclose(manifest);
+				
+				return result == 1 ? 3 : 2;
+				
+			}
+			
+		}
+		else if(batch_add_job(batch, path, *argument ? strtoull(argument, NULL, 0) : 0)) {
+			
+			fclose(manifest);
+			
+			return 2;
+			
+		}
+		
+	}
+	
+	fclose(manifest);
+	
+	if(!batch->output_dir) {
+		
+		size_t length = strlen(manifest_filename);
+		
+		if(!(batch->output_dir = (char *)malloc(length + 5)))
+			return 2;
+			
+		memcpy(batch->output_dir, manifest_filename, length);
+		memcpy(batch->output_dir + length, ".out", 5);
+		
+	}
+	
+	return 0;
+	
+}
+	
+u8 batch_run(rr_batch_t *batch) {
+	
+	rr_worker_t *workers;
+	u32 worker_count;
+	u32 started = 1;
+	u32 c;
+	FILE *stats;
+	char stats_path[4096];
+	
+	if(!batch->output_dir)
+		return 1;
+		
+	// Fine if it already exists, saving will tell us if it can't be used
+	make_directory(batch->output_dir);
+	
+	// Until a worker gets to it
+	for(c = 0; c < batch->job_count; c++)
+		batch->jobs[c].result = BATCH_NOT_RUN;
+		
+	// Workers steal from every deque while they run, so threads_used holds the number of deques until they are all done
+	worker_count = batch->threads_used = batch->thread_count ? batch->thread_count : batch_processor_count();
+	
+	if(worker_count > batch->job_count)
+		worker_count = batch->threads_used = batch->job_count ? batch->job_count : 1;
+		
+	workers = (rr_worker_t *)aligned_alloc(64, ((worker_count * sizeof(rr_worker_t) + 63) / 64) * 64);
+	
+	if(!workers)
+		return 2;
+		
+	memset(workers, 0, worker_count * sizeof(rr_worker_t));
+	
+	// Deal the jobs out in contiguous runs, stealing evens out whatever the cycle counts turn out to be
+	for(c = 0; c < worker_count; c++) {
+		
+		u32 first = (u32)((u64)batch->job_count * c / worker_count);
+		u32 last = (u32)((u64)batch->job_count * (c + 1) / worker_count);
+		
+		if(deque_init(&workers[c].deque, last - first + 1)) {
+			
+			// The deque that failed has nothing allocated, free the ones before it
+			while(c--)
+				free(workers[c].deque.items);
+				
+			free(workers);
+			
+			return 2;
+			
+		}
+		
+		workers[c].batch = batch;
+		workers[c].workers = workers;
+		workers[c].index = c;
+		
+		// Pushed in reverse so the owner pops them in manifest order
+		while(last-- > first)
+			deque_push(&workers[c].deque, last);
+			
+	}
+	
+	batch->seconds = batch_seconds();
+	
+	{
+		
+		// Threads are started in order until one can't be - the jobs dealt to the rest are stolen by the workers that did start
+#if defined(_WIN32)
+		HANDLE *threads = (HANDLE *)malloc(worker_count * sizeof(HANDLE));
+		
+		if(threads)
+			for(; started < worker_count; started++)
+				if(!(threads[started] = CreateThread(NULL, 0, batch_worker, &workers[started], 0, NULL)))
+					break;
+					
+		// The calling thread is worker 0
+		batch_worker(&workers[0]);
+		
+		for(c = 1; c < started; c++) {
+			
+			WaitForSingleObject(threads[c], INFINITE);
+			CloseHandle(threads[c]);
+			
+		}
+#else
+		pthread_t *threads = (pthread_t *)malloc(worker_count * sizeof(pthread_t));
+		
+		if(threads)
+			for(; started < worker_count; started++)
+				if(pthread_create(&threads[started], NULL, batch_worker, &workers[started]))
+					break;
+					
+		// The calling thread is worker 0
+		batch_worker(&workers[0]);
+		
+		for(c = 1; c < started; c++)
+			pthread_join(threads[c], NULL);
+#endif
+			
+		free(threads);
+		
+	}
+	
+	batch->seconds = batch_seconds() - batch->seconds;
+	batch->threads_used = started;
+	batch->steals = 0;
+	
+	for(c = 0; c < worker_count; c++) {
+		
+		batch->steals += workers[c].steals;
+		free(workers[c].deque.items);
+		
+	}
+	
+	free(workers);
+	
+	snprintf(stats_path, sizeof(stats_path), "%s/stats.csv", batch->output_dir);
+	
+	if(!(stats = fopen(stats_path, "w")))
+		return 3;
+		
+	fprintf(stats, "job,input,cycles,result,loop_entry,loop_period\n");
+	
+	for(c = 0; c < batch->job_count; c++) {
+		
+		static const char *result_names[6] = { "halted", "cycle_limit", "load_failed", "save_failed", "infinite_loop", "not_run" };
+		rr_batch_job_t *job = &batch->jobs[c];
+		const char *input = job->input_path;
+		
+		// Corpus images go by their packed name, or their place in the corpus
+		if(!input && !(input = corpus_name(batch->corpus, job->corpus_index)))
+			input = "";
+			
+		if(job->result == BATCH_INFINITE_LOOP)
+			fprintf(stats, "%06u,%s,%" PRIu64 ",%s,$%02X,%" PRIu64 "\n", c, input, job->cycles, result_names[job->result], job->loop_entry_pc, job->loop_period);
+		else
+			fprintf(stats, "%06u,%s,%" PRIu64 ",%s,,\n", c, input, job->cycles, result_names[job->result]);
+			
+	}
+	
+	fclose(stats);
+	
+	return 0;
+	
+}
\ No newline at end of file
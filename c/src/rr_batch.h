@@ -0,0 +1,79 @@
+#ifndef RR_BATCH_H
+#define RR_BATCH_H
+
+#include "rr_machine.h"
+#include "rr_corpus.h"
+
+// Cycle limit for jobs that don't give one
+#define BATCH_DEFAULT_CYCLES 1000000
+
+// How a job ended
+#define BATCH_HALTED 0
+#define BATCH_CYCLE_LIMIT 1
+#define BATCH_LOAD_FAILED 2
+#define BATCH_SAVE_FAILED 3
+#define BATCH_INFINITE_LOOP 4
+// No worker got to the job, as when none could be started
+#define BATCH_NOT_RUN 5
+
+typedef struct rr_batch_job_d {
+	// 256 byte memory image to run, NULL for an image from the batch's corpus
+	char *input_path;
+	u32 corpus_index;
+	// 0 uses the batch's cycle limit
+	u64 max_cycles;
+	// Filled in by batch_run
+	u64 cycles;
+	u8 result;
+	// Where the loop starts and cycles per trip around it, for BATCH_INFINITE_LOOP
+	u8 loop_entry_pc;
+	u64 loop_period;
+} rr_batch_job_t;
+
+typedef struct rr_batch_d {
+	rr_batch_job_t *jobs;
+	u32 job_count;
+	u32 job_capacity;
+	// Packed images queued by batch_add_corpus, loaded straight from the mapping
+	rr_corpus_t *corpus;
+	// Final memory images and stats.csv are written here
+	char *output_dir;
+	// 0 uses every online processor
+	u32 thread_count;
+	u64 max_cycles;
+	// Stop jobs that revisit an earlier state instead of running them out to their cycle limit (on by default)
+	u8 detect_loops;
+	// Filled in by batch_run - threads_used counts the workers that were actually started
+	u32 threads_used;
+	u64 steals;
+	f64 seconds;
+} rr_batch_t;
+
+rr_batch_t *batch_new();
+void batch_free(rr_batch_t *batch);
+
+// Queue a job, max_cycles of 0 uses the batch's limit
+u8 batch_add_job(rr_batch_t *batch, const char *input_path, u64 max_cycles);
+
+// Queue every image in a corpus (see rr_corpus.h) with the batch's cycle limit, only one corpus can be used per batch
+// Returns 1 if the corpus can't be opened (or one is already queued) or 2 if the jobs can't be allocated
+u8 batch_add_corpus(rr_batch_t *batch, const char *corpus_filename);
+
+// Read jobs and settings from a manifest, one per line:
+// <image path> [<max cycles>]   - queue a job
+// corpus <corpus path>           - queue every image in a packed corpus
+// output <dir>                   - output directory (defaults to the manifest path with ".out" appended)
+// threads <count>                - worker threads (defaults to the processor count)
+// cycles <count>                 - cycle limit for jobs that don't give one
+// detect <0|1>                   - turn infinite loop detection off or on
+// Blank lines and lines starting with # are skipped
+// Returns 1 if the manifest can't be opened, 2 if the jobs can't be allocated or 3 if a corpus can't be opened
+u8 batch_load_manifest(rr_batch_t *batch, const char *manifest_filename);
+
+// Run every job on a pool of worker threads, each job to a HALT, its cycle limit or a detected infinite loop
+// Workers write each job's final memory to <output dir>/<job number>.bin, stats.csv is written once they are all done
+// A worker thread that can't be started leaves its jobs to be stolen by the rest, any job no worker gets to is left as BATCH_NOT_RUN
+// Returns 1 without an output directory, 2 if the workers can't be allocated or 3 if stats.csv can't be written
+u8 batch_run(rr_batch_t *batch);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include "rr_corpus.h"
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Round up to the next multiple of CORPUS_ALIGNMENT
+#define CORPUS_ALIGN(x) (((x) + CORPUS_ALIGNMENT - 1) & ~(u64)(CORPUS_ALIGNMENT - 1))
+
+// Check every offset and size in the header against the mapping, so the accessors never have to
+static u8 corpus_valid(const rr_corpus_t *corpus) {
+	
+	const rr_corpus_header_t *header = (const rr_corpus_header_t *)corpus->data;
+	u64 index_size;
+	
+	if(corpus->size < sizeof(rr_corpus_header_t) || memcmp(header->magic, CORPUS_MAGIC, 4) || header->byte_order != CORPUS_BYTE_ORDER || header->version != CORPUS_VERSION)
+		return 0;
+		
+	index_size = (u64)header->image_count * sizeof(rr_corpus_entry_t);
+	
+	// Entries are read in place, so their u32 name offsets have to be aligned
+	if(header->index_offset % sizeof(u32) || header->index_offset > corpus->size || index_size > corpus->size - header->index_offset)
+		return 0;
+		
+	if(header->names_offset > corpus->size || header->names_size > corpus->size - header->names_offset)
+		return 0;
+		
+	// Names must end in a NUL so none of them can run off the end
+	if(header->names_size && corpus->data[header->names_offset + header->names_size - 1])
+		return 0;
+		
+	if(header->images_offset % CORPUS_ALIGNMENT || header->images_offset > corpus->size || (u64)header->image_count * 256 > corpus->size - header->images_offset)
+		return 0;
+		
+	return 1;
+	
+}
+
+rr_corpus_t *corpus_open(const char *corpus_filename) {
+	
+	rr_corpus_t *corpus = (rr_corpus_t *)calloc(1, sizeof(rr_corpus_t));
+	u32 c = 0;
+	
+	if(!corpus)
+		return NULL;
+		
+#if defined(_WIN32)
+	LARGE_INTEGER size;
+	
+	corpus->file = CreateFileA(corpus_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	
+	if(corpus->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(corpus->file, &size) || !size.QuadPart) {
+		
+		if(corpus->file != INVALID_HANDLE_VALUE)
+			CloseHandle(corpus->file);
+			
+		free(corpus);
+		return NULL;
+		
+	}
+	
+	corpus->size = size.QuadPart;
+	
+	if(!(corpus->mapping = CreateFileMappingA(corpus->file, NULL, PAGE_READONLY, 0, 0, NULL)) || !(corpus->data = (const u8 *)MapViewOfFile(corpus->mapping, FILE_MAP_READ, 0, 0, 0))) {
+		
+		if(corpus->mapping)
+			CloseHandle(corpus->mapping);
+			
+		CloseHandle(corpus->file);
+		free(corpus);
+		return NULL;
+		
+	}
+#elif defined(__unix__)
+	struct stat status;
+	void *data;
+	s32 fd = open(corpus_filename, O_RDONLY);
+	
+	if(fd < 0 || fstat(fd, &status) || !status.st_size) {
+		
+		if(fd >= 0)
+			close(fd);
+			
+		free(corpus);
+		return NULL;
+		
+	}
+	
+	corpus->size = status.st_size;
+	data = mmap(NULL, corpus->size, PROT_READ, MAP_SHARED, fd, 0);
+	
+	// The mapping holds the file open by itself
+	close(fd);
+	
+	if(data == MAP_FAILED) {
+		
+		free(corpus);
+		return NULL;
+		
+	}
+	
+	corpus->data = (const u8 *)data;
+#endif
+	
+	if(!corpus_valid(corpus)) {
+		
+		corpus_close(corpus);
+		return NULL;
+		
+	}
+	
+	corpus->header = (const rr_corpus_header_t *)corpus->data;
+	corpus->index = (const rr_corpus_entry_t *)(corpus->data + corpus->header->index_offset);
+	corpus->names = (const char *)(corpus->data + corpus->header->names_offset);
+	corpus->images = corpus->data + corpus->header->images_offset;
+	
+	// Name offsets are checked once here rather than on every lookup
+	for(; c < corpus->header->image_count; c++)
+		if(corpus->index[c].name_offset != CORPUS_NO_NAME && corpus->index[c].name_offset >= corpus->header->names_size) {
+			
+			corpus_close(corpus);
+			return NULL;
+			
+		}
+		
+	return corpus;
+	
+}
+
+void corpus_close(rr_corpus_t *corpus) {
+	
+	if(!corpus)
+		return;
+		
+#if defined(_WIN32)
+	UnmapViewOfFile(corpus->data);
+	CloseHandle(corpus->mapping);
+	CloseHandle(corpus->file);
+#elif defined(__unix__)
+	munmap((void *)corpus->data, corpus->size);
+#endif
+	
+	free(corpus);
+	
+}
+
+u32 corpus_count(const rr_corpus_t *corpus) {
+	
+	return corpus->header->image_count;
+	
+}
+
+const u8 *corpus_image(const rr_corpus_t *corpus, u32 index) {
+	
+	return index < corpus->header->image_count ? corpus->images + (u64)index * 256 : NULL;
+	
+}
+
+const char *corpus_name(const rr_corpus_t *corpus, u32 index) {
+	
+	if(index >= corpus->header->image_count || corpus->index[index].name_offset == CORPUS_NO_NAME)
+		return NULL;
+		
+	return corpus->names + corpus->index[index].name_offset;
+	
+}
+
+u8 machine_load_corpus(rr_machine_t *machine, const rr_corpus_t *corpus, u32 index) {
+	
+	const rr_corpus_entry_t *entry;
+	
+	if(index >= corpus->header->image_count)
+		return 1;
+		
+	entry = &corpus->index[index];
+	
+	machine_mark_memory(machine, corpus->images + (u64)index * 256);
+	memcpy(machine->memory, corpus->images + (u64)index * 256, 256);
+	
+	// Same as machine_load, the cache was built from the code being replaced
+	memset(machine->decode_cache, 0, sizeof(machine->decode_cache));
+	
+	if(entry->flags & CORPUS_HAS_STATE) {
+		
+		machine_mark_state(machine, entry->registers, entry->program_counter, entry->status_register & 0x0F, 0);
+		memcpy(machine->registers, entry->registers, 16);
+		machine->program_counter = entry->program_counter;
+		machine->status_register = entry->status_register & 0x0F;
+		machine->instruction_register = 0;
+		
+	}
+	
+	return 0;
+	
+}
+
+rr_corpus_builder_t *corpus_builder_new() {
+	
+	return (rr_corpus_builder_t *)calloc(1, sizeof(rr_corpus_builder_t));
+	
+}
+
+void corpus_builder_free(rr_corpus_builder_t *builder) {
+	
+	if(!builder)
+		return;
+		
+	free(builder->index);
+	free(builder->images);
+	free(builder->names);
+	free(builder);
+	
+}
+
+u8 corpus_builder_add(rr_corpus_builder_t *builder, const u8 *image, const char *name, const rr_machine_t *state) {
+	
+	rr_corpus_entry_t *entry;
+	
+	if(builder->image_count == builder->image_capacity) {
+		
+		u32 capacity = builder->image_capacity ? builder->image_capacity << 1 : 64;
+		rr_corpus_entry_t *index = (rr_corpus_entry_t *)realloc(builder->index, capacity * sizeof(rr_corpus_entry_t));
+		u8 *images;
+		
+		if(!index)
+			return 1;
+			
+		builder->index = index;
+		
+		if(!(images = (u8 *)realloc(builder->images, (u64)capacity * 256)))
+			return 1;
+			
+		builder->images = images;
+		builder->image_capacity = capacity;
+		
+	}
+	
+	entry = &builder->index[builder->image_count];
+	memset(entry, 0, sizeof(rr_corpus_entry_t));
+	entry->name_offset = CORPUS_NO_NAME;
+	
+	if(name) {
+		
+		u64 length = strlen(name) + 1;
+		
+		if(builder->names_size + length > CORPUS_NO_NAME)
+			return 1;
+			
+		if(builder->names_size + length > builder->names_capacity) {
+			
+			u64 capacity = builder->names_capacity ? builder->names_capacity : 4096;
+			char *names;
+			
+			while(capacity < builder->names_size + length)
+				capacity <<= 1;
+				
+			if(!(names = (char *)realloc(builder->names, capacity)))
+				return 1;
+				
+			builder->names = names;
+			builder->names_capacity = capacity;
+			
+		}
+		
+		memcpy(builder->names + builder->names_size, name, length);
+		entry->name_offset = builder->names_size;
+		builder->names_size += length;
+		
+	}
+	
+	if(state) {
+		
+		entry->flags |= CORPUS_HAS_STATE;
+		entry->program_counter = state->program_counter;
+		entry->status_register = state->status_register;
+		memcpy(entry->registers, state->registers, 16);
+		
+	}
+	
+	memcpy(builder->images + (u64)builder->image_count * 256, image, 256);
+	builder->image_count++;
+	
+	return 0;
+	
+}
+
+u8 corpus_builder_write(const rr_corpus_builder_t *builder, const char *corpus_filename) {
+	
+	rr_corpus_header_t header;
+	u8 padding[CORPUS_ALIGNMENT] = {0};
+	u64 index_size = (u64)builder->image_count * sizeof(rr_corpus_entry_t);
+	FILE *corpus_file;
+	u8 failed;
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CORPUS_MAGIC, 4);
+	header.byte_order = CORPUS_BYTE_ORDER;
+	header.version = CORPUS_VERSION;
+	header.image_count = builder->image_count;
+	header.index_offset = sizeof(header);
+	header.names_offset = header.index_offset + index_size;
+	header.names_size = builder->names_size;
+	header.images_offset = CORPUS_ALIGN(header.names_offset + header.names_size);
+	
+	if(!(corpus_file = fopen(corpus_filename, "wb")))
+		return 1;
+		
+	failed = fwrite(&header, sizeof(header), 1, corpus_file) != 1;
+	failed |= index_size && fwrite(builder->index, index_size, 1, corpus_file) != 1;
+	failed |= builder->names_size && fwrite(builder->names, builder->names_size, 1, corpus_file) != 1;
+	failed |= header.images_offset > header.names_offset + header.names_size && fwrite(padding, header.images_offset - header.names_offset - header.names_size, 1, corpus_file) != 1;
+	failed |= builder->image_count && fwrite(builder->images, (u64)builder->image_count * 256, 1, corpus_file) != 1;
+	
+	if(fclose(corpus_file))
+		failed = 1;
+		
+	return failed ? 2 : 0;
+	
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef RR_CORPUS_H
+#define RR_CORPUS_H
+
+#include "rr_machine.h"
+
+// Corpus file layout - a header, an index entry per image, the image names, then the images themselves, 256 bytes each and 256 byte aligned
+// Multi-byte fields are written in the host's byte order and checked against byte_order when the corpus is opened
+#define CORPUS_MAGIC "RRCP"
+#define CORPUS_VERSION 1
+#define CORPUS_BYTE_ORDER 0x01020304
+#define CORPUS_ALIGNMENT 256
+// Index entries for images packed without a name
+#define CORPUS_NO_NAME 0xFFFFFFFF
+
+// The entry gives the state to start the image from, otherwise loading it leaves the registers alone
+#define CORPUS_HAS_STATE 1
+
+typedef struct rr_corpus_header_d {
+	char magic[4];
+	u32 byte_order;
+	u32 version;
+	u32 image_count;
+	// Offsets from the start of the file
+	u64 index_offset;
+	u64 names_offset;
+	u64 names_size;
+	u64 images_offset;
+} rr_corpus_header_t;
+
+typedef struct rr_corpus_entry_d {
+	// Offset of the NUL-terminated name within the names, CORPUS_NO_NAME for none
+	u32 name_offset;
+	u8 flags;
+	// Starting state, for CORPUS_HAS_STATE
+	u8 program_counter;
+	u8 status_register;
+	u8 reserved;
+	u8 registers[16];
+} rr_corpus_entry_t;
+
+// An open corpus - every accessor reads straight out of the mapping, so none of them make a system call
+typedef struct rr_corpus_d {
+	const u8 *data;
+	u64 size;
+	const rr_corpus_header_t *header;
+	const rr_corpus_entry_t *index;
+	const char *names;
+	const u8 *images;
+#if defined(_WIN32)
+	HANDLE file;
+	HANDLE mapping;
+#endif
+} rr_corpus_t;
+
+// Images gathered in memory by the packer, written out in one go by corpus_builder_write
+typedef struct rr_corpus_builder_d {
+	rr_corpus_entry_t *index;
+	u8 *images;
+	u32 image_count;
+	u32 image_capacity;
+	char *names;
+	u64 names_size;
+	u64 names_capacity;
+} rr_corpus_builder_t;
+
+// Map a corpus read-only, returns NULL if it can't be opened or isn't a valid version CORPUS_VERSION corpus
+rr_corpus_t *corpus_open(const char *corpus_filename);
+void corpus_close(rr_corpus_t *corpus);
+
+u32 corpus_count(const rr_corpus_t *corpus);
+// The 256 bytes of an image, in place in the mapping
+const u8 *corpus_image(const rr_corpus_t *corpus, u32 index);
+// NULL for images packed without a name
+const char *corpus_name(const rr_corpus_t *corpus, u32 index);
+
+// Copy an image into main memory (and its starting state, if it has one), returns 1 for an index past the end
+u8 machine_load_corpus(rr_machine_t *machine, const rr_corpus_t *corpus, u32 index);
+
+rr_corpus_builder_t *corpus_builder_new();
+void corpus_builder_free(rr_corpus_builder_t *builder);
+
+// Add a 256 byte image, name and state may be NULL - state gives the registers, program counter and status register to start from
+// Returns 1 if the builder can't grow
+u8 corpus_builder_add(rr_corpus_builder_t *builder, const u8 *image, const char *name, const rr_machine_t *state);
+
+// Write the corpus out, returns 1 if the file can't be opened or 2 if it can't be written
+u8 corpus_builder_write(const rr_corpus_builder_t *builder, const char *corpus_filename);
+
+#endif
\ No newline at end of file
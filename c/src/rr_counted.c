@@ -0,0 +1,218 @@
+#include "rr_machine.h"
+
+// A counted loop is a straight run of register-only instructions closed by ADC <counter>, <counter>, <step> then BRA back to its head while Z is clear
+// Every register the body writes is worked out from registers the loop never writes, or ones written earlier in the same trip, so after one trip they hold the value every later trip leaves
+// Only the counter changes from trip to trip, which leaves the ADC/BRA pair at the end - its sums can be done without running the body in between
+
+static u16 counted_instruction(const rr_machine_t *machine, u8 address) {
+	
+	return (MEM(machine, address) << 8) | MEM(machine, (u8)(address + 1));
+	
+}
+
+u8 machine_counted_loop(const rr_machine_t *machine, u8 address, rr_counted_loop_t *loop) {
+	
+	u8 operands[4];
+	u16 written = 0;
+	// Registers holding the same value on every trip by the point reached, and whether the carry does too
+	u16 ready;
+	u8 carry_ready = 0;
+	u8 c;
+	
+	// The branch has to sit right after the ADC without wrapping around memory
+	if(address > 0xFD)
+		return 0;
+		
+	machine_decode_instruction(counted_instruction(machine, address), operands);
+	
+	if(operands[0] != 0x1)
+		return 0;
+		
+	loop->end = address;
+	loop->counter = operands[1];
+	
+	// The counter has to be one of the two added registers, not both
+	if(operands[2] == operands[1] && operands[3] != operands[1])
+		loop->step = operands[3];
+	else if(operands[3] == operands[1] && operands[2] != operands[1])
+		loop->step = operands[2];
+	else
+		return 0;
+		
+	// Branch back (or onto the ADC itself) only while Z is clear
+	machine_decode_instruction(counted_instruction(machine, address + 2), operands);
+	
+	if(operands[0] != 0xE || operands[1] != 0b0010 || (operands[2] & 0b0010) || operands[3] > address || ((address - operands[3]) & 1))
+		return 0;
+		
+	loop->head = operands[3];
+	loop->body_length = (address - loop->head) >> 1;
+	
+	// Only instructions that neither touch memory (other than reading it) nor move the program counter, and nothing else may write the counter
+	for(c = 0; c < loop->body_length; c++) {
+		
+		machine_decode_instruction(counted_instruction(machine, loop->head + 2 * c), operands);
+		
+		switch(operands[0]) {
+			
+			case 0x1:
+			case 0x2:
+			case 0x3:
+			case 0x4:
+			case 0x5:
+			case 0x6:
+			case 0x7:
+				written |= 1 << operands[1];
+				break;
+				
+			case 0xF:
+				break;
+				
+			default:
+				return 0;
+				
+		}
+		
+	}
+	
+	if(written & (1 << loop->counter))
+		return 0;
+		
+	// Walk the body in order, each value read has to be ready and none may be the counter
+	ready = ~written & ~(1 << loop->counter);
+	
+	for(c = 0; c < loop->body_length; c++) {
+		
+		u16 reads = 0;
+		
+		machine_decode_instruction(counted_instruction(machine, loop->head + 2 * c), operands);
+		
+		switch(operands[0]) {
+			
+			// Adds the carry in and sets it
+			case 0x1:
+			// Rotates the carry in and sets it (unless the rotation is 0, which leaves it and the destination alone)
+			// The Z it sets comes from the old destination value, but the ADC at the end overwrites Z before anything reads it
+			case 0x4:
+				if(!carry_ready)
+					return 0;
+				reads = (1 << operands[2]) | (1 << operands[3]);
+				break;
+				
+			case 0x2:
+			case 0x3:
+				reads = (1 << operands[2]) | (1 << operands[3]);
+				break;
+				
+			case 0x7:
+				reads = 1 << operands[2];
+				break;
+				
+			// Setting the carry makes it the same on every trip
+			case 0xF:
+				if(operands[1] & 0b0001)
+					carry_ready = 1;
+				break;
+				
+		}
+		
+		if(reads & ~ready)
+			return 0;
+			
+		if(operands[0] != 0xF)
+			ready |= 1 << operands[1];
+			
+	}
+	
+	loop->fixed_carry = carry_ready;
+	
+	return 1;
+	
+}
+
+// ADC/BRA pairs run from a counter value until the counter reaches 0, adding the same delta every time, 0 when it never does
+static u64 counted_loop_trips(u8 counter, u8 delta) {
+	
+	u8 remaining = -counter;
+	u8 low_bit;
+	u8 inverse;
+	u16 modulus;
+	u16 trips;
+	
+	if(!delta)
+		return remaining ? 0 : 1;
+		
+	// delta = odd * low_bit, so trips * odd = remaining / low_bit modulo 256 / low_bit
+	low_bit = delta & -delta;
+	
+	if(remaining & (low_bit - 1))
+		return 0;
+		
+	modulus = 256 / low_bit;
+	
+	// Newton's iteration for the inverse of an odd number, each step doubles the bits that are right (3 to begin with)
+	inverse = delta / low_bit;
+	inverse *= 2 - (delta / low_bit) * inverse;
+	inverse *= 2 - (delta / low_bit) * inverse;
+	inverse *= 2 - (delta / low_bit) * inverse;
+	
+	trips = (u8)((remaining / low_bit) * inverse) % modulus;
+	
+	return trips ? trips : modulus;
+	
+}
+
+u64 counted_loop_run(const rr_counted_loop_t *loop, u8 *registers, u8 *flags, u64 max_cycles) {
+	
+	u8 counter = registers[loop->counter];
+	u8 step = registers[loop->step];
+	u8 carry = *flags & 0b0001;
+	u64 trip = loop->body_length + 2;
+	u64 cycles = 0;
+	u16 sum;
+	u16 c;
+	
+	if(max_cycles < 2)
+		return 0;
+		
+	// The same carry goes in every time, so the counter moves by a fixed delta and the trip count is a modular division
+	if(loop->fixed_carry) {
+		
+		u8 delta = step + carry;
+		u64 trips = counted_loop_trips(counter, delta);
+		
+		// Not enough cycles to finish (or it never does), stop at the head after as many pairs as fit - each one but the first preceded by a pass through the body
+		if(!trips || (trips - 1) * trip + 2 > max_cycles)
+			trips = (max_cycles - 2) / trip + 1;
+			
+		counter += (u8)((trips - 1) * delta);
+		sum = counter + step + carry;
+		
+		registers[loop->counter] = sum & 0xFF;
+		*flags = (((sum & 0xFF) == 0) << 1) | (sum >> 8);
+		
+		return (trips - 1) * trip + 2;
+		
+	}
+	
+	// Otherwise each carry out is the next carry in - there are only 512 counter and carry combinations, so the pairs are run on their own (a loop that gets through all of them never ends)
+	for(c = 0; ; c++) {
+		
+		sum = counter + step + carry;
+		counter = sum & 0xFF;
+		carry = sum >> 8;
+		cycles += 2;
+		
+		if(!counter || cycles + trip > max_cycles || c == 511)
+			break;
+			
+		cycles += loop->body_length;
+		
+	}
+	
+	registers[loop->counter] = counter;
+	*flags = ((counter == 0) << 1) | carry;
+	
+	return cycles;
+	
+}
\ No newline at end of file
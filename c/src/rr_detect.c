@@ -0,0 +1,175 @@
+#include "rr_machine.h"
+
+// The machine is a finite state machine (program counter, flags, 16 registers, 256 bytes of memory), so a run that never halts must eventually revisit a state exactly
+// Brent's algorithm finds the repeat by saving the state at every power of two cycles and comparing each later state against it
+// The search runs in the threaded interpreter, which only looks past the program counter when it equals the saved one
+// Finding where the loop starts means replaying the run in lockstep, there each state carries a fingerprint - a weighted sum of every register and memory byte - updated from only the bytes an instruction wrote
+
+// Weight of a byte in the fingerprint - registers are positions 0-15, memory 16-271
+static inline u64 detect_weight(u32 position) {
+	
+	u64 x = position + 0x9E3779B97F4A7C15;
+	
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+	
+	return x ^ (x >> 31);
+	
+}
+
+// Run one full cycle, adding whatever it changed to the fingerprint
+static u8 detect_step(rr_machine_t *machine, u64 *fingerprint) {
+	
+	rr_decoded_t *entry = &machine->decode_cache[machine->program_counter];
+	u8 reg;
+	u8 address;
+	u8 old_reg, old_sp, old_mem;
+	
+	if(!entry->valid)
+		entry = machine_predecode(machine, machine->program_counter);
+		
+	// At most one general register, the stack pointer and one memory cell can change - for instructions that don't write them these are just read back unchanged
+	reg = entry->operands[1] & 0x0F;
+	
+	switch(entry->operands[0]) {
+		
+		case 0x8:
+			address = entry->operands[2];
+			break;
+			
+		case 0x9:
+			address = REG(machine, entry->operands[2]);
+			break;
+			
+		case 0xA:
+		case 0xC:
+			address = STACK_POINTER(machine);
+			break;
+			
+		default:
+			address = 0;
+			break;
+			
+	}
+	
+	old_reg = REG(machine, reg);
+	old_sp = STACK_POINTER(machine);
+	old_mem = MEM(machine, address);
+	
+	machine->instruction_register = entry->instruction;
+	memcpy(machine->operands, entry->operands, 4);
+	MARK_STATE(machine, CHANGED_IR);
+	
+	machine_execute(machine);
+	
+	if(reg != 15)
+		*fingerprint += (u64)(REG(machine, reg) - old_reg) * detect_weight(reg);
+		
+	*fingerprint += (u64)(STACK_POINTER(machine) - old_sp) * detect_weight(15);
+	*fingerprint += (u64)(MEM(machine, address) - old_mem) * detect_weight(16 + address);
+	
+	return CURRENT_STATE(machine);
+	
+}
+
+static u8 detect_same_state(const rr_machine_t *a, u64 a_fingerprint, const rr_machine_t *b, u64 b_fingerprint) {
+	
+	return a->program_counter == b->program_counter &&
+		(a->status_register & 0b0011) == (b->status_register & 0b0011) &&
+		a_fingerprint == b_fingerprint &&
+		!memcmp(a->registers, b->registers, 16) &&
+		!memcmp(a->memory, b->memory, 256);
+		
+}
+
+// Find where the loop starts by replaying from the initial state - one copy runs a period ahead of the other, and they first meet at the loop's entry
+static void detect_entry(const rr_machine_t *initial, u64 period, rr_loop_t *loop) {
+	
+	rr_machine_t tortoise = *initial;
+	rr_machine_t hare = *initial;
+	u64 tortoise_fingerprint = 0;
+	u64 hare_fingerprint = 0;
+	u64 c = 0;
+	
+	for(; c < period; c++)
+		detect_step(&hare, &hare_fingerprint);
+		
+	while(!detect_same_state(&tortoise, tortoise_fingerprint, &hare, hare_fingerprint)) {
+		
+		detect_step(&tortoise, &tortoise_fingerprint);
+		detect_step(&hare, &hare_fingerprint);
+		loop->entry_cycle++;
+		
+	}
+	
+	loop->entry_pc = tortoise.program_counter;
+	loop->period = period;
+	
+}
+
+u8 machine_run_detect(rr_machine_t *machine, u64 max_cycles, rr_loop_t *loop) {
+	
+	rr_loop_t unused;
+	rr_machine_t initial;
+	rr_machine_t tortoise;
+	u64 cycle_limit = max_cycles ? max_cycles : UINT64_MAX;
+	u64 power = 1;
+	u64 period;
+	
+	if(!loop)
+		loop = &unused;
+		
+	memset(loop, 0, sizeof(rr_loop_t));
+	
+	if(CURRENT_STATE(machine) == 0b11)
+		return RUN_HALTED;
+		
+	// Finish a cycle that was left partway through so every compared state is at the start of a cycle
+	if(CURRENT_STATE(machine)) {
+		
+		loop->cycles++;
+		
+		if(machine_step(machine, 0) == 0b11)
+			return RUN_HALTED;
+			
+	}
+	
+	initial = *machine;
+	tortoise = *machine;
+	loop->entry_cycle = loop->cycles;
+	
+	while(1) {
+		
+		u64 window = power;
+		
+		if(window > cycle_limit - loop->cycles)
+			window = cycle_limit - loop->cycles;
+			
+		if(!window)
+			return RUN_CYCLE_LIMIT;
+			
+		period = machine_run_until_state(machine, window, &tortoise);
+		loop->cycles += period;
+		
+		if(CURRENT_STATE(machine) == 0b11)
+			return RUN_HALTED;
+			
+		// The run also stops when the window is used up, which may land on the saved state too
+		if(detect_same_state(&tortoise, 0, machine, 0))
+			break;
+			
+		// Move the saved state up to the current one, doubling how far ahead it may be looked for
+		tortoise.program_counter = machine->program_counter;
+		tortoise.status_register = machine->status_register;
+		memcpy(tortoise.registers, machine->registers, 16);
+		memcpy(tortoise.memory, machine->memory, 256);
+		
+		power <<= 1;
+		
+	}
+	
+	detect_entry(&initial, period, loop);
+	
+	return RUN_INFINITE_LOOP;
+	
+}
\ No newline at end of file
@@ -0,0 +1,691 @@
+// Body of the threaded interpreter, included by rr_machine_fast.c once per variant
+// FAST_RUN_NAME names the function, FAST_CHECK picks the check built in before each cycle - kept out of the plain variant so it costs nothing there
+// FAST_CHECK_NONE runs plainly, FAST_CHECK_MATCH stops on reaching the match state, FAST_CHECK_CONDITIONS stops once any of the conditions holds
+// FAST_CHECK_TRACE never stops early, each handler records what it wrote to the trace instead - FAST_CHECK_OBSERVE the same, as events for an observer
+// FAST_CHECK_PROFILE never stops early either, it counts each fetch and each handler counts its memory accesses, branches and calls
+// FAST_CHECK_BREAK stops on reaching an address in the breakpoint bitmap, FAST_CHECK_WATCH also after a handler reads or writes a cell in the watch bitmaps
+// Only the plain variant runs fused sequences (FUSE_*) - the others check, trace or count every instruction on its own
+
+// Fetch the next predecoded instruction from the cache, decoding it first if needed
+// The checking variants stop before the first cycle that would start from a state passing the check (never at the very start of the run)
+#if FAST_CHECK == FAST_CHECK_MATCH
+#define FAST_FETCH() {														\
+	if(pc == match_pc && cycles_left != cycle_limit && FAST_MATCHES())		\
+		goto write_back;													\
+	FAST_FETCH_ENTRY();														\
+}
+#elif FAST_CHECK == FAST_CHECK_CONDITIONS
+#define FAST_FETCH() {														\
+	if(cycles_left != cycle_limit && 										\
+		conditions_met(conditions, pc, registers, memory))					\
+		goto write_back;													\
+	FAST_FETCH_ENTRY();														\
+}
+#elif FAST_CHECK == FAST_CHECK_BREAK || FAST_CHECK == FAST_CHECK_WATCH
+#define FAST_FETCH() {														\
+	if(FAST_WATCH_HIT())													\
+		goto write_back;													\
+	if(BITMAP_TEST(breaks, pc) && cycles_left != cycle_limit) {			\
+		watch->stopped = WATCH_BREAK;										\
+		watch->address = watch->pc = pc;									\
+		goto write_back;													\
+	}																		\
+	FAST_FETCH_ENTRY();														\
+}
+#elif FAST_CHECK == FAST_CHECK_PROFILE
+#define FAST_FETCH() {														\
+	FAST_FETCH_ENTRY();														\
+	profile->pc_counts[pc]++;												\
+	profile->opcode_counts[entry->operands[0]]++;							\
+	FAST_COUNT_FUSION();													\
+}
+
+// Count the fused sequences the plain variant would start, skipping the instructions inside each one
+#define FAST_COUNT_FUSION() {												\
+	if(fused_left)															\
+		fused_left--;														\
+	else if(entry->handler >= FUSE_FIRST) {									\
+		profile->fusions[entry->handler - FUSE_FIRST]++;					\
+		fused_left = entry->handler >= FUSE_PSH_PSH_JSR ? 2 : 1;			\
+	}																		\
+}
+#else
+#define FAST_FETCH() FAST_FETCH_ENTRY()
+#endif
+
+// Record the cycle just run, while pc still holds its address - each handler knows what it wrote, so nothing has to be worked out again
+// Trace records carry the state bits for HLT as trace_put_machine's do, state is 0 until HLT sets it
+#if FAST_CHECK == FAST_CHECK_TRACE
+#define FAST_TRACE(kind, location, value) trace_put(trace, pc, entry->instruction, FAST_FLAGS() | state, registers[15], kind, location, value)
+#elif FAST_CHECK == FAST_CHECK_OBSERVE
+#define FAST_TRACE(kind, location, value) observe_put(observer, OBSERVE_ALL, pc, entry->instruction, FAST_FLAGS(), registers[15], kind, location, value)
+#else
+#define FAST_TRACE(kind, location, value)
+#endif
+
+// Count something about the cycle about to run, before its handler changes any state
+#if FAST_CHECK == FAST_CHECK_PROFILE
+#define FAST_PROFILE(count) count
+#else
+#define FAST_PROFILE(count)
+#endif
+
+// Note a memory access by the cycle about to run when its cell is watched, stopping at the next fetch - only the access that stopped the run is reported
+#if FAST_CHECK == FAST_CHECK_WATCH
+#define FAST_WATCH_HIT() (watch_hit)
+#define FAST_WATCH(kind, bits, location) {									\
+	if(BITMAP_TEST(bits, location)) {										\
+		watch_hit = 1;														\
+		watch->stopped = (kind);											\
+		watch->address = (location);										\
+		watch->pc = pc;														\
+	}																		\
+}
+#else
+#define FAST_WATCH_HIT() 0
+#define FAST_WATCH(kind, bits, location)
+#endif
+#define FAST_WATCH_READ(location) FAST_WATCH(WATCH_READ, reads, location)
+#define FAST_WATCH_WRITE(location) FAST_WATCH(WATCH_WRITE, writes, location)
+
+// Lazy flags keep the value Z is tested on and the carry apart, packing them into SR bits only for the instructions that read them (ADC, ROT, BRA, MDF), trace records, state matches and the write back
+// Most instructions only set Z, so they just keep their result
+#if RR_LAZY_FLAGS
+#define FAST_SET_Z(value) (zero_value = (value))
+#define FAST_SET_ZC(value, c) (zero_value = (value), carry = (c))
+#define FAST_LOAD_FLAGS(f) (zero_value = !((f) & 0b0010), carry = (f) & 0b0001)
+#define FAST_CARRY() (carry)
+#define FAST_FLAGS() (((zero_value == 0) << 1) | carry)
+#else
+#define FAST_SET_Z(value) (flags = (flags & 0b0001) | (((value) == 0) << 1))
+#define FAST_SET_ZC(value, c) (flags = (((value) == 0) << 1) | (c))
+#define FAST_LOAD_FLAGS(f) (flags = (f) & 0b0011)
+#define FAST_CARRY() (flags & 1)
+#define FAST_FLAGS() (flags)
+#endif
+
+#define FAST_FETCH_ENTRY() {												\
+	if(!cycles_left)														\
+		goto write_back;													\
+	cycles_left--;															\
+																			\
+	entry = &machine->decode_cache[pc];										\
+	if(!entry->valid)														\
+		entry = machine_predecode(machine, pc);								\
+}
+
+// Handler an entry is dispatched to - its fused sequence where there is one, in the variant that runs them
+#if FAST_CHECK == FAST_CHECK_NONE
+#define FAST_FUSING 1
+#define FAST_INDEX(e) ((e)->handler)
+#else
+#define FAST_FUSING 0
+#define FAST_INDEX(e) ((e)->operands[0])
+#endif
+
+// Only reached when the program counter matches, so the common case costs a single compare
+#define FAST_MATCHES() (													\
+	FAST_FLAGS() == (match->status_register & 0b0011) &&				\
+	!memcmp(registers, match->registers, 16) &&								\
+	!memcmp(memory, match->memory, 256)										\
+)
+
+#if RR_THREADED
+// Each handler ends with its own copy of the dispatch so every jump gets its own prediction history
+#define FAST_HANDLER(num, label) label:
+#define FAST_NEXT() {														\
+	FAST_FETCH();															\
+	goto *handlers[FAST_INDEX(entry)];										\
+}
+#define FAST_FUSE_DISPATCH() goto *handlers[entry->handler]
+#else
+#define FAST_HANDLER(num, label) case num:
+#define FAST_NEXT() goto dispatch
+#define FAST_FUSE_DISPATCH() goto dispatch_entry
+#endif
+
+// Fetch the next instruction of a fused sequence, once the one before it has run - anything else (the code was changed since the sequence was found, or the instruction starts a sequence of its own) is dispatched as usual
+#define FAST_FUSE_NEXT(opcode) {											\
+	FAST_FETCH_ENTRY();														\
+	if(entry->handler != (opcode))											\
+		FAST_FUSE_DISPATCH();												\
+}
+
+// Run full cycles with everything hot kept in locals, writing the machine back on halt, when max_cycles runs out (0 for no limit) or when the check passes
+static u64 FAST_RUN_NAME(rr_machine_t *machine, u64 max_cycles, const rr_machine_t *match, rr_conditions_t *conditions, rr_trace_t *trace, rr_profile_t *profile, rr_watch_t *watch, rr_observer_t *observer) {
+
+	u8 registers[16];
+	u8 *memory = machine->memory;
+	u8 pc;
+#if RR_LAZY_FLAGS
+	u8 zero_value;
+	u8 carry;
+#else
+	u8 flags;
+#endif
+	// Set to halt by HLT
+	u8 state = 0;
+	u64 cycle_limit = max_cycles ? max_cycles : UINT64_MAX;
+	u64 cycles_left = cycle_limit;
+	rr_decoded_t *entry = NULL;
+#if FAST_CHECK == FAST_CHECK_MATCH
+	u8 match_pc = match->program_counter;
+#elif FAST_CHECK == FAST_CHECK_PROFILE
+	u8 fused_left = 0;
+#elif FAST_CHECK == FAST_CHECK_BREAK || FAST_CHECK == FAST_CHECK_WATCH
+	// Copied so the bitmaps can't be taken for memory the handlers write, and reloaded every cycle
+	u64 breaks[4];
+#if FAST_CHECK == FAST_CHECK_WATCH
+	u64 reads[4];
+	u64 writes[4];
+	u8 watch_hit = 0;
+#endif
+#endif
+#if FAST_FUSING
+	// Address of the counted loop's ADC once a branch back to its head has been taken - reaching it again means a whole trip ran (the body is straight line code)
+	u16 loop_armed = 0x100;
+	rr_counted_loop_t counted;
+#endif
+
+#if RR_THREADED
+	static void *handlers[FUSE_FIRST + FAST_FUSING * FUSE_COUNT] = {
+		&&op_hlt, &&op_adc, &&op_and, &&op_xor,
+		&&op_rot, &&op_ldi, &&op_ldm, &&op_ldr,
+		&&op_sto, &&op_str, &&op_psh, &&op_pop,
+		&&op_jsr, &&op_ret, &&op_bra, &&op_mdf,
+#if FAST_FUSING
+		&&op_ldi_adc, &&op_adc_bra, &&op_counted_loop, &&op_psh_psh_jsr, &&op_pop_pop_ret
+#endif
+	};
+#endif
+
+	if(CURRENT_STATE(machine) == 0b11)
+		return 0;
+
+	// Finish a cycle that was left partway through so the loop always starts at a fetch
+	if(CURRENT_STATE(machine)) {
+
+		cycles_left--;
+
+		if(machine_step(machine, 0) == 0b11 || !cycles_left)
+			return 1;
+
+	}
+
+	memcpy(registers, machine->registers, 16);
+	pc = machine->program_counter;
+	FAST_LOAD_FLAGS(machine->status_register);
+#if FAST_CHECK == FAST_CHECK_BREAK || FAST_CHECK == FAST_CHECK_WATCH
+	memcpy(breaks, watch->breaks, sizeof(breaks));
+#if FAST_CHECK == FAST_CHECK_WATCH
+	memcpy(reads, watch->reads, sizeof(reads));
+	memcpy(writes, watch->writes, sizeof(writes));
+#endif
+#endif
+
+#if RR_THREADED
+	FAST_NEXT();
+#else
+	dispatch:
+	FAST_FETCH();
+
+#if FAST_FUSING
+	dispatch_entry:
+#endif
+	switch(FAST_INDEX(entry)) {
+#endif
+
+		// Halt
+		FAST_HANDLER(0x0, op_hlt)
+
+			state = 0b1100;
+			FAST_TRACE(TRACE_WRITE_NONE, 0, 0);
+
+			pc += 2;
+			goto write_back;
+
+		// Add with carry
+		FAST_HANDLER(0x1, op_adc)
+
+			{
+
+				u16 temp = registers[entry->operands[2]] + registers[entry->operands[3]] + FAST_CARRY();
+				registers[entry->operands[1]] = temp & 0xFF;
+				FAST_SET_ZC(temp & 0xFF, temp >> 8);
+
+			}
+
+			FAST_TRACE(TRACE_WRITE_REGISTER, entry->operands[1], registers[entry->operands[1]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// AND
+		FAST_HANDLER(0x2, op_and)
+
+			registers[entry->operands[1]] = registers[entry->operands[2]] & registers[entry->operands[3]];
+			FAST_SET_Z(registers[entry->operands[1]]);
+			FAST_TRACE(TRACE_WRITE_REGISTER, entry->operands[1], registers[entry->operands[1]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// XOR
+		FAST_HANDLER(0x3, op_xor)
+
+			registers[entry->operands[1]] = registers[entry->operands[2]] ^ registers[entry->operands[3]];
+			FAST_SET_Z(registers[entry->operands[1]]);
+			FAST_TRACE(TRACE_WRITE_REGISTER, entry->operands[1], registers[entry->operands[1]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Rotate register
+		FAST_HANDLER(0x4, op_rot)
+
+			{
+
+				u8 shift_count = registers[entry->operands[3]] & 0b0111;
+				u8 source = registers[entry->operands[2]];
+				u16 temp;
+
+				// Matches machine_execute - no rotation leaves the flags alone, and Z comes from the old destination value
+				if(shift_count) {
+
+					// Rotate right
+					if(registers[entry->operands[3]] & 0b1000) {
+
+						temp = FAST_CARRY() << (8 - shift_count);
+						temp |= source >> shift_count;
+						temp |= source << (9 - shift_count);
+
+						FAST_SET_ZC(registers[entry->operands[1]], (source >> (shift_count - 1)) & 1);
+
+					}
+					// Rotate left
+					else {
+
+						temp = FAST_CARRY() << (shift_count - 1);
+						temp |= source >> (9 - shift_count);
+						temp |= source << shift_count;
+
+						FAST_SET_ZC(registers[entry->operands[1]], (source >> (8 - shift_count)) & 1);
+
+					}
+
+					registers[entry->operands[1]] = temp & 0xFF;
+
+				}
+
+			}
+
+			FAST_TRACE(TRACE_WRITE_REGISTER, entry->operands[1], registers[entry->operands[1]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Load immediate
+		FAST_HANDLER(0x5, op_ldi)
+
+			registers[entry->operands[1]] = entry->operands[2];
+			FAST_SET_Z(entry->operands[2]);
+			FAST_TRACE(TRACE_WRITE_REGISTER, entry->operands[1], registers[entry->operands[1]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Load from memory
+		FAST_HANDLER(0x6, op_ldm)
+
+			FAST_PROFILE(profile->memory_reads[entry->operands[2]]++);
+			FAST_WATCH_READ(entry->operands[2]);
+			registers[entry->operands[1]] = memory[entry->operands[2]];
+			FAST_SET_Z(registers[entry->operands[1]]);
+			FAST_TRACE(TRACE_WRITE_REGISTER, entry->operands[1], registers[entry->operands[1]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Load from memory with register offset
+		FAST_HANDLER(0x7, op_ldr)
+
+			FAST_PROFILE(profile->memory_reads[registers[entry->operands[2]]]++);
+			FAST_WATCH_READ(registers[entry->operands[2]]);
+			registers[entry->operands[1]] = memory[registers[entry->operands[2]]];
+			FAST_SET_Z(registers[entry->operands[1]]);
+			FAST_TRACE(TRACE_WRITE_REGISTER, entry->operands[1], registers[entry->operands[1]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Store
+		FAST_HANDLER(0x8, op_sto)
+
+			FAST_PROFILE(profile->memory_writes[entry->operands[2]]++);
+			FAST_WATCH_WRITE(entry->operands[2]);
+			memory[entry->operands[2]] = registers[entry->operands[1]];
+			INVALIDATE_DECODE(machine, entry->operands[2]);
+			FAST_SET_Z(registers[entry->operands[1]]);
+			FAST_TRACE(TRACE_WRITE_MEMORY, entry->operands[2], memory[entry->operands[2]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Store at register offset
+		FAST_HANDLER(0x9, op_str)
+
+			{
+
+				u8 address = registers[entry->operands[2]];
+
+				FAST_PROFILE(profile->memory_writes[address]++);
+				FAST_WATCH_WRITE(address);
+				memory[address] = registers[entry->operands[1]];
+				INVALIDATE_DECODE(machine, address);
+				FAST_SET_Z(registers[entry->operands[1]]);
+				FAST_TRACE(TRACE_WRITE_MEMORY, address, memory[address]);
+
+			}
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Push register
+		FAST_HANDLER(0xA, op_psh)
+
+			FAST_PROFILE(profile->memory_writes[registers[15]]++);
+			FAST_WATCH_WRITE(registers[15]);
+			INVALIDATE_DECODE(machine, registers[15]);
+
+			// The decrement lands before the register is read, so pushing the stack pointer itself stores SP - 1 (same as MACHINE_PUSH)
+			registers[15]--;
+			memory[(u8)(registers[15] + 1)] = registers[entry->operands[1]];
+			FAST_TRACE(TRACE_WRITE_MEMORY, registers[15] + 1, memory[(u8)(registers[15] + 1)]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Pop to register
+		FAST_HANDLER(0xB, op_pop)
+
+			FAST_PROFILE(profile->memory_reads[(u8)(registers[15] + 1)]++);
+			FAST_WATCH_READ((u8)(registers[15] + 1));
+
+			{
+
+				u8 value = memory[++registers[15]];
+
+				registers[entry->operands[1]] = value;
+				FAST_SET_Z(value);
+
+			}
+
+			FAST_TRACE(TRACE_WRITE_REGISTER, entry->operands[1], registers[entry->operands[1]]);
+
+			pc += 2;
+			FAST_NEXT();
+
+		// Jump subroutine
+		FAST_HANDLER(0xC, op_jsr)
+
+			FAST_PROFILE(profile->memory_writes[registers[15]]++);
+			FAST_PROFILE(profile->calls[entry->operands[1]]++);
+			FAST_WATCH_WRITE(registers[15]);
+			INVALIDATE_DECODE(machine, registers[15]);
+			memory[registers[15]--] = pc + 2;
+			FAST_TRACE(TRACE_WRITE_MEMORY, registers[15] + 1, pc + 2);
+
+			pc = entry->operands[1];
+			FAST_NEXT();
+
+		// Return from subroutine
+		FAST_HANDLER(0xD, op_ret)
+
+			FAST_PROFILE(profile->memory_reads[(u8)(registers[15] + 1)]++);
+			FAST_WATCH_READ((u8)(registers[15] + 1));
+			registers[15]++;
+			FAST_TRACE(TRACE_WRITE_NONE, 0, 0);
+
+			pc = memory[registers[15]];
+			FAST_NEXT();
+
+		// Branch on flag conditions
+		FAST_HANDLER(0xE, op_bra)
+
+			{
+
+				u8 taken = (entry->operands[1] & ~(FAST_FLAGS() ^ entry->operands[2])) == entry->operands[1];
+
+				FAST_TRACE(TRACE_WRITE_NONE, 0, 0);
+				FAST_PROFILE(profile->branches[pc][taken]++);
+				FAST_PROFILE(profile->branch_targets[pc] = entry->operands[3]);
+
+				if(taken)
+					pc = entry->operands[3];
+				else
+					pc += 2;
+
+			}
+
+			FAST_NEXT();
+
+		// Modify flags
+		FAST_HANDLER(0xF, op_mdf)
+
+			FAST_LOAD_FLAGS((FAST_FLAGS() & ~entry->operands[1]) | (entry->operands[2] & entry->operands[1]));
+			FAST_TRACE(TRACE_WRITE_NONE, 0, 0);
+
+			pc += 2;
+			FAST_NEXT();
+
+#if FAST_FUSING
+		// LDI then ADC - loading a constant to add
+		FAST_HANDLER(FUSE_LDI_ADC, op_ldi_adc)
+
+			registers[entry->operands[1]] = entry->operands[2];
+			FAST_SET_Z(entry->operands[2]);
+
+			pc += 2;
+			FAST_FUSE_NEXT(0x1);
+
+			{
+
+				u16 temp = registers[entry->operands[2]] + registers[entry->operands[3]] + FAST_CARRY();
+				registers[entry->operands[1]] = temp & 0xFF;
+				FAST_SET_ZC(temp & 0xFF, temp >> 8);
+
+			}
+
+			pc += 2;
+			FAST_NEXT();
+
+		// ADC then BRA - a counted loop's back edge
+		FAST_HANDLER(FUSE_ADC_BRA, op_adc_bra)
+
+			{
+
+				u16 temp = registers[entry->operands[2]] + registers[entry->operands[3]] + FAST_CARRY();
+				registers[entry->operands[1]] = temp & 0xFF;
+				FAST_SET_ZC(temp & 0xFF, temp >> 8);
+
+			}
+
+			pc += 2;
+			FAST_FUSE_NEXT(0xE);
+
+			if((entry->operands[1] & ~(FAST_FLAGS() ^ entry->operands[2])) == entry->operands[1])
+				pc = entry->operands[3];
+			else
+				pc += 2;
+
+			FAST_NEXT();
+
+		// ADC then BRA closing a counted loop - after one whole trip the rest are run in closed form, taking the cycles stepping would
+		FAST_HANDLER(FUSE_COUNTED_LOOP, op_counted_loop)
+
+			if(loop_armed == pc) {
+
+				u8 loop_flags = FAST_FLAGS();
+				// Counting the cycle this ADC was fetched in
+				u64 loop_cycles = counted_loop_run(&counted, registers, &loop_flags, cycles_left + 1);
+
+				if(loop_cycles) {
+
+					cycles_left -= loop_cycles - 1;
+					FAST_LOAD_FLAGS(loop_flags);
+					// The last cycle run was the branch, predecoded when the loop was armed
+					entry = &machine->decode_cache[(u8)(pc + 2)];
+
+					if(loop_flags & 0b0010) {
+
+						loop_armed = 0x100;
+						pc += 4;
+
+					}
+					else
+						pc = counted.head;
+
+					FAST_NEXT();
+
+				}
+
+			}
+
+			{
+
+				u16 temp = registers[entry->operands[2]] + registers[entry->operands[3]] + FAST_CARRY();
+				registers[entry->operands[1]] = temp & 0xFF;
+				FAST_SET_ZC(temp & 0xFF, temp >> 8);
+
+			}
+
+			pc += 2;
+			FAST_FUSE_NEXT(0xE);
+
+			if((entry->operands[1] & ~(FAST_FLAGS() ^ entry->operands[2])) == entry->operands[1]) {
+
+				// Check the loop again as the code stands now, it may have changed since the ADC was predecoded
+				if(loop_armed != (u8)(pc - 2)) {
+
+					if(machine_counted_loop(machine, pc - 2, &counted))
+						loop_armed = (u8)(pc - 2);
+					else
+						machine->decode_cache[(u8)(pc - 2)].handler = FUSE_ADC_BRA;
+
+				}
+
+				pc = entry->operands[3];
+
+			}
+			else {
+
+				loop_armed = 0x100;
+				pc += 2;
+
+			}
+
+			FAST_NEXT();
+
+		// PSH, PSH then JSR - a call pushing two arguments
+		FAST_HANDLER(FUSE_PSH_PSH_JSR, op_psh_psh_jsr)
+
+			INVALIDATE_DECODE(machine, registers[15]);
+			registers[15]--;
+			memory[(u8)(registers[15] + 1)] = registers[entry->operands[1]];
+
+			// The push may have overwritten the rest of the sequence, which the fetch picks up
+			pc += 2;
+			FAST_FUSE_NEXT(0xA);
+
+			INVALIDATE_DECODE(machine, registers[15]);
+			registers[15]--;
+			memory[(u8)(registers[15] + 1)] = registers[entry->operands[1]];
+
+			pc += 2;
+			FAST_FUSE_NEXT(0xC);
+
+			INVALIDATE_DECODE(machine, registers[15]);
+			memory[registers[15]--] = pc + 2;
+
+			pc = entry->operands[1];
+			FAST_NEXT();
+
+		// POP, POP then RET - a subroutine's epilogue
+		FAST_HANDLER(FUSE_POP_POP_RET, op_pop_pop_ret)
+
+			{
+
+				u8 value = memory[++registers[15]];
+
+				registers[entry->operands[1]] = value;
+				FAST_SET_Z(value);
+
+			}
+
+			pc += 2;
+			FAST_FUSE_NEXT(0xB);
+
+			{
+
+				u8 value = memory[++registers[15]];
+
+				registers[entry->operands[1]] = value;
+				FAST_SET_Z(value);
+
+			}
+
+			pc += 2;
+			FAST_FUSE_NEXT(0xD);
+
+			pc = memory[++registers[15]];
+			FAST_NEXT();
+
+#endif
+#if !RR_THREADED
+	}
+#endif
+
+	write_back:
+
+	// Registers, flags and PC/IR only reach the machine here, so their changes are marked here (stores mark memory through INVALIDATE_DECODE)
+	machine_mark_state(machine, registers, pc, state | FAST_FLAGS(), entry ? entry->instruction : machine->instruction_register);
+	memcpy(machine->registers, registers, 16);
+	machine->program_counter = pc;
+	// Halt sets the state bits, otherwise the machine is back at the start of a cycle
+	machine->status_register = state | FAST_FLAGS();
+
+	// The last instruction run is left behind in IR/operands, as after a normal step
+	if(entry) {
+
+		machine->instruction_register = entry->instruction;
+		memcpy(machine->operands, entry->operands, 4);
+
+	}
+
+	return cycle_limit - cycles_left;
+
+}
+
+#undef FAST_FETCH
+#undef FAST_FETCH_ENTRY
+#undef FAST_MATCHES
+#undef FAST_HANDLER
+#undef FAST_NEXT
+#undef FAST_TRACE
+#undef FAST_PROFILE
+#undef FAST_WATCH_HIT
+#undef FAST_WATCH
+#undef FAST_WATCH_READ
+#undef FAST_WATCH_WRITE
+#undef FAST_SET_Z
+#undef FAST_SET_ZC
+#undef FAST_LOAD_FLAGS
+#undef FAST_CARRY
+#undef FAST_FLAGS
+#undef FAST_COUNT_FUSION
+#undef FAST_FUSING
+#undef FAST_INDEX
+#undef FAST_FUSE_DISPATCH
+#undef FAST_FUSE_NEXT
+#undef FAST_RUN_NAME
+#undef FAST_CHECK
\ No newline at end of file
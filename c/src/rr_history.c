@@ -0,0 +1,474 @@
+#include "rr_history.h"
+
+rr_history_t *history_new(u32 record_count) {
+	
+	rr_history_t *history = (rr_history_t *)calloc(1, sizeof(rr_history_t));
+	u32 size = HISTORY_CHECKPOINT_INTERVAL;
+	
+	if(!history)
+		return NULL;
+	
+	// Replaying from a checkpoint must be able to refill records all the way back to it
+	while(size < record_count)
+		size <<= 1;
+	
+	if(!(history->records = (rr_undo_t *)malloc(size * sizeof(rr_undo_t)))) {
+		
+		free(history);
+		return NULL;
+		
+	}
+	
+	history->record_mask = size - 1;
+	
+	return history;
+	
+}
+
+void history_free(rr_history_t *history) {
+	
+	if(!history)
+		return;
+	
+	free(history->records);
+	free(history->checkpoints);
+	free(history);
+	
+}
+
+void history_clear(rr_history_t *history) {
+	
+	if(!history)
+		return;
+		
+	history->cycle = 0;
+	history->oldest = 0;
+	history->checkpoint_count = 0;
+	history->pending_active = 0;
+	
+}
+
+static u8 history_checkpoint(rr_history_t *history, const rr_machine_t *machine) {
+	
+	rr_checkpoint_t *checkpoint;
+	
+	if(history->checkpoint_count == history->checkpoint_capacity) {
+		
+		u64 capacity = history->checkpoint_capacity ? history->checkpoint_capacity << 1 : 16;
+		rr_checkpoint_t *checkpoints = (rr_checkpoint_t *)realloc(history->checkpoints, capacity * sizeof(rr_checkpoint_t));
+		
+		if(!checkpoints)
+			return 1;
+		
+		history->checkpoints = checkpoints;
+		history->checkpoint_capacity = capacity;
+		
+	}
+	
+	checkpoint = &history->checkpoints[history->checkpoint_count++];
+	
+	memcpy(checkpoint->registers, machine->registers, 16);
+	memcpy(checkpoint->memory, machine->memory, 256);
+	checkpoint->instruction = machine->instruction_register;
+	checkpoint->program_counter = machine->program_counter;
+	checkpoint->status_register = machine->status_register;
+	
+	return 0;
+	
+}
+
+// Put the machine back to checkpoint k, dropping everything recorded after it
+static void history_restore(rr_history_t *history, rr_machine_t *machine, u64 k) {
+	
+	rr_checkpoint_t *checkpoint = &history->checkpoints[k];
+	
+	machine_mark_state(machine, checkpoint->registers, checkpoint->program_counter, checkpoint->status_register, checkpoint->instruction);
+	machine_mark_memory(machine, checkpoint->memory);
+	
+	memcpy(machine->registers, checkpoint->registers, 16);
+	memcpy(machine->memory, checkpoint->memory, 256);
+	machine->instruction_register = checkpoint->instruction;
+	machine_decode_instruction(machine->instruction_register, machine->operands);
+	machine->program_counter = checkpoint->program_counter;
+	machine->status_register = checkpoint->status_register;
+	
+	// Any of memory may have changed
+	memset(machine->decode_cache, 0, sizeof(machine->decode_cache));
+	
+	history->cycle = k * HISTORY_CHECKPOINT_INTERVAL;
+	history->oldest = history->cycle;
+	history->checkpoint_count = k + 1;
+	history->pending_active = 0;
+	
+}
+
+// Operands of the instruction the current cycle executes, decoded into decoded if the machine hasn't got them yet
+static const u8 *history_operands(rr_machine_t *machine, u8 *decoded) {
+	
+	rr_decoded_t *entry;
+	
+	if(CURRENT_STATE(machine) == 0b10)
+		return machine->operands;
+		
+	if(CURRENT_STATE(machine) == 0b01) {
+		
+		machine_decode_instruction(machine->instruction_register, decoded);
+		return decoded;
+		
+	}
+	
+	if(!(entry = &machine->decode_cache[machine->program_counter])->valid)
+		entry = machine_predecode(machine, machine->program_counter);
+		
+	return entry->operands;
+	
+}
+
+// Memory access (WATCH_READ or WATCH_WRITE) the current cycle is about to make, with its address in location - 0 for none
+// The same accesses the watch interpreter checks, instruction fetches aren't counted
+static u8 history_access(rr_machine_t *machine, u8 *location) {
+	
+	u8 decoded[4];
+	const u8 *operands = history_operands(machine, decoded);
+	
+	switch(operands[0]) {
+		
+		// LDM, STO
+		case 0x6:
+		case 0x8:
+			*location = operands[2];
+			return operands[0] == 0x6 ? WATCH_READ : WATCH_WRITE;
+			
+		// LDR, STR
+		case 0x7:
+		case 0x9:
+			*location = REG(machine, operands[2]);
+			return operands[0] == 0x7 ? WATCH_READ : WATCH_WRITE;
+			
+		// PSH, JSR
+		case 0xA:
+		case 0xC:
+			*location = STACK_POINTER(machine);
+			return WATCH_WRITE;
+			
+		// POP, RET
+		case 0xB:
+		case 0xD:
+			*location = STACK_POINTER(machine) + 1;
+			return WATCH_READ;
+			
+	}
+	
+	return 0;
+	
+}
+
+u8 history_step(rr_history_t *history, rr_machine_t *machine, u8 part_step) {
+	
+	u8 state = CURRENT_STATE(machine);
+	u8 decoded[4];
+	const u8 *operands;
+	rr_undo_t *undo = &history->pending;
+	
+	if(state == 0b11)
+		return state;
+	
+	if(state == 0b00) {
+		
+		// Checkpoints are taken as each interval starts rather than when the history is cleared, so changes made to the machine in between are kept
+		if(history->cycle == history->checkpoint_count * HISTORY_CHECKPOINT_INTERVAL && history_checkpoint(history, machine)) {
+			
+			history_clear(history);
+			return machine_step(machine, part_step);
+			
+		}
+		
+		undo->instruction = machine->instruction_register;
+		undo->program_counter = machine->program_counter;
+		undo->status_register = machine->status_register;
+		history->pending_active = 1;
+		
+	}
+	// The cycle was already underway when the history started, there is nothing to go back to
+	else if(!history->pending_active)
+		return machine_step(machine, part_step);
+	
+	// Fetch and decode only touch the instruction register and operands, which the pending record can already restore
+	if(part_step && state != 0b10)
+		return machine_step(machine, 1);
+	
+	// Find what execute is about to overwrite
+	operands = history_operands(machine, decoded);
+	
+	switch(operands[0]) {
+		
+		// ADC, AND, XOR, ROT, LDI, LDM, LDR, POP
+		case 0x1:
+		case 0x2:
+		case 0x3:
+		case 0x4:
+		case 0x5:
+		case 0x6:
+		case 0x7:
+		case 0xB:
+			undo->kind = UNDO_REGISTER;
+			undo->location = operands[1];
+			undo->value = REG(machine, operands[1]);
+			break;
+		
+		case 0x8:
+			undo->kind = UNDO_MEMORY;
+			undo->location = operands[2];
+			undo->value = MEM(machine, operands[2]);
+			break;
+		
+		case 0x9:
+			undo->kind = UNDO_MEMORY;
+			undo->location = REG(machine, operands[2]);
+			undo->value = MEM(machine, undo->location);
+			break;
+		
+		// PSH, JSR
+		case 0xA:
+		case 0xC:
+			undo->kind = UNDO_MEMORY;
+			undo->location = STACK_POINTER(machine);
+			undo->value = MEM(machine, undo->location);
+			break;
+		
+		// HLT, RET, BRA, MDF only change the program counter, status register and stack pointer
+		default:
+			undo->kind = UNDO_NONE;
+			break;
+		
+	}
+	
+	undo->stack_pointer = STACK_POINTER(machine);
+	
+	machine_step(machine, part_step);
+	
+	history->records[history->cycle & history->record_mask] = *undo;
+	history->pending_active = 0;
+	
+	// The ring is full, the oldest record has just been overwritten
+	if(++history->cycle - history->oldest > (u64)history->record_mask + 1)
+		history->oldest++;
+	
+	return CURRENT_STATE(machine);
+	
+}
+
+u8 history_run(rr_history_t *history, rr_machine_t *machine, u64 max_cycles, const rr_conditions_t *conditions, rr_watch_t *watch, rr_stop_t *stop) {
+	
+	rr_stop_t unused;
+	rr_conditions_t active;
+	u8 checking = conditions && conditions->count;
+	u8 watching = watch ? watch_active(watch) : 0;
+	u8 access = 0;
+	u8 location = 0;
+	u64 cycle_limit = max_cycles ? max_cycles : UINT64_MAX;
+	
+	if(!stop)
+		stop = &unused;
+	
+	stop->cycles = 0;
+	stop->condition = 0;
+	
+	if(watch)
+		watch->stopped = 0;
+	
+	if(checking)
+		conditions_begin(&active, conditions, machine);
+	
+	while(1) {
+		
+		if(CURRENT_STATE(machine) == 0b11) {
+			
+			stop->reason = RUN_HALTED;
+			break;
+			
+		}
+		
+		// Same order as machine_run_until and machine_run_watch - the starting state is never checked, a watched access stops just after the cycle that made it
+		// and a breakpoint just before the cycle starting there, both before conditions, which come before the cycle limit
+		if(access && (access == WATCH_READ ? BITMAP_TEST(watch->reads, location) : BITMAP_TEST(watch->writes, location))) {
+			
+			watch->stopped = access;
+			watch->address = location;
+			stop->reason = RUN_WATCHPOINT;
+			break;
+			
+		}
+		
+		if(stop->cycles && (watching & WATCH_BREAK) && !CURRENT_STATE(machine) && BITMAP_TEST(watch->breaks, machine->program_counter)) {
+			
+			watch->stopped = WATCH_BREAK;
+			watch->address = watch->pc = machine->program_counter;
+			stop->reason = RUN_BREAKPOINT;
+			break;
+			
+		}
+		
+		if(stop->cycles && checking && conditions_check(&active, machine)) {
+			
+			stop->reason = RUN_CONDITION;
+			stop->condition = active.stopped - 1;
+			break;
+			
+		}
+		
+		if(stop->cycles == cycle_limit) {
+			
+			stop->reason = RUN_CYCLE_LIMIT;
+			break;
+			
+		}
+		
+		if(watching & (WATCH_READ | WATCH_WRITE)) {
+			
+			watch->pc = machine->program_counter;
+			access = history_access(machine, &location);
+			
+		}
+		
+		if(history)
+			history_step(history, machine, 0);
+		else
+			machine_step(machine, 0);
+			
+		stop->cycles++;
+		
+	}
+	
+	return stop->reason;
+	
+}
+
+// Undo a single cycle, returns 1 when there is nothing left to undo
+static u8 history_undo(rr_history_t *history, rr_machine_t *machine) {
+	
+	rr_undo_t *undo;
+	
+	// Partway through a cycle - back to where it started
+	if(CURRENT_STATE(machine) == 0b01 || CURRENT_STATE(machine) == 0b10) {
+		
+		if(!history->pending_active)
+			return 1;
+		
+		undo = &history->pending;
+		history->pending_active = 0;
+		
+	}
+	else {
+		
+		if(!history->cycle)
+			return 1;
+		
+		// Out of records, rebuild them by replaying from the last checkpoint before the target cycle
+		if(history->cycle == history->oldest) {
+			
+			u64 target = history->cycle - 1;
+			
+			history_restore(history, machine, target / HISTORY_CHECKPOINT_INTERVAL);
+			
+			while(history->cycle < target)
+				history_step(history, machine, 0);
+			
+			return 0;
+			
+		}
+		
+		undo = &history->records[--history->cycle & history->record_mask];
+		
+		switch(undo->kind) {
+			
+			case UNDO_REGISTER:
+				REG(machine, undo->location) = undo->value;
+				MARK_REGISTER(machine, undo->location);
+				break;
+			
+			case UNDO_MEMORY:
+				MEM(machine, undo->location) = undo->value;
+				INVALIDATE_DECODE(machine, undo->location);
+				break;
+			
+		}
+		
+		// Stack pointer last, popping into r15 also records it as the register
+		STACK_POINTER(machine) = undo->stack_pointer;
+		MARK_REGISTER(machine, 15);
+		
+		// Checkpoints past this cycle belong to the undone future
+		if(history->checkpoint_count > history->cycle / HISTORY_CHECKPOINT_INTERVAL + 1)
+			history->checkpoint_count = history->cycle / HISTORY_CHECKPOINT_INTERVAL + 1;
+		
+	}
+	
+	machine->program_counter = undo->program_counter;
+	machine->status_register = undo->status_register;
+	machine->instruction_register = undo->instruction;
+	machine_decode_instruction(machine->instruction_register, machine->operands);
+	MARK_STATE(machine, CHANGED_ALL);
+	
+	return 0;
+	
+}
+
+u64 history_step_back(rr_history_t *history, rr_machine_t *machine, u64 steps) {
+	
+	u64 done = 0;
+	
+	while(done < steps && !history_undo(history, machine))
+		done++;
+	
+	return done;
+	
+}
+
+u8 history_run_back(rr_history_t *history, rr_machine_t *machine, u64 max_cycles, const rr_conditions_t *conditions, rr_stop_t *stop) {
+	
+	rr_stop_t unused;
+	rr_conditions_t active;
+	u8 checking = conditions && conditions->count;
+	u64 cycle_limit = max_cycles ? max_cycles : UINT64_MAX;
+	
+	if(!stop)
+		stop = &unused;
+	
+	stop->cycles = 0;
+	stop->condition = 0;
+	
+	if(checking)
+		conditions_begin(&active, conditions, machine);
+	
+	while(1) {
+		
+		if(stop->cycles == cycle_limit) {
+			
+			stop->reason = RUN_CYCLE_LIMIT;
+			break;
+			
+		}
+		
+		if(history_undo(history, machine)) {
+			
+			stop->reason = RUN_HISTORY_START;
+			break;
+			
+		}
+		
+		stop->cycles++;
+		
+		if(checking && conditions_check(&active, machine)) {
+			
+			stop->reason = RUN_CONDITION;
+			stop->condition = active.stopped - 1;
+			break;
+			
+		}
+		
+	}
+	
+	return stop->reason;
+	
+}
\ No newline at end of file
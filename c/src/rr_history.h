@@ -0,0 +1,76 @@
+#ifndef RR_HISTORY_H
+#define RR_HISTORY_H
+
+#include "rr_machine.h"
+
+// Undo records kept by default, the oldest are dropped (and rebuilt from checkpoints when needed) beyond this
+#define HISTORY_DEFAULT_RECORDS (1 << 20)
+// Cycles between full checkpoints - going back past the oldest undo record restores the checkpoint before it and replays forward from there
+#define HISTORY_CHECKPOINT_INTERVAL (1 << 16)
+
+// What an undo record restores besides the program counter, status register and stack pointer
+#define UNDO_NONE 0
+#define UNDO_REGISTER 1
+#define UNDO_MEMORY 2
+
+// Everything one machine cycle overwrote - execute changes at most one general register or memory cell, plus the program counter, flags and stack pointer
+typedef struct rr_undo_d {
+	// Instruction register before the cycle's fetch
+	u16 instruction;
+	u8 program_counter;
+	u8 status_register;
+	u8 stack_pointer;
+	u8 kind;
+	// Register number or memory address, and the value it held
+	u8 location;
+	u8 value;
+} rr_undo_t;
+
+// Full machine state at the start of a cycle
+typedef struct rr_checkpoint_d {
+	u8 registers[16];
+	u8 memory[256];
+	u16 instruction;
+	u8 program_counter;
+	u8 status_register;
+} rr_checkpoint_t;
+
+typedef struct rr_history_d {
+	// Ring of undo records, records[c & record_mask] undoes cycle c
+	rr_undo_t *records;
+	u32 record_mask;
+	// Cycles recorded since the history started, and the earliest one that can still be undone from a record
+	u64 cycle;
+	u64 oldest;
+	// checkpoints[k] holds the state at cycle k * HISTORY_CHECKPOINT_INTERVAL
+	rr_checkpoint_t *checkpoints;
+	u64 checkpoint_count;
+	u64 checkpoint_capacity;
+	// Record for a cycle that has been fetched (or decoded) but not yet executed
+	rr_undo_t pending;
+	u8 pending_active;
+} rr_history_t;
+
+// Create a history keeping up to record_count undo records (rounded up to a power of 2, and to at least HISTORY_CHECKPOINT_INTERVAL)
+rr_history_t *history_new(u32 record_count);
+void history_free(rr_history_t *history);
+
+// Forget everything recorded - needed whenever the machine is changed other than through the history (poke, load, reset, ...), does nothing given NULL
+void history_clear(rr_history_t *history);
+
+// Same as machine_step, recording the cycle
+u8 history_step(rr_history_t *history, rr_machine_t *machine, u8 part_step);
+
+// Same as machine_run_until, recording each cycle (conditions may be NULL) - also stopping on the breakpoints and watchpoints in watch (which may be NULL) as machine_run_watch does
+// A NULL history checks the same way without recording, for conditions together with breakpoints or watchpoints, which no single fast run checks
+u8 history_run(rr_history_t *history, rr_machine_t *machine, u64 max_cycles, const rr_conditions_t *conditions, rr_watch_t *watch, rr_stop_t *stop);
+
+// Return the machine to the start of an earlier cycle - a machine partway through a cycle first goes back to that cycle's start
+// Returns the number of cycles stepped back, less than steps if the start of the history was reached
+u64 history_step_back(rr_history_t *history, rr_machine_t *machine, u64 steps);
+
+// Step back until reaching a state where any of the conditions holds, max_cycles have been undone (0 for no limit) or the start of the history is reached (RUN_HISTORY_START)
+// The starting state is not checked, so running back again after a stop moves on
+u8 history_run_back(rr_history_t *history, rr_machine_t *machine, u64 max_cycles, const rr_conditions_t *conditions, rr_stop_t *stop);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "rr_isa.h"
+
+// Pick one of the three values in an operand format list
+#define ISA_FIRST(...) ISA_FIRST_(__VA_ARGS__)
+#define ISA_FIRST_(a, b, c) a
+#define ISA_SECOND(...) ISA_SECOND_(__VA_ARGS__)
+#define ISA_SECOND_(a, b, c) b
+#define ISA_THIRD(...) ISA_THIRD_(__VA_ARGS__)
+#define ISA_THIRD_(a, b, c) c
+
+// Run m(opcode, format, base + n) for each n in 0-15, there are three copies since a macro can't expand inside itself and the full table nests them
+#define ISA_REPEAT16(m, opcode, format, base) \
+	m(opcode, format, (base) | 0x0) m(opcode, format, (base) | 0x1) m(opcode, format, (base) | 0x2) m(opcode, format, (base) | 0x3) \
+	m(opcode, format, (base) | 0x4) m(opcode, format, (base) | 0x5) m(opcode, format, (base) | 0x6) m(opcode, format, (base) | 0x7) \
+	m(opcode, format, (base) | 0x8) m(opcode, format, (base) | 0x9) m(opcode, format, (base) | 0xA) m(opcode, format, (base) | 0xB) \
+	m(opcode, format, (base) | 0xC) m(opcode, format, (base) | 0xD) m(opcode, format, (base) | 0xE) m(opcode, format, (base) | 0xF)
+#define ISA_REPEAT16_MIDDLE(m, opcode, format, base) \
+	m(opcode, format, (base) | 0x0) m(opcode, format, (base) | 0x1) m(opcode, format, (base) | 0x2) m(opcode, format, (base) | 0x3) \
+	m(opcode, format, (base) | 0x4) m(opcode, format, (base) | 0x5) m(opcode, format, (base) | 0x6) m(opcode, format, (base) | 0x7) \
+	m(opcode, format, (base) | 0x8) m(opcode, format, (base) | 0x9) m(opcode, format, (base) | 0xA) m(opcode, format, (base) | 0xB) \
+	m(opcode, format, (base) | 0xC) m(opcode, format, (base) | 0xD) m(opcode, format, (base) | 0xE) m(opcode, format, (base) | 0xF)
+#define ISA_REPEAT16_INNER(m, opcode, format, base) \
+	m(opcode, format, (base) | 0x0) m(opcode, format, (base) | 0x1) m(opcode, format, (base) | 0x2) m(opcode, format, (base) | 0x3) \
+	m(opcode, format, (base) | 0x4) m(opcode, format, (base) | 0x5) m(opcode, format, (base) | 0x6) m(opcode, format, (base) | 0x7) \
+	m(opcode, format, (base) | 0x8) m(opcode, format, (base) | 0x9) m(opcode, format, (base) | 0xA) m(opcode, format, (base) | 0xB) \
+	m(opcode, format, (base) | 0xC) m(opcode, format, (base) | 0xD) m(opcode, format, (base) | 0xE) m(opcode, format, (base) | 0xF)
+
+// One decode table entry for high byte h
+#define ISA_DECODE_ENTRY(opcode, format, h) [h] = { { opcode, ISA_HIGH_##format(h) }, { 0, ISA_SHIFT_##format }, { 0, ISA_MASK_##format } },
+#define ISA_DECODE_ROWS(opcode, mnemonic, format, text) ISA_REPEAT16(ISA_DECODE_ENTRY, opcode, format, (opcode) << 4)
+
+const rr_isa_decode_t isa_decode_table[256] = {
+	ISA_INSTRUCTIONS(ISA_DECODE_ROWS)
+};
+
+#define ISA_MNEMONIC(opcode, mnemonic, format, text) [opcode] = #mnemonic,
+
+const char isa_mnemonics[16][4] = {
+	ISA_INSTRUCTIONS(ISA_MNEMONIC)
+};
+
+#define ISA_FORMAT(opcode, mnemonic, format, text) [opcode] = text,
+
+const char *isa_formats[16] = {
+	ISA_INSTRUCTIONS(ISA_FORMAT)
+};
+
+#if defined(RR_FULL_DECODE_TABLE)
+// Operand n of instruction i, worked out the same way isa_decode does from the 256 entry table
+#define ISA_OPERAND(pick, format, i) (pick(ISA_HIGH_##format((i) >> 8)) | ((((i) & 0xFF) >> pick(ISA_SHIFT_##format)) & pick(ISA_MASK_##format)))
+#define ISA_FULL_ENTRY(opcode, format, i) { opcode, ISA_OPERAND(ISA_FIRST, format, i), ISA_OPERAND(ISA_SECOND, format, i), ISA_OPERAND(ISA_THIRD, format, i) },
+#define ISA_FULL_REPEAT16(opcode, format, base) ISA_REPEAT16_INNER(ISA_FULL_ENTRY, opcode, format, (base) << 4)
+#define ISA_FULL_REPEAT256(opcode, format, base) ISA_REPEAT16_MIDDLE(ISA_FULL_REPEAT16, opcode, format, (base) << 4)
+#define ISA_FULL_ROWS(opcode, mnemonic, format, text) ISA_REPEAT16(ISA_FULL_REPEAT256, opcode, format, (opcode) << 4)
+
+// Opcodes are listed in order, so the entries come out in instruction order without designators
+const u8 isa_full_decode_table[65536][4] = {
+	ISA_INSTRUCTIONS(ISA_FULL_ROWS)
+};
+#endif
+
+u32 machine_disassemble(u16 instruction, char *text) {
+	
+	u8 operands[4];
+	s32 length;
+	
+	isa_decode(instruction, operands);
+	length = snprintf(text, ISA_TEXT_SIZE, isa_formats[operands[0]], operands[1], operands[2], operands[3]);
+	
+	return length > 0 ? (u32)length : 0;
+	
+}
+
+void machine_disassemble_range(const rr_machine_t *machine, u8 first, u16 count, FILE *out) {
+	
+	char text[ISA_TEXT_SIZE];
+	u8 address = first;
+	u16 c = 0;
+	
+	for(; c < count; c++, address += 2) {
+		
+		u16 instruction = (MEM(machine, address) << 8) | MEM(machine, (u8)(address + 1));
+		
+		machine_disassemble(instruction, text);
+		fprintf(out, "%02X: %04X  %s\n", address, instruction, text);
+		
+	}
+	
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#ifndef RR_ISA_H
+#define RR_ISA_H
+
+#include "rr_machine.h"
+
+// The one description of the instruction set, everything else (the decode tables, mnemonics and disassembly) is generated from it at compile time
+// X(opcode, mnemonic, operand format, disassembly format) - the disassembly format is given operands 1-3 in order and may use any prefix of them
+// Operand formats name where operands 1-3 come from, R/S/T a register nibble, XX/MM a byte and I the two 2-bit flag fields of BRA and MDF
+#define ISA_INSTRUCTIONS(X) \
+	/* HaLT machine execution */ \
+	X(0x0, HLT, ____, "HLT") \
+	/* ADd with Carry, S + T + C -> R, sets carry if the addition exceeds 0xFF, zero if R = 0 */ \
+	X(0x1, ADC, RST, "ADC R%X, R%X, R%X") \
+	/* AND registers, S & T -> R, sets zero if R = 0 */ \
+	X(0x2, AND, RST, "AND R%X, R%X, R%X") \
+	/* XOR registers, S ^ T -> R, sets zero if R = 0 */ \
+	X(0x3, XOR, RST, "XOR R%X, R%X, R%X") \
+	/* ROTate register, S (<< | >>) T -> R, T[4] set rotates right, carry gets the last bit rotated out, sets zero if R = 0 */ \
+	X(0x4, ROT, RST, "ROT R%X, R%X, R%X") \
+	/* LoaD Immediate, XX -> R, sets zero if R = 0 */ \
+	X(0x5, LDI, RXX, "LDI R%X, $%02X") \
+	/* LoaD from Memory, Mem[MM] -> R, sets zero if R = 0 */ \
+	X(0x6, LDM, RXX, "LDM R%X, [$%02X]") \
+	/* LoaD with Register offset, Mem[S] -> R, sets zero if R = 0 */ \
+	X(0x7, LDR, _RS, "LDR R%X, [R%X]") \
+	/* STOre register, R -> Mem[MM] */ \
+	X(0x8, STO, RXX, "STO R%X, [$%02X]") \
+	/* STore with Register offset, R -> Mem[S] */ \
+	X(0x9, STR, _RS, "STR R%X, [R%X]") \
+	/* PuSH register to stack, R -> [SP--] */ \
+	X(0xA, PSH, R__, "PSH R%X") \
+	/* POP stack to register, [++SP] -> R, sets zero if R = 0 */ \
+	X(0xB, POP, R__, "POP R%X") \
+	/* Jump to SubRoutine, PC + 2 -> Mem[SP--], XX -> PC */ \
+	X(0xC, JSR, _XX, "JSR $%02X") \
+	/* RETurn from subroutine, Mem[++SP] -> PC */ \
+	X(0xD, RET, ____, "RET") \
+	/* BRAnch on flag conditions, I ? (XX : PC + 2) -> PC, I is the flags considered (Z, C) then the states to branch on */ \
+	X(0xE, BRA, IXX, "BRA %X, %X, $%02X") \
+	/* MoDify Flag, I is the flags (Z, C) to modify then the states to set them to */ \
+	X(0xF, MDF, I__, "MDF %X, %X")
+
+// How each operand format fills operands 1-3 from an instruction with high byte h and low byte l (operands[0] is always h >> 4)
+// Operand n is high[n] | ((l >> shift[n]) & mask[n]), so the parts from the high byte can be worked out once per high byte
+#define ISA_HIGH_____(h) 0, 0, 0
+#define ISA_SHIFT_____ 0, 0, 0
+#define ISA_MASK_____ 0, 0, 0
+#define ISA_HIGH_RST(h) ((h) & 0xF), 0, 0
+#define ISA_SHIFT_RST 0, 4, 0
+#define ISA_MASK_RST 0, 0xF, 0xF
+#define ISA_HIGH_RXX(h) ((h) & 0xF), 0, 0
+#define ISA_SHIFT_RXX 0, 0, 0
+#define ISA_MASK_RXX 0, 0xFF, 0
+#define ISA_HIGH__RS(h) 0, 0, 0
+#define ISA_SHIFT__RS 4, 0, 0
+#define ISA_MASK__RS 0xF, 0xF, 0
+#define ISA_HIGH_R__(h) ((h) & 0xF), 0, 0
+#define ISA_SHIFT_R__ 0, 0, 0
+#define ISA_MASK_R__ 0, 0, 0
+#define ISA_HIGH__XX(h) 0, 0, 0
+#define ISA_SHIFT__XX 0, 0, 0
+#define ISA_MASK__XX 0xFF, 0, 0
+#define ISA_HIGH_IXX(h) (((h) >> 2) & 0x3), ((h) & 0x3), 0
+#define ISA_SHIFT_IXX 0, 0, 0
+#define ISA_MASK_IXX 0, 0, 0xFF
+#define ISA_HIGH_I__(h) (((h) >> 2) & 0x3), ((h) & 0x3), 0
+#define ISA_SHIFT_I__ 0, 0, 0
+#define ISA_MASK_I__ 0, 0, 0
+
+// Longest line machine_disassemble writes, including the NUL
+#define ISA_TEXT_SIZE 24
+
+// One entry per instruction high byte, operands laid out like rr_machine_t.operands
+typedef struct rr_isa_decode_d {
+	u8 high[4];
+	u8 shift[4];
+	u8 mask[4];
+} rr_isa_decode_t;
+
+extern const rr_isa_decode_t isa_decode_table[256];
+extern const char isa_mnemonics[16][4];
+extern const char *isa_formats[16];
+
+#if defined(RR_FULL_DECODE_TABLE)
+// Every instruction already split into its four operands, for hosts where 256KB of table beats a shift and mask per operand
+extern const u8 isa_full_decode_table[65536][4];
+#endif
+
+// Split an instruction into its four operands with table lookups only
+static inline void isa_decode(u16 instruction, u8 *operands) {
+	
+#if defined(RR_FULL_DECODE_TABLE)
+	memcpy(operands, isa_full_decode_table[instruction], 4);
+#else
+	const rr_isa_decode_t *entry = &isa_decode_table[instruction >> 8];
+	u8 low = (u8)instruction;
+	
+	operands[0] = entry->high[0];
+	operands[1] = entry->high[1] | ((low >> entry->shift[1]) & entry->mask[1]);
+	operands[2] = entry->high[2] | ((low >> entry->shift[2]) & entry->mask[2]);
+	operands[3] = entry->high[3] | ((low >> entry->shift[3]) & entry->mask[3]);
+#endif
+	
+}
+
+// Write an instruction as assembly text (at most ISA_TEXT_SIZE bytes with the NUL), returns the length written
+u32 machine_disassemble(u16 instruction, char *text);
+
+// Print count instructions from memory starting at first, one per line as "<address>: <instruction> <assembly>"
+// Addresses wrap around past 0xFF the same way fetches do
+void machine_disassemble_range(const rr_machine_t *machine, u8 first, u16 count, FILE *out);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,927 @@
+#include "rr_jit.h"
+
+#if RR_JIT_AVAILABLE
+
+#include <sys/mman.h>
+
+// Worst case native bytes for one block, checked before translating so a block never runs off the buffer
+#define JIT_BLOCK_BYTES (JIT_MAX_BLOCK * 192 + 256)
+
+// Displacements used by generated code - rdi holds the machine, rsi the translator context
+#define M_REG(x) (u32)(offsetof(rr_machine_t, registers) + (x))
+#define M_MEM(x) (u32)(offsetof(rr_machine_t, memory) + (x))
+#define M_PC (u32)offsetof(rr_machine_t, program_counter)
+#define M_SR (u32)offsetof(rr_machine_t, status_register)
+#define M_IR (u32)offsetof(rr_machine_t, instruction_register)
+#define M_OPERANDS (u32)offsetof(rr_machine_t, operands)
+#define M_CACHE_VALID(x) (u32)(offsetof(rr_machine_t, decode_cache) + (x) * sizeof(rr_decoded_t) + offsetof(rr_decoded_t, valid))
+// Byte x of the changed memory bitmap (little endian, so bit n of the bitmap is bit n & 7 of byte n >> 3)
+#define M_CHANGED(x) (u32)(offsetof(rr_machine_t, changes) + offsetof(rr_changes_t, memory) + (x))
+#define J_CYCLES (u32)offsetof(rr_jit_t, cycles_left)
+#define J_ENTRY (u32)offsetof(rr_jit_t, entry_points)
+#define J_MAP(x) (u32)(offsetof(rr_jit_t, code_map) + (x))
+#define J_STORE (u32)offsetof(rr_jit_t, store_address)
+
+// Host register numbers
+#define EAX 0
+#define ECX 1
+#define EDX 2
+
+// Decode cache invalidation indexes entries as [rdi + rcx * 8]
+_Static_assert(sizeof(rr_decoded_t) == 8, "decode cache entries must be 8 bytes for the JIT");
+
+typedef u32 (*jit_block_fn)(rr_machine_t *machine, rr_jit_t *jit);
+
+// Raw emitters
+static void emit_u8(u8 **out, u8 value) {
+	
+	*(*out)++ = value;
+	
+}
+static void emit_u16(u8 **out, u16 value) {
+	
+	memcpy(*out, &value, 2);
+	*out += 2;
+	
+}
+static void emit_u32(u8 **out, u32 value) {
+	
+	memcpy(*out, &value, 4);
+	*out += 4;
+	
+}
+static void emit_u64(u8 **out, u64 value) {
+	
+	memcpy(*out, &value, 8);
+	*out += 8;
+	
+}
+
+// Point a rel32 displacement at the given target
+static void patch_rel32(u8 *site, u8 *target) {
+	
+	s32 rel = (s32)(target - (site + 4));
+	
+	memcpy(site, &rel, 4);
+	
+}
+
+// Conditional jump with a displacement to be patched later, returns the displacement's location
+static u8 *emit_jcc(u8 **out, u8 condition) {
+	
+	u8 *site;
+	
+	emit_u8(out, 0x0F);
+	emit_u8(out, 0x80 | condition);
+	site = *out;
+	emit_u32(out, 0);
+	
+	return site;
+	
+}
+
+// Jump conditions
+#define CC_AE 0x3
+#define CC_Z 0x4
+
+// movzx host, byte [rdi + disp]
+static void emit_load(u8 **out, u8 host, u32 disp) {
+	
+	emit_u8(out, 0x0F);
+	emit_u8(out, 0xB6);
+	emit_u8(out, 0x87 | (host << 3));
+	emit_u32(out, disp);
+	
+}
+
+// movzx host, byte [rdi + rcx + memory]
+static void emit_load_indexed(u8 **out, u8 host) {
+	
+	emit_u8(out, 0x0F);
+	emit_u8(out, 0xB6);
+	emit_u8(out, 0x84 | (host << 3));
+	emit_u8(out, 0x0F);
+	emit_u32(out, M_MEM(0));
+	
+}
+
+// mov byte [rdi + disp], host
+static void emit_store(u8 **out, u8 host, u32 disp) {
+	
+	emit_u8(out, 0x88);
+	emit_u8(out, 0x87 | (host << 3));
+	emit_u32(out, disp);
+	
+}
+
+// mov byte [rdi + rcx + memory], host
+static void emit_store_indexed(u8 **out, u8 host) {
+	
+	emit_u8(out, 0x88);
+	emit_u8(out, 0x84 | (host << 3));
+	emit_u8(out, 0x0F);
+	emit_u32(out, M_MEM(0));
+	
+}
+
+// mov byte [rdi + disp], value
+static void emit_store_imm(u8 **out, u32 disp, u8 value) {
+	
+	emit_u8(out, 0xC6);
+	emit_u8(out, 0x87);
+	emit_u32(out, disp);
+	emit_u8(out, value);
+	
+}
+
+// (and|or) byte [rdi + disp], value
+static void emit_and_imm(u8 **out, u32 disp, u8 value) {
+	
+	emit_u8(out, 0x80);
+	emit_u8(out, 0xA7);
+	emit_u32(out, disp);
+	emit_u8(out, value);
+	
+}
+static void emit_or_imm(u8 **out, u32 disp, u8 value) {
+	
+	emit_u8(out, 0x80);
+	emit_u8(out, 0x8F);
+	emit_u32(out, disp);
+	emit_u8(out, value);
+	
+}
+
+// (cmp|sub|add) qword [rsi + cycles_left], value
+static void emit_cycles_op(u8 **out, u8 op, u32 value) {
+	
+	emit_u8(out, 0x48);
+	emit_u8(out, 0x81);
+	emit_u8(out, 0x86 | (op << 3));
+	emit_u32(out, J_CYCLES);
+	emit_u32(out, value);
+	
+}
+#define CYCLES_ADD 0
+#define CYCLES_SUB 5
+#define CYCLES_CMP 7
+
+// mov eax, code; ret
+static void emit_return(u8 **out, u32 code) {
+	
+	emit_u8(out, 0xB8);
+	emit_u32(out, code);
+	emit_u8(out, 0xC3);
+	
+}
+
+// Update Z from al and keep C - clobbers dl
+static void emit_zero_flag(u8 **out) {
+	
+	// test al, al; sete dl; add dl, dl
+	emit_u8(out, 0x84);
+	emit_u8(out, 0xC0);
+	emit_u8(out, 0x0F);
+	emit_u8(out, 0x94);
+	emit_u8(out, 0xC2);
+	emit_u8(out, 0x00);
+	emit_u8(out, 0xD2);
+	
+	emit_and_imm(out, M_SR, 0b1101);
+	
+	// or byte [rdi + SR], dl
+	emit_u8(out, 0x08);
+	emit_u8(out, 0x97);
+	emit_u32(out, M_SR);
+	
+}
+
+// Invalidate the decode cache entries covering a static address, or the address in rcx (clobbers edx), and mark the cell changed
+static void emit_invalidate(u8 **out, u8 address) {
+	
+	emit_store_imm(out, M_CACHE_VALID(address), 0);
+	emit_store_imm(out, M_CACHE_VALID((u8)(address - 1)), 0);
+	emit_or_imm(out, M_CHANGED(address >> 3), 1 << (address & 7));
+	
+}
+static void emit_invalidate_indexed(u8 **out) {
+	
+	// mov byte [rdi + rcx * 8 + valid], 0
+	emit_u8(out, 0xC6);
+	emit_u8(out, 0x84);
+	emit_u8(out, 0xCF);
+	emit_u32(out, M_CACHE_VALID(0));
+	emit_u8(out, 0);
+	
+	// lea edx, [rcx - 1]; movzx edx, dl
+	emit_u8(out, 0x8D);
+	emit_u8(out, 0x51);
+	emit_u8(out, 0xFF);
+	emit_u8(out, 0x0F);
+	emit_u8(out, 0xB6);
+	emit_u8(out, 0xD2);
+	
+	// mov byte [rdi + rdx * 8 + valid], 0
+	emit_u8(out, 0xC6);
+	emit_u8(out, 0x84);
+	emit_u8(out, 0xD7);
+	emit_u32(out, M_CACHE_VALID(0));
+	emit_u8(out, 0);
+	
+	// bts dword [rdi + changed], ecx
+	emit_u8(out, 0x0F);
+	emit_u8(out, 0xAB);
+	emit_u8(out, 0x8F);
+	emit_u32(out, M_CHANGED(0));
+	
+}
+
+// Leave IR, operands and the program counter as a normal step would after the given instruction
+static void emit_machine_state(u8 **out, rr_decoded_t *entry, u8 next_pc) {
+	
+	u32 operands;
+	
+	memcpy(&operands, entry->operands, 4);
+	
+	// mov word [rdi + IR], instruction
+	emit_u8(out, 0x66);
+	emit_u8(out, 0xC7);
+	emit_u8(out, 0x87);
+	emit_u32(out, M_IR);
+	emit_u16(out, entry->instruction);
+	
+	// mov dword [rdi + operands], operands
+	emit_u8(out, 0xC7);
+	emit_u8(out, 0x87);
+	emit_u32(out, M_OPERANDS);
+	emit_u32(out, operands);
+	
+	emit_store_imm(out, M_PC, next_pc);
+	
+}
+
+// Leave the block if a store hit translated code - static address, or the address in rcx
+// Cycles charged up front for instructions after the store are handed back
+static void emit_store_check(u8 **out, s16 address, rr_decoded_t *entry, u8 next_pc, u32 refund) {
+	
+	u8 *skip;
+	
+	if(address < 0) {
+		
+		// test byte [rsi + rcx + code_map], 1
+		emit_u8(out, 0xF6);
+		emit_u8(out, 0x84);
+		emit_u8(out, 0x0E);
+		emit_u32(out, J_MAP(0));
+		emit_u8(out, 1);
+		
+	}
+	else {
+		
+		// test byte [rsi + code_map + address], 1
+		emit_u8(out, 0xF6);
+		emit_u8(out, 0x86);
+		emit_u32(out, J_MAP(address));
+		emit_u8(out, 1);
+		
+	}
+	
+	skip = emit_jcc(out, CC_Z);
+	
+	if(address < 0) {
+		
+		// mov byte [rsi + store_address], cl
+		emit_u8(out, 0x88);
+		emit_u8(out, 0x8E);
+		emit_u32(out, J_STORE);
+		
+	}
+	else {
+		
+		// mov byte [rsi + store_address], address
+		emit_u8(out, 0xC6);
+		emit_u8(out, 0x86);
+		emit_u32(out, J_STORE);
+		emit_u8(out, address);
+		
+	}
+	
+	if(refund)
+		emit_cycles_op(out, CYCLES_ADD, refund);
+		
+	emit_machine_state(out, entry, next_pc);
+	emit_return(out, JIT_EXIT_STORE);
+	
+	patch_rel32(skip, *out);
+	
+}
+
+// Record (and if possible patch) a direct jump into another block
+// Without room for the record the jump stays on its stub, which leaves through the dispatcher instead of chaining
+static void jit_add_link(rr_jit_t *jit, u8 *site, u8 *stub, u8 from, u8 to) {
+	
+	if(jit->link_count == jit->link_capacity) {
+		
+		u32 capacity = jit->link_capacity ? jit->link_capacity << 1 : 256;
+		rr_jit_link_t *links = (rr_jit_link_t *)realloc(jit->links, capacity * sizeof(rr_jit_link_t));
+		
+		if(!links) {
+			
+			patch_rel32(site, stub);
+			return;
+			
+		}
+		
+		jit->links = links;
+		jit->link_capacity = capacity;
+		
+	}
+	
+	jit->links[jit->link_count++] = (rr_jit_link_t){ site, stub, from, to };
+	
+	patch_rel32(site, jit->blocks[to].code ? jit->blocks[to].code : stub);
+	
+}
+
+// End the block with a jump to a known address, chained straight into the target block once it is translated
+static void emit_chain(rr_jit_t *jit, u8 **out, u8 from, rr_decoded_t *entry, u8 next_pc) {
+	
+	u8 *site;
+	
+	emit_machine_state(out, entry, next_pc);
+	
+	// jmp rel32, followed by the stub it points to until the target exists
+	emit_u8(out, 0xE9);
+	site = *out;
+	emit_u32(out, 0);
+	
+	jit_add_link(jit, site, *out, from, next_pc);
+	emit_return(out, JIT_EXIT_CONTINUE);
+	
+}
+
+// Run a single instruction through the interpreter from translated code (used for ROT)
+static void jit_execute_helper(rr_machine_t *machine, u32 packed) {
+	
+	machine->instruction_register = packed & 0xFFFF;
+	machine->program_counter = packed >> 16;
+	
+	machine_decode(machine);
+	machine_execute(machine);
+	
+}
+
+// Call jit_execute_helper, preserving the machine and context pointers
+static void emit_helper_call(u8 **out, u16 instruction, u8 address) {
+	
+	// push rdi; push rsi; sub rsp, 8 (keeps the stack 16-byte aligned for the call)
+	emit_u8(out, 0x57);
+	emit_u8(out, 0x56);
+	emit_u8(out, 0x48);
+	emit_u8(out, 0x83);
+	emit_u8(out, 0xEC);
+	emit_u8(out, 0x08);
+	
+	// mov esi, packed
+	emit_u8(out, 0xBE);
+	emit_u32(out, instruction | (address << 16));
+	
+	// mov rax, helper; call rax
+	emit_u8(out, 0x48);
+	emit_u8(out, 0xB8);
+	emit_u64(out, (u64)(uintptr_t)jit_execute_helper);
+	emit_u8(out, 0xFF);
+	emit_u8(out, 0xD0);
+	
+	// add rsp, 8; pop rsi; pop rdi
+	emit_u8(out, 0x48);
+	emit_u8(out, 0x83);
+	emit_u8(out, 0xC4);
+	emit_u8(out, 0x08);
+	emit_u8(out, 0x5E);
+	emit_u8(out, 0x5F);
+	
+}
+
+// Remove a block, unlinking every jump into it
+static void jit_remove_block(rr_jit_t *jit, u8 start) {
+	
+	u32 c = 0;
+	
+	jit->blocks[start].code = NULL;
+	jit->entry_points[start] = NULL;
+	jit->blocks_invalidated++;
+	
+	while(c < jit->link_count) {
+		
+		rr_jit_link_t *link = &jit->links[c];
+		
+		// Jumps out of the dead block are never taken again
+		if(link->from == start) {
+			
+			*link = jit->links[--jit->link_count];
+			continue;
+			
+		}
+		
+		if(link->to == start)
+			patch_rel32(link->site, link->stub);
+			
+		c++;
+		
+	}
+	
+}
+
+// Drop every block covering the given memory cell
+static void jit_invalidate(rr_jit_t *jit, u8 address) {
+	
+	u16 start = 0;
+	
+	for(; start < 256; start++)
+		if(jit->blocks[start].code && (u8)(address - start) < (jit->blocks[start].length << 1))
+			jit_remove_block(jit, start);
+			
+	// Rebuild the code map from whatever is left
+	memset(jit->code_map, 0, 256);
+	
+	for(start = 0; start < 256; start++)
+		if(jit->blocks[start].code) {
+			
+			u8 c = 0;
+			
+			for(; c < (jit->blocks[start].length << 1); c++)
+				jit->code_map[(u8)(start + c)] = 1;
+				
+		}
+		
+}
+
+// Translate the block starting at the given address
+static u8 *jit_translate(rr_jit_t *jit, rr_machine_t *machine, u8 start) {
+	
+	u8 *code;
+	u8 *out;
+	u8 *skip;
+	u8 length = 0;
+	u8 c;
+	u16 address;
+	
+	if(jit->code_used + JIT_BLOCK_BYTES > JIT_CODE_SIZE)
+		jit_flush(jit);
+		
+	code = out = jit->code + jit->code_used;
+	
+	// Blocks run up to (and including) the first instruction that can change the program counter
+	for(address = start; length < JIT_MAX_BLOCK; address += 2) {
+		
+		u8 opcode = machine_predecode(machine, (u8)address)->operands[0];
+		
+		length++;
+		
+		if(opcode == 0x0 || (opcode >= 0xC && opcode != 0xF))
+			break;
+			
+	}
+	
+	// Charge the whole block up front, leaving to the interpreter if the budget can't cover it
+	emit_cycles_op(&out, CYCLES_CMP, length);
+	skip = emit_jcc(&out, CC_AE);
+	emit_store_imm(&out, M_PC, start);
+	emit_return(&out, JIT_EXIT_BUDGET);
+	patch_rel32(skip, out);
+	emit_cycles_op(&out, CYCLES_SUB, length);
+	
+	for(c = 0, address = start; c < length; c++, address += 2) {
+		
+		rr_decoded_t *entry = &machine->decode_cache[(u8)address];
+		u8 *operands = entry->operands;
+		u8 next_pc = address + 2;
+		u32 refund = length - c - 1;
+		
+		switch(operands[0]) {
+			
+			// Halt
+			case 0x0:
+				emit_or_imm(&out, M_SR, 0b1100);
+				emit_machine_state(&out, entry, next_pc);
+				emit_return(&out, JIT_EXIT_HALT);
+				break;
+				
+			// Add with carry
+			case 0x1:
+				emit_load(&out, EAX, M_REG(operands[2]));
+				emit_load(&out, ECX, M_REG(operands[3]));
+				// add eax, ecx
+				emit_u8(&out, 0x01);
+				emit_u8(&out, 0xC8);
+				emit_load(&out, ECX, M_SR);
+				// and ecx, 1; add eax, ecx
+				emit_u8(&out, 0x83);
+				emit_u8(&out, 0xE1);
+				emit_u8(&out, 0x01);
+				emit_u8(&out, 0x01);
+				emit_u8(&out, 0xC8);
+				emit_store(&out, EAX, M_REG(operands[1]));
+				// mov edx, eax; shr edx, 8 (carry); test al, al; sete cl; add cl, cl; or dl, cl
+				emit_u8(&out, 0x89);
+				emit_u8(&out, 0xC2);
+				emit_u8(&out, 0xC1);
+				emit_u8(&out, 0xEA);
+				emit_u8(&out, 0x08);
+				emit_u8(&out, 0x84);
+				emit_u8(&out, 0xC0);
+				emit_u8(&out, 0x0F);
+				emit_u8(&out, 0x94);
+				emit_u8(&out, 0xC1);
+				emit_u8(&out, 0x00);
+				emit_u8(&out, 0xC9);
+				emit_u8(&out, 0x08);
+				emit_u8(&out, 0xCA);
+				emit_store(&out, EDX, M_SR);
+				break;
+				
+			// AND, XOR
+			case 0x2:
+			case 0x3:
+				emit_load(&out, EAX, M_REG(operands[2]));
+				// (and|xor) al, byte [rdi + T]
+				emit_u8(&out, operands[0] == 0x2 ? 0x22 : 0x32);
+				emit_u8(&out, 0x87);
+				emit_u32(&out, M_REG(operands[3]));
+				emit_store(&out, EAX, M_REG(operands[1]));
+				emit_zero_flag(&out);
+				break;
+				
+			// Rotate register - rare enough to leave to the interpreter
+			case 0x4:
+				emit_helper_call(&out, entry->instruction, address);
+				break;
+				
+			// Load immediate
+			case 0x5:
+				emit_store_imm(&out, M_REG(operands[1]), operands[2]);
+				emit_and_imm(&out, M_SR, 0b1101);
+				if(!operands[2])
+					emit_or_imm(&out, M_SR, 0b0010);
+				break;
+				
+			// Load from memory
+			case 0x6:
+				emit_load(&out, EAX, M_MEM(operands[2]));
+				emit_store(&out, EAX, M_REG(operands[1]));
+				emit_zero_flag(&out);
+				break;
+				
+			// Load from memory with register offset
+			case 0x7:
+				emit_load(&out, ECX, M_REG(operands[2]));
+				emit_load_indexed(&out, EAX);
+				emit_store(&out, EAX, M_REG(operands[1]));
+				emit_zero_flag(&out);
+				break;
+				
+			// Store
+			case 0x8:
+				emit_load(&out, EAX, M_REG(operands[1]));
+				emit_store(&out, EAX, M_MEM(operands[2]));
+				emit_zero_flag(&out);
+				emit_invalidate(&out, operands[2]);
+				emit_store_check(&out, operands[2], entry, next_pc, refund);
+				break;
+				
+			// Store at register offset
+			case 0x9:
+				emit_load(&out, ECX, M_REG(operands[2]));
+				emit_load(&out, EAX, M_REG(operands[1]));
+				emit_store_indexed(&out, EAX);
+				emit_zero_flag(&out);
+				emit_invalidate_indexed(&out);
+				emit_store_check(&out, -1, entry, next_pc, refund);
+				break;
+				
+			// Push register - the value is read after the decrement, as MACHINE_PUSH does
+			case 0xA:
+				emit_load(&out, ECX, M_REG(15));
+				// dec byte [rdi + SP]
+				emit_u8(&out, 0xFE);
+				emit_u8(&out, 0x8F);
+				emit_u32(&out, M_REG(15));
+				emit_load(&out, EAX, M_REG(operands[1]));
+				emit_store_indexed(&out, EAX);
+				emit_invalidate_indexed(&out);
+				emit_store_check(&out, -1, entry, next_pc, refund);
+				break;
+				
+			// Pop to register
+			case 0xB:
+				// inc byte [rdi + SP]
+				emit_u8(&out, 0xFE);
+				emit_u8(&out, 0x87);
+				emit_u32(&out, M_REG(15));
+				emit_load(&out, ECX, M_REG(15));
+				emit_load_indexed(&out, EAX);
+				emit_store(&out, EAX, M_REG(operands[1]));
+				emit_zero_flag(&out);
+				break;
+				
+			// Jump subroutine
+			case 0xC:
+				emit_load(&out, ECX, M_REG(15));
+				emit_u8(&out, 0xFE);
+				emit_u8(&out, 0x8F);
+				emit_u32(&out, M_REG(15));
+				// mov byte [rdi + rcx + memory], return address
+				emit_u8(&out, 0xC6);
+				emit_u8(&out, 0x84);
+				emit_u8(&out, 0x0F);
+				emit_u32(&out, M_MEM(0));
+				emit_u8(&out, next_pc);
+				emit_invalidate_indexed(&out);
+				emit_store_check(&out, -1, entry, operands[1], 0);
+				emit_chain(jit, &out, start, entry, operands[1]);
+				break;
+				
+			// Return from subroutine - look the target up in the entry point table
+			case 0xD:
+				emit_u8(&out, 0xFE);
+				emit_u8(&out, 0x87);
+				emit_u32(&out, M_REG(15));
+				emit_load(&out, ECX, M_REG(15));
+				emit_load_indexed(&out, EAX);
+				emit_machine_state(&out, entry, 0);
+				emit_store(&out, EAX, M_PC);
+				// mov rax, [rsi + rax * 8 + entry_points]; test rax, rax; jz stub; jmp rax
+				emit_u8(&out, 0x48);
+				emit_u8(&out, 0x8B);
+				emit_u8(&out, 0x84);
+				emit_u8(&out, 0xC6);
+				emit_u32(&out, J_ENTRY);
+				emit_u8(&out, 0x48);
+				emit_u8(&out, 0x85);
+				emit_u8(&out, 0xC0);
+				skip = emit_jcc(&out, CC_Z);
+				emit_u8(&out, 0xFF);
+				emit_u8(&out, 0xE0);
+				patch_rel32(skip, out);
+				emit_return(&out, JIT_EXIT_CONTINUE);
+				break;
+				
+			// Branch on flag conditions
+			case 0xE:
+				
+				if(operands[1]) {
+					
+					// movzx eax, SR; xor al, values; test al, considered; jz taken
+					emit_load(&out, EAX, M_SR);
+					emit_u8(&out, 0x34);
+					emit_u8(&out, operands[2]);
+					emit_u8(&out, 0xA8);
+					emit_u8(&out, operands[1]);
+					skip = emit_jcc(&out, CC_Z);
+					emit_chain(jit, &out, start, entry, next_pc);
+					patch_rel32(skip, out);
+					
+				}
+				
+				emit_chain(jit, &out, start, entry, operands[3]);
+				break;
+				
+			// Modify flags
+			case 0xF:
+				if(operands[1]) {
+					emit_and_imm(&out, M_SR, ~operands[1]);
+					emit_or_imm(&out, M_SR, operands[2] & operands[1]);
+				}
+				break;
+				
+		}
+		
+		// Mark the instruction's bytes as translated
+		jit->code_map[(u8)address] = jit->code_map[(u8)(address + 1)] = 1;
+		jit->translated_memory[(u8)address] = MEM(machine, (u8)address);
+		jit->translated_memory[(u8)(address + 1)] = MEM(machine, (u8)(address + 1));
+		
+	}
+	
+	// Ran out of room before reaching a jump, continue with the next block
+	{
+		
+		rr_decoded_t *last = &machine->decode_cache[(u8)(address - 2)];
+		
+		if(last->operands[0] != 0x0 && (last->operands[0] < 0xC || last->operands[0] == 0xF))
+			emit_chain(jit, &out, start, last, (u8)address);
+			
+	}
+	
+	jit->code_used = out - jit->code;
+	jit->blocks[start].code = code;
+	jit->blocks[start].length = length;
+	jit->entry_points[start] = code;
+	jit->blocks_translated++;
+	
+	// Patch jumps from blocks translated earlier that were waiting on this one
+	for(c = 0; c < jit->link_count; c++)
+		if(jit->links[c].to == start)
+			patch_rel32(jit->links[c].site, code);
+			
+	return code;
+	
+}
+
+// Drop blocks whose memory was changed outside of translated code since they were translated
+static void jit_check_memory(rr_jit_t *jit, rr_machine_t *machine) {
+	
+	u16 c = 0;
+	
+	for(; c < 256; c++)
+		if(jit->code_map[c] && jit->translated_memory[c] != MEM(machine, c))
+			jit_invalidate(jit, c);
+			
+}
+
+rr_jit_t *jit_new() {
+	
+	rr_jit_t *jit = (rr_jit_t *)calloc(1, sizeof(rr_jit_t));
+	
+	if(!jit)
+		return NULL;
+		
+	jit->code = (u8 *)mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	
+	if(jit->code == MAP_FAILED) {
+		
+		free(jit);
+		
+		return NULL;
+		
+	}
+	
+	jit->writable = 1;
+	
+	return jit;
+	
+}
+
+void jit_free(rr_jit_t *jit) {
+	
+	if(!jit)
+		return;
+		
+	munmap(jit->code, JIT_CODE_SIZE);
+	free(jit->links);
+	free(jit);
+	
+}
+
+void jit_flush(rr_jit_t *jit) {
+	
+	memset(jit->entry_points, 0, sizeof(jit->entry_points));
+	memset(jit->code_map, 0, 256);
+	memset(jit->blocks, 0, sizeof(jit->blocks));
+	
+	jit->link_count = 0;
+	jit->code_used = 0;
+	jit->flushes++;
+	
+}
+
+// Switch the code buffer between writable and executable, returns 1 if it can't be switched
+// Only costs a system call when it changes, which happens as blocks are translated or invalidated rather than as they run
+static u8 jit_protect(rr_jit_t *jit, u8 writable) {
+	
+	if(jit->writable == writable)
+		return 0;
+		
+	if(mprotect(jit->code, JIT_CODE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC))
+		return 1;
+		
+	jit->writable = writable;
+	
+	return 0;
+	
+}
+
+// Run translated blocks, machine_run_jit marks what they wrote to the registers and PC/SR/IR
+// Should the code buffer's protection fail to change, the interpreter finishes the run
+static u64 jit_run(rr_machine_t *machine, rr_jit_t *jit, u64 max_cycles) {
+	
+	u64 cycle_limit = max_cycles ? max_cycles : UINT64_MAX;
+	
+	if(CURRENT_STATE(machine) == 0b11)
+		return 0;
+		
+	jit->cycles_left = cycle_limit;
+	
+	// Translated code always starts at a fetch
+	if(CURRENT_STATE(machine)) {
+		
+		jit->cycles_left--;
+		
+		if(machine_step(machine, 0) == 0b11 || !jit->cycles_left)
+			return 1;
+			
+	}
+	
+	if(jit_protect(jit, 1))
+		goto interpret;
+		
+	jit_check_memory(jit, machine);
+	
+	while(1) {
+		
+		jit_block_fn block;
+		u8 *code = jit->entry_points[machine->program_counter];
+		
+		if(!code) {
+			
+			if(jit_protect(jit, 1))
+				goto interpret;
+				
+			code = jit_translate(jit, machine, machine->program_counter);
+			
+		}
+		
+		if(jit_protect(jit, 0))
+			goto interpret;
+			
+		block = (jit_block_fn)(uintptr_t)code;
+		
+		switch(block(machine, jit)) {
+			
+			case JIT_EXIT_CONTINUE:
+				break;
+				
+			// A store hit translated code, retranslate from the new contents
+			case JIT_EXIT_STORE:
+				if(jit_protect(jit, 1))
+					goto interpret;
+				jit_invalidate(jit, jit->store_address);
+				break;
+				
+			// Too few cycles left for a whole block, finish them in the interpreter
+			case JIT_EXIT_BUDGET:
+				goto interpret;
+				
+			case JIT_EXIT_HALT:
+				return cycle_limit - jit->cycles_left;
+				
+		}
+		
+	}
+	
+	// The interpreter runs whatever is left when a block can't - too few cycles for a whole one, or the buffer's protection couldn't be changed
+	interpret:
+	
+	if(jit->cycles_left)
+		jit->cycles_left -= machine_run_fast(machine, jit->cycles_left);
+		
+	return cycle_limit - jit->cycles_left;
+	
+}
+
+u64 machine_run_jit(rr_machine_t *machine, rr_jit_t *jit, u64 max_cycles) {
+	
+	u8 registers[16];
+	u8 program_counter = machine->program_counter;
+	u8 status_register = machine->status_register;
+	u16 instruction_register = machine->instruction_register;
+	u64 cycles;
+	
+	if(!jit)
+		return machine_run_fast(machine, max_cycles);
+		
+	// Translated code writes these in place without marking them (stores do mark memory), so compare against the start once it stops
+	memcpy(registers, machine->registers, 16);
+	cycles = jit_run(machine, jit, max_cycles);
+	machine_mark_state(machine, registers, program_counter, status_register, instruction_register);
+	
+	return cycles;
+	
+}
+
+#else
+
+rr_jit_t *jit_new() {
+	
+	return NULL;
+	
+}
+
+void jit_free(rr_jit_t *jit) {
+	
+	free(jit);
+	
+}
+
+void jit_flush(rr_jit_t *jit) {
+	
+}
+
+u64 machine_run_jit(rr_machine_t *machine, rr_jit_t *jit, u64 max_cycles) {
+	
+	return machine_run_fast(machine, max_cycles);
+	
+}
+
+#endif
\ No newline at end of file
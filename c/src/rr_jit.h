@@ -0,0 +1,81 @@
+#ifndef RR_JIT_H
+#define RR_JIT_H
+
+#include "rr_machine.h"
+
+// Native translation is only implemented for x86-64 with the System V calling convention
+#if defined(__x86_64__) && defined(__unix__)
+#define RR_JIT_AVAILABLE 1
+#else
+#define RR_JIT_AVAILABLE 0
+#endif
+
+// Size of the executable buffer blocks are translated into, flushed entirely when it fills up
+#define JIT_CODE_SIZE (1 << 20)
+// Longest run of instructions translated as one block
+#define JIT_MAX_BLOCK 64
+
+// Ways translated code can hand control back to the dispatcher
+#define JIT_EXIT_CONTINUE 0
+#define JIT_EXIT_HALT 1
+#define JIT_EXIT_BUDGET 2
+#define JIT_EXIT_STORE 3
+
+// One translated basic block
+typedef struct rr_jit_block_d {
+	// Native entry point, NULL when the block is not translated
+	u8 *code;
+	// Number of instructions (memory bytes covered is twice this, starting at the block's address)
+	u8 length;
+} rr_jit_block_t;
+
+// A direct jump from the end of one block to the start of another
+typedef struct rr_jit_link_d {
+	// Location of the jump's rel32 displacement
+	u8 *site;
+	// Where the jump goes while the target is not translated (returns to the dispatcher)
+	u8 *stub;
+	// Blocks on either end of the jump
+	u8 from;
+	u8 to;
+} rr_jit_link_t;
+
+typedef struct rr_jit_d {
+	// Read and written by translated code (addressed relative to the context) - must stay at the front
+	u64 cycles_left;
+	u8 *entry_points[256];
+	// Set for each memory cell that is part of a translated block, stores here leave the block
+	u8 code_map[256];
+	// Address of the store that left the block with JIT_EXIT_STORE
+	u8 store_address;
+
+	// Memory contents at translation, used to catch writes made outside of translated code between runs
+	u8 translated_memory[256];
+	rr_jit_block_t blocks[256];
+	rr_jit_link_t *links;
+	u32 link_count;
+	u32 link_capacity;
+
+	// Executable buffer, writable while blocks are translated or unlinked and executable while they run - never both at once
+	u8 *code;
+	u32 code_used;
+	u8 writable;
+
+	// Statistics
+	u64 blocks_translated;
+	u64 blocks_invalidated;
+	u64 flushes;
+} rr_jit_t;
+
+// Create a translator, returns NULL if executable memory is not available (or the JIT is not supported on this platform)
+rr_jit_t *jit_new();
+void jit_free(rr_jit_t *jit);
+
+// Drop every translated block
+void jit_flush(rr_jit_t *jit);
+
+// Run full cycles up to a HALT or max_cycles (0 for no limit) using translated code, returns the number of cycles run
+// With a NULL jit this falls back to the interpreter, the end state is the same either way
+u64 machine_run_jit(rr_machine_t *machine, rr_jit_t *jit, u64 max_cycles);
+
+#endif
\ No newline at end of file
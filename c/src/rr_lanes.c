@@ -0,0 +1,588 @@
+#include "rr_lanes.h"
+
+// Vector primitives over bytes, widest available first - masks are 0xFF/0x00 per lane
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LANE_VECTOR 32
+typedef __m256i lane_vec_t;
+#define VLOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define VSTORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define VSET(x) _mm256_set1_epi8((char)(x))
+#define VADD(a, b) _mm256_add_epi8(a, b)
+#define VSUB(a, b) _mm256_sub_epi8(a, b)
+#define VADDS(a, b) _mm256_adds_epu8(a, b)
+#define VAND(a, b) _mm256_and_si256(a, b)
+#define VANDNOT(m, a) _mm256_andnot_si256(m, a)
+#define VOR(a, b) _mm256_or_si256(a, b)
+#define VXOR(a, b) _mm256_xor_si256(a, b)
+#define VEQ(a, b) _mm256_cmpeq_epi8(a, b)
+#define VMIN(a, b) _mm256_min_epu8(a, b)
+#define VMAX(a, b) _mm256_max_epu8(a, b)
+#define VTOP(a) _mm256_cmpgt_epi8(_mm256_setzero_si256(), a)
+#define VBLEND(a, b, m) _mm256_blendv_epi8(a, b, m)
+#define VBITS(m) (u32)_mm256_movemask_epi8(m)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LANE_VECTOR 16
+typedef __m128i lane_vec_t;
+#define VLOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define VSTORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define VSET(x) _mm_set1_epi8((char)(x))
+#define VADD(a, b) _mm_add_epi8(a, b)
+#define VSUB(a, b) _mm_sub_epi8(a, b)
+#define VADDS(a, b) _mm_adds_epu8(a, b)
+#define VAND(a, b) _mm_and_si128(a, b)
+#define VANDNOT(m, a) _mm_andnot_si128(m, a)
+#define VOR(a, b) _mm_or_si128(a, b)
+#define VXOR(a, b) _mm_xor_si128(a, b)
+#define VEQ(a, b) _mm_cmpeq_epi8(a, b)
+#define VMIN(a, b) _mm_min_epu8(a, b)
+#define VMAX(a, b) _mm_max_epu8(a, b)
+#define VTOP(a) _mm_cmpgt_epi8(_mm_setzero_si128(), a)
+#define VBLEND(a, b, m) _mm_or_si128(_mm_andnot_si128(m, a), _mm_and_si128(m, b))
+#define VBITS(m) (u32)_mm_movemask_epi8(m)
+#else
+// One lane at a time
+#define LANE_VECTOR 1
+typedef u8 lane_vec_t;
+#define VLOAD(p) (*(const u8 *)(p))
+#define VSTORE(p, v) (*(u8 *)(p) = (v))
+#define VSET(x) ((u8)(x))
+#define VADD(a, b) ((u8)((a) + (b)))
+#define VSUB(a, b) ((u8)((a) - (b)))
+#define VADDS(a, b) ((u8)((a) + (b) > 0xFF ? 0xFF : (a) + (b)))
+#define VAND(a, b) ((u8)((a) & (b)))
+#define VANDNOT(m, a) ((u8)(~(m) & (a)))
+#define VOR(a, b) ((u8)((a) | (b)))
+#define VXOR(a, b) ((u8)((a) ^ (b)))
+#define VEQ(a, b) ((u8)((a) == (b) ? 0xFF : 0x00))
+#define VMIN(a, b) ((u8)((a) < (b) ? (a) : (b)))
+#define VMAX(a, b) ((u8)((a) > (b) ? (a) : (b)))
+#define VTOP(a) ((u8)((a) & 0x80 ? 0xFF : 0x00))
+#define VBLEND(a, b, m) ((u8)(((a) & ~(m)) | ((b) & (m))))
+#define VBITS(m) (u32)((m) & 1)
+#endif
+
+// Row pointers
+#define REG_ROW(l, r) ((l)->registers + (r) * (l)->stride)
+#define MEM_ROW(l, a) ((l)->memory + (a) * (l)->stride)
+
+// Blend a new value into the masked lanes of a row
+#define ROW_UPDATE(row, value, m) VSTORE((row) + c, VBLEND(VLOAD((row) + c), value, m))
+
+// Index of the lowest set bit
+#if defined(__GNUC__)
+#define LOWEST_BIT(x) __builtin_ctz(x)
+#else
+static u32 LOWEST_BIT(u32 x) {
+	
+	u32 bit = 0;
+	
+	while(!(x & 1)) {
+		x >>= 1;
+		bit++;
+	}
+	
+	return bit;
+	
+}
+#endif
+
+rr_lanes_t *lanes_new(u32 lane_count) {
+	
+	rr_lanes_t *lanes;
+	u8 *rows;
+	u32 stride = (lane_count + LANE_GROUP - 1) / LANE_GROUP * LANE_GROUP;
+	
+	if(!lane_count)
+		return NULL;
+		
+	lanes = (rr_lanes_t *)calloc(1, sizeof(rr_lanes_t));
+	// 16 registers, 256 memory cells and 8 single rows
+	rows = (u8 *)calloc((size_t)stride, 16 + 256 + 8);
+	
+	if(!lanes || !rows) {
+		
+		free(lanes);
+		free(rows);
+		
+		return NULL;
+		
+	}
+	
+	lanes->cycles = (u64 *)calloc(stride, sizeof(u64));
+	
+	if(!lanes->cycles) {
+		
+		free(lanes);
+		free(rows);
+		
+		return NULL;
+		
+	}
+	
+	lanes->lane_count = lane_count;
+	lanes->stride = stride;
+	lanes->registers = rows;
+	lanes->memory = lanes->registers + 16 * stride;
+	lanes->program_counter = lanes->memory + 256 * stride;
+	lanes->zero = lanes->program_counter + stride;
+	lanes->carry = lanes->zero + stride;
+	lanes->instruction_high = lanes->carry + stride;
+	lanes->instruction_low = lanes->instruction_high + stride;
+	lanes->running = lanes->instruction_low + stride;
+	lanes->halted = lanes->running + stride;
+	lanes->recent_cycles = lanes->halted + stride;
+	
+	// Stack pointers start at the end of memory, as in machine_new
+	memset(REG_ROW(lanes, 15), 0xFF, stride);
+	
+	return lanes;
+	
+}
+
+void lanes_free(rr_lanes_t *lanes) {
+	
+	if(!lanes)
+		return;
+		
+	free(lanes->registers);
+	free(lanes->cycles);
+	free(lanes);
+	
+}
+
+u8 lanes_import(rr_lanes_t *lanes, u32 lane, const rr_machine_t *machine) {
+	
+	u16 c = 0;
+	
+	if(lane >= lanes->lane_count)
+		return 1;
+		
+	// Only whole cycles can be split across lanes
+	if(CURRENT_STATE(machine) == 0b01 || CURRENT_STATE(machine) == 0b10)
+		return 2;
+		
+	for(; c < 16; c++)
+		LANE_REG(lanes, c, lane) = REG(machine, c);
+		
+	for(c = 0; c < 256; c++)
+		LANE_MEM(lanes, c, lane) = MEM(machine, c);
+		
+	lanes->program_counter[lane] = machine->program_counter;
+	lanes->zero[lane] = ZERO_SET(machine);
+	lanes->carry[lane] = CARRY_SET(machine);
+	lanes->instruction_high[lane] = machine->instruction_register >> 8;
+	lanes->instruction_low[lane] = machine->instruction_register & 0xFF;
+	lanes->halted[lane] = CURRENT_STATE(machine) == 0b11 ? 0xFF : 0x00;
+	lanes->cycles[lane] = 0;
+	
+	return 0;
+	
+}
+
+u8 lanes_export(const rr_lanes_t *lanes, u32 lane, rr_machine_t *machine) {
+	
+	u8 registers[16];
+	u8 memory[256];
+	u16 instruction_register;
+	u8 status_register;
+	u16 c = 0;
+	
+	if(lane >= lanes->lane_count)
+		return 1;
+		
+	status_register = (lanes->halted[lane] ? 0b1100 : 0) | (lanes->zero[lane] << 1) | lanes->carry[lane];
+	instruction_register = (lanes->instruction_high[lane] << 8) | lanes->instruction_low[lane];
+	
+	// Gathered out of the lane first, so only what differs is marked changed
+	for(; c < 16; c++)
+		registers[c] = LANE_REG(lanes, c, lane);
+		
+	for(c = 0; c < 256; c++)
+		memory[c] = LANE_MEM(lanes, c, lane);
+		
+	machine_mark_state(machine, registers, lanes->program_counter[lane], status_register, instruction_register);
+	machine_mark_memory(machine, memory);
+	
+	memcpy(machine->registers, registers, 16);
+	memcpy(machine->memory, memory, 256);
+	memset(machine->decode_cache, 0, sizeof(machine->decode_cache));
+	
+	machine->program_counter = lanes->program_counter[lane];
+	machine->status_register = status_register;
+	machine->instruction_register = instruction_register;
+	machine_decode_instruction(machine->instruction_register, machine->operands);
+	
+	return 0;
+	
+}
+
+// Move the per-step counters into the totals, stop lanes that have used up max_cycles and return the most cycles any running lane has run
+static u64 lanes_flush_cycles(rr_lanes_t *lanes, u64 max_cycles) {
+	
+	u32 lane = 0;
+	u64 most = 0;
+	
+	for(; lane < lanes->lane_count; lane++) {
+		
+		lanes->cycles[lane] += lanes->recent_cycles[lane];
+		lanes->recent_cycles[lane] = 0;
+		
+		if(!lanes->running[lane])
+			continue;
+			
+		if(lanes->cycles[lane] >= max_cycles)
+			lanes->running[lane] = 0;
+		else if(lanes->cycles[lane] > most)
+			most = lanes->cycles[lane];
+			
+	}
+	
+	return most;
+	
+}
+
+// Run one instruction in every lane at the given address holding the same instruction as the leader lane
+static void lanes_step(rr_lanes_t *lanes, u8 address, u32 leader) {
+	
+	u8 high = LANE_MEM(lanes, address, leader);
+	u8 low = LANE_MEM(lanes, (u8)(address + 1), leader);
+	u8 operands[4];
+	u8 *pc = lanes->program_counter;
+	u32 c = 0;
+	lane_vec_t zeros = VSET(0);
+	lane_vec_t ones = VSET(1);
+	lane_vec_t all = VSET(0xFF);
+	
+	machine_decode_instruction((high << 8) | low, operands);
+	
+	for(; c < lanes->stride; c += LANE_VECTOR) {
+		
+		lane_vec_t m = VAND(VLOAD(lanes->running + c), VEQ(VLOAD(pc + c), VSET(address)));
+		// Lanes that carry on to the next instruction
+		lane_vec_t advance;
+		
+		if(!VBITS(m))
+			continue;
+			
+		m = VAND(m, VAND(VEQ(VLOAD(MEM_ROW(lanes, address) + c), VSET(high)), VEQ(VLOAD(MEM_ROW(lanes, (u8)(address + 1)) + c), VSET(low))));
+		
+		if(!VBITS(m))
+			continue;
+			
+		advance = m;
+		
+		switch(operands[0]) {
+			
+			// Halt
+			case 0x0:
+				ROW_UPDATE(lanes->halted, all, m);
+				VSTORE(lanes->running + c, VANDNOT(m, VLOAD(lanes->running + c)));
+				break;
+				
+			// Add with carry
+			case 0x1:
+				
+				{
+					
+					lane_vec_t s = VLOAD(REG_ROW(lanes, operands[2]) + c);
+					lane_vec_t t = VLOAD(REG_ROW(lanes, operands[3]) + c);
+					lane_vec_t carry = VLOAD(lanes->carry + c);
+					lane_vec_t sum = VADD(s, t);
+					// Saturating add differs from the wrapped sum exactly when S + T carries
+					lane_vec_t carry_out = VXOR(VEQ(VADDS(s, t), sum), all);
+					
+					carry_out = VOR(carry_out, VAND(VEQ(sum, all), VEQ(carry, ones)));
+					sum = VADD(sum, carry);
+					
+					ROW_UPDATE(REG_ROW(lanes, operands[1]), sum, m);
+					ROW_UPDATE(lanes->zero, VAND(VEQ(sum, zeros), ones), m);
+					ROW_UPDATE(lanes->carry, VAND(carry_out, ones), m);
+					
+				}
+				
+				break;
+				
+			// AND, XOR
+			case 0x2:
+			case 0x3:
+				
+				{
+					
+					lane_vec_t s = VLOAD(REG_ROW(lanes, operands[2]) + c);
+					lane_vec_t t = VLOAD(REG_ROW(lanes, operands[3]) + c);
+					lane_vec_t result = operands[0] == 0x2 ? VAND(s, t) : VXOR(s, t);
+					
+					ROW_UPDATE(REG_ROW(lanes, operands[1]), result, m);
+					ROW_UPDATE(lanes->zero, VAND(VEQ(result, zeros), ones), m);
+					
+				}
+				
+				break;
+				
+			// Rotate register - a right rotate by n is a left rotate by 9 - n through the carry, done one bit at a time
+			case 0x4:
+				
+				{
+					
+					lane_vec_t t = VLOAD(REG_ROW(lanes, operands[3]) + c);
+					lane_vec_t count = VAND(t, VSET(0b0111));
+					lane_vec_t right = VEQ(VAND(t, VSET(0b1000)), VSET(0b1000));
+					lane_vec_t rotate = VANDNOT(VEQ(count, zeros), m);
+					lane_vec_t value = VLOAD(REG_ROW(lanes, operands[2]) + c);
+					lane_vec_t carry = VLOAD(lanes->carry + c);
+					// Matches machine_execute, Z comes from the destination before it is written
+					lane_vec_t zero = VAND(VEQ(VLOAD(REG_ROW(lanes, operands[1]) + c), zeros), ones);
+					u8 bit = 1;
+					
+					count = VBLEND(count, VSUB(VSET(9), count), right);
+					
+					for(; bit <= 8; bit++) {
+						
+						lane_vec_t step = VAND(rotate, VEQ(VMAX(count, VSET(bit)), count));
+						lane_vec_t carry_out = VAND(VTOP(value), ones);
+						
+						value = VBLEND(value, VOR(VADD(value, value), carry), step);
+						carry = VBLEND(carry, carry_out, step);
+						
+					}
+					
+					ROW_UPDATE(REG_ROW(lanes, operands[1]), value, rotate);
+					ROW_UPDATE(lanes->carry, carry, rotate);
+					ROW_UPDATE(lanes->zero, zero, rotate);
+					
+				}
+				
+				break;
+				
+			// Load immediate
+			case 0x5:
+				ROW_UPDATE(REG_ROW(lanes, operands[1]), VSET(operands[2]), m);
+				ROW_UPDATE(lanes->zero, VSET(operands[2] == 0), m);
+				break;
+				
+			// Load from memory
+			case 0x6:
+				
+				{
+					
+					lane_vec_t value = VLOAD(MEM_ROW(lanes, operands[2]) + c);
+					
+					ROW_UPDATE(REG_ROW(lanes, operands[1]), value, m);
+					ROW_UPDATE(lanes->zero, VAND(VEQ(value, zeros), ones), m);
+					
+				}
+				
+				break;
+				
+			// Store
+			case 0x8:
+				
+				{
+					
+					lane_vec_t value = VLOAD(REG_ROW(lanes, operands[1]) + c);
+					
+					ROW_UPDATE(MEM_ROW(lanes, operands[2]), value, m);
+					ROW_UPDATE(lanes->zero, VAND(VEQ(value, zeros), ones), m);
+					
+				}
+				
+				break;
+				
+			// Register offset and stack instructions address memory differently in every lane, so run them lane by lane
+			case 0x7:
+			case 0x9:
+			case 0xA:
+			case 0xB:
+			case 0xC:
+			case 0xD:
+				
+				{
+					
+					u32 bits = VBITS(m);
+					
+					while(bits) {
+						
+						u32 lane = c + LOWEST_BIT(bits);
+						u8 sp = LANE_REG(lanes, 15, lane);
+						
+						bits &= bits - 1;
+						
+						switch(operands[0]) {
+							
+							// Load from memory with register offset
+							case 0x7:
+								LANE_REG(lanes, operands[1], lane) = LANE_MEM(lanes, LANE_REG(lanes, operands[2], lane), lane);
+								lanes->zero[lane] = LANE_REG(lanes, operands[1], lane) == 0;
+								break;
+								
+							// Store at register offset
+							case 0x9:
+								LANE_MEM(lanes, LANE_REG(lanes, operands[2], lane), lane) = LANE_REG(lanes, operands[1], lane);
+								lanes->zero[lane] = LANE_REG(lanes, operands[1], lane) == 0;
+								break;
+								
+							// Push register - the value is read after the decrement, as MACHINE_PUSH does
+							case 0xA:
+								LANE_REG(lanes, 15, lane) = sp - 1;
+								LANE_MEM(lanes, sp, lane) = LANE_REG(lanes, operands[1], lane);
+								break;
+								
+							// Pop to register
+							case 0xB:
+								sp++;
+								LANE_REG(lanes, 15, lane) = sp;
+								LANE_REG(lanes, operands[1], lane) = LANE_MEM(lanes, sp, lane);
+								lanes->zero[lane] = LANE_MEM(lanes, sp, lane) == 0;
+								break;
+								
+							// Jump subroutine
+							case 0xC:
+								LANE_REG(lanes, 15, lane) = sp - 1;
+								LANE_MEM(lanes, sp, lane) = address + 2;
+								pc[lane] = operands[1];
+								break;
+								
+							// Return from subroutine
+							case 0xD:
+								sp++;
+								LANE_REG(lanes, 15, lane) = sp;
+								pc[lane] = LANE_MEM(lanes, sp, lane);
+								break;
+								
+						}
+						
+					}
+					
+					if(operands[0] >= 0xC)
+						advance = zeros;
+						
+				}
+				
+				break;
+				
+			// Branch on flag conditions
+			case 0xE:
+				
+				{
+					
+					lane_vec_t taken = m;
+					
+					if(operands[1] & 0b0010)
+						taken = VAND(taken, VEQ(VLOAD(lanes->zero + c), VSET((operands[2] >> 1) & 1)));
+					if(operands[1] & 0b0001)
+						taken = VAND(taken, VEQ(VLOAD(lanes->carry + c), VSET(operands[2] & 1)));
+						
+					ROW_UPDATE(pc, VSET(operands[3]), taken);
+					advance = VANDNOT(taken, m);
+					
+				}
+				
+				break;
+				
+			// Modify flags
+			case 0xF:
+				if(operands[1] & 0b0010)
+					ROW_UPDATE(lanes->zero, VSET((operands[2] >> 1) & 1), m);
+				if(operands[1] & 0b0001)
+					ROW_UPDATE(lanes->carry, VSET(operands[2] & 1), m);
+				break;
+				
+		}
+		
+		ROW_UPDATE(lanes->instruction_high, VSET(high), m);
+		ROW_UPDATE(lanes->instruction_low, VSET(low), m);
+		// Mask lanes are 0xFF, so subtracting counts one cycle
+		VSTORE(lanes->recent_cycles + c, VSUB(VLOAD(lanes->recent_cycles + c), m));
+		
+		ROW_UPDATE(pc, VSET(address + 2), advance);
+		
+	}
+	
+}
+
+u64 lanes_run(rr_lanes_t *lanes, u64 max_cycles) {
+	
+	u32 lane = 0;
+	u64 segment = 0;
+	
+	if(!max_cycles)
+		max_cycles = UINT64_MAX;
+		
+	lanes->steps = 0;
+	lanes->lane_cycles = 0;
+	
+	// Every lane that has not halted takes part, padding lanes never do
+	for(; lane < lanes->stride; lane++) {
+		
+		lanes->running[lane] = lane < lanes->lane_count && !lanes->halted[lane] ? 0xFF : 0x00;
+		lanes->cycles[lane] = 0;
+		lanes->recent_cycles[lane] = 0;
+		
+	}
+	
+	while(1) {
+		
+		lane_vec_t lowest = VSET(0xFF);
+		u8 lowest_bytes[LANE_VECTOR];
+		u8 address = 0xFF;
+		u32 any = 0;
+		u32 c = 0;
+		
+		// Each lane can only run one cycle per step, so in steps of at most 255 (the per-step counter's range) no lane can pass the budget unnoticed
+		if(!segment) {
+			
+			u64 most = lanes_flush_cycles(lanes, max_cycles);
+			
+			segment = max_cycles - most < 255 ? max_cycles - most : 255;
+			
+		}
+		
+		// The group always moves to the lowest address any running lane is waiting at, so lanes that branched apart meet up again
+		for(; c < lanes->stride; c += LANE_VECTOR) {
+			
+			lane_vec_t running = VLOAD(lanes->running + c);
+			
+			any |= VBITS(running);
+			lowest = VMIN(lowest, VOR(VLOAD(lanes->program_counter + c), VXOR(running, VSET(0xFF))));
+			
+		}
+		
+		if(!any)
+			break;
+			
+		VSTORE(lowest_bytes, lowest);
+		
+		for(c = 0; c < LANE_VECTOR; c++)
+			if(lowest_bytes[c] < address)
+				address = lowest_bytes[c];
+				
+		// First running lane at that address decides which instruction the group runs
+		for(c = 0; c < lanes->stride; c += LANE_VECTOR) {
+			
+			u32 bits = VBITS(VAND(VLOAD(lanes->running + c), VEQ(VLOAD(lanes->program_counter + c), VSET(address))));
+			
+			if(bits) {
+				
+				lane = c + LOWEST_BIT(bits);
+				break;
+				
+			}
+			
+		}
+		
+		lanes_step(lanes, address, lane);
+		lanes->steps++;
+		segment--;
+		
+	}
+	
+	lanes_flush_cycles(lanes, max_cycles);
+	
+	for(lane = 0; lane < lanes->lane_count; lane++)
+		lanes->lane_cycles += lanes->cycles[lane];
+		
+	return lanes->steps;
+	
+}
\ No newline at end of file
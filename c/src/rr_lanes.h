@@ -0,0 +1,54 @@
+#ifndef RR_LANES_H
+#define RR_LANES_H
+
+#include "rr_machine.h"
+
+// Lanes are processed in groups of the widest vector used (AVX2), rows are padded to a multiple of this
+#define LANE_GROUP 32
+
+// Row access - each machine field is a row with one byte per lane
+#define LANE_REG(l, r, lane) ((l)->registers[(r) * (l)->stride + (lane)])
+#define LANE_MEM(l, a, lane) ((l)->memory[(a) * (l)->stride + (lane)])
+
+// Many machines run in lockstep, stored field by field (structure of arrays) so one vector instruction covers many lanes
+// All lanes step through the same program counter together - lanes at another address, or holding a different instruction there, sit out until the group reaches them
+typedef struct rr_lanes_d {
+	u32 lane_count;
+	// Row length, lane_count rounded up to LANE_GROUP
+	u32 stride;
+	// registers[16][stride]
+	u8 *registers;
+	// memory[256][stride]
+	u8 *memory;
+	u8 *program_counter;
+	// Flags kept as separate 0/1 rows
+	u8 *zero;
+	u8 *carry;
+	// Last instruction run by each lane
+	u8 *instruction_high;
+	u8 *instruction_low;
+	// 0xFF for lanes still taking part in the current run
+	u8 *running;
+	// 0xFF for lanes that executed a HALT
+	u8 *halted;
+	// Cycles each lane ran in the last lanes_run
+	u64 *cycles;
+	// Cycles counted since the last flush into cycles (at most 255)
+	u8 *recent_cycles;
+	// Lockstep steps taken and instructions executed across all lanes in the last lanes_run
+	u64 steps;
+	u64 lane_cycles;
+} rr_lanes_t;
+
+// Create lane_count machines in the reset state (memory cleared, stack pointer at 0xFF)
+rr_lanes_t *lanes_new(u32 lane_count);
+void lanes_free(rr_lanes_t *lanes);
+
+// Copy a machine into or out of a lane - machines must be between cycles (not partway through a part step)
+u8 lanes_import(rr_lanes_t *lanes, u32 lane, const rr_machine_t *machine);
+u8 lanes_export(const rr_lanes_t *lanes, u32 lane, rr_machine_t *machine);
+
+// Run every lane up to a HALT or max_cycles (0 for no limit), returns the number of lockstep steps taken
+u64 lanes_run(rr_lanes_t *lanes, u64 max_cycles);
+
+#endif
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "rr_machine.h"
+#include "rr_pace.h"
+#include "rr_isa.h"
 
 // Create a base machine
 rr_machine_t *machine_new() {
@@ -12,10 +14,15 @@ rr_machine_t *machine_new() {
 	
 }
 
+// Registers as machine_reset leaves them
+static const u8 reset_registers[16] = { [15] = 0xFF };
+
 u8 machine_reset(rr_machine_t *machine) {
 	
-	// Don't clear memory
-	memset(machine, 0, sizeof(rr_machine_t) - 256);
+	machine_mark_state(machine, reset_registers, 0, 0, 0);
+	
+	// Don't clear memory (or the decode cache, which only depends on memory)
+	memset(machine, 0, offsetof(rr_machine_t, memory));
 	STACK_POINTER(machine) = 0xFF;
 	
 	return 0;
@@ -24,18 +31,72 @@ u8 machine_reset(rr_machine_t *machine) {
 
 u8 machine_clear_memory(rr_machine_t *machine) {
 	
+	machine_mark_memory(machine, NULL);
 	memset(machine->memory, 0, 256);
+	memset(machine->decode_cache, 0, sizeof(machine->decode_cache));
 	
 	return 0;
 	
 }
 
+// Write a single memory cell, keeping the decode cache coherent
+u8 machine_poke(rr_machine_t *machine, u8 address, u8 value) {
+	
+	MEM(machine, address) = value;
+	INVALIDATE_DECODE(machine, address);
+	
+	return 0;
+	
+}
+
+u8 machine_collect_changes(rr_machine_t *machine, rr_changes_t *changes) {
+	
+	*changes = machine->changes;
+	memset(&machine->changes, 0, sizeof(rr_changes_t));
+	
+	return (changes->memory[0] | changes->memory[1] | changes->memory[2] | changes->memory[3] | changes->registers | changes->state) != 0;
+	
+}
+
+// Mark the differences from a state or memory image about to replace the machine's own
+void machine_mark_state(rr_machine_t *machine, const u8 *registers, u8 program_counter, u8 status_register, u16 instruction_register) {
+	
+	u8 r = 0;
+	
+	for(; r < 16; r++)
+		if(REG(machine, r) != registers[r])
+			MARK_REGISTER(machine, r);
+			
+	MARK_STATE(machine, (machine->program_counter != program_counter) * CHANGED_PC | (machine->status_register != status_register) * CHANGED_SR | (machine->instruction_register != instruction_register) * CHANGED_IR);
+	
+}
+void machine_mark_memory(rr_machine_t *machine, const u8 *memory) {
+	
+	u16 c = 0;
+	
+	if(!memory) {
+		
+		memset(machine->changes.memory, 0xFF, sizeof(machine->changes.memory));
+		return;
+		
+	}
+	
+	for(; c < 256; c++)
+		if(MEM(machine, c) != memory[c])
+			BITMAP_SET(machine->changes.memory, c);
+			
+}
+
 // Load/save machine memory from file
 u8 machine_load(rr_machine_t *machine, const char *memory_filename) {
 	
-	FILE *mem_file = fopen(memory_filename, "r");
+	FILE *mem_file = fopen(memory_filename, "rb");
 	if(!mem_file)
 		return 1;
+		
+	// Anything loaded (even partially) replaces the code the cache was built from
+	memset(machine->decode_cache, 0, sizeof(machine->decode_cache));
+	machine_mark_memory(machine, NULL);
 	
 	if(!fread((char *)machine->memory, sizeof(u8), 256, mem_file)) {
 		
@@ -52,10 +113,10 @@ u8 machine_load(rr_machine_t *machine, const char *memory_filename) {
 }
 u8 machine_save(rr_machine_t *machine, const char *memory_filename) {
 	
-	FILE *mem_file = fopen(memory_filename, "w");
+	FILE *mem_file = fopen(memory_filename, "wb");
 	if(!mem_file)
 		return 1;
-	
+		
 	if(fwrite((char *)machine->memory, sizeof(u8), 256, mem_file) != 256) {
 		
 		fclose(mem_file);
@@ -74,129 +135,89 @@ u8 machine_save(rr_machine_t *machine, const char *memory_filename) {
 void machine_fetch(rr_machine_t *machine) {
 	
 	machine->instruction_register = MEM(machine, machine->program_counter) << 8;
-	machine->instruction_register |= MEM(machine, machine->program_counter + 1);
+	// Wrap around to 0x00 when fetching from 0xFF
+	machine->instruction_register |= MEM(machine, (u8)(machine->program_counter + 1));
+	MARK_STATE(machine, CHANGED_IR);
+	
+}
+
+// Split an instruction into its opcode and operands (shared by decode and the decode cache)
+// The operand layout of each instruction comes from the tables generated out of ISA_INSTRUCTIONS in rr_isa.h
+void machine_decode_instruction(u16 instruction, u8 *operands) {
+	
+	isa_decode(instruction, operands);
 	
 }
+
 void machine_decode(rr_machine_t *machine) {
 	
-	// Clear current operands
-	memset(machine->operands, 0, 4);
+	machine_decode_instruction(machine->instruction_register, machine->operands);
+	
+}
+
+// Fill the decode cache entry for the instruction at the given address
+rr_decoded_t *machine_predecode(rr_machine_t *machine, u8 address) {
 	
-	// Get this instruction number and copy the instruction mnemonic to the machine
-	u8 instr = machine->instruction_register >> 12;
-	//memcpy(machine->instruction_name, instruction_mnemonics[instr], 3);
+	rr_decoded_t *entry = &machine->decode_cache[address];
+	u8 next = MEM(machine, (u8)(address + 2)) >> 4;
+	u8 after = MEM(machine, (u8)(address + 4)) >> 4;
 	
-	// Set operands[0] to the instruction number so we don't need to shift again during execute
-	machine->operands[0] = instr;
+	entry->instruction = (MEM(machine, address) << 8) | MEM(machine, (u8)(address + 1));
+	machine_decode_instruction(entry->instruction, entry->operands);
+	entry->valid = 1;
 	
-	switch(instr) {
+	// Look for a fused sequence starting here, going by the opcodes that follow as they are now
+	switch(entry->operands[0]) {
 		
-		// HLT - 0___
-		// HaLT machine execution
-		case 0x0:
-		// RET - D___
-		// RETurn from subroutine, Mem[++SP] -> PC
-		case 0xD:
-			break;
-		// ADC - 1RST
-		// ADd with Carry, adds S + T + C -> R
-		// Sets carry if the addition exceeds 0xFF, clears otherwise
-		// Sets zero if R = 0, clears otherwise
-		case 0x1:
-		// AND - 2RST
-		// AND registers, S & T -> R
-		// Sets zero if R = 0, clears otherwise
-		case 0x2:
-		// XOR - 3RST
-		// XOR registers, S ^ T -> R
-		// Sets zero if R = 0, clears otherwise
-		case 0x3:
-		// ROT - 4RST
-		// ROTate register, S (<< | >>) T -> R
-		// T[4] controls direction, 0 for left, 1 for right
-		// Sets zero if R = 0, clears otherwise
-		// Carry will be set according to the last bit from S to be rotated out
-		case 0x4:
-			machine->operands[1] = (machine->instruction_register >> 8) & 0xF;
-			machine->operands[2] = (machine->instruction_register >> 4) & 0xF;
-			machine->operands[3] = machine->instruction_register & 0xF;
-			break;
-		// LDI - 5RXX
-		// LoaD Immediate, XX -> R
-		// Sets zero if R = 0, clears otherwise
+		// An ADC followed by a BRA is left to start its own sequence, it may close a counted loop
 		case 0x5:
-		// LDM - 6RMM
-		// LoaD from Memory, Mem[MM] -> R
-		// Sets zero if R = 0, clears otherwise
-		case 0x6:
-		// STO - 8RMM
-		// STOre register, R -> Mem[MM]
-		// Sets zero if R = 0, clears otherwise
-		case 0x8:
-			machine->operands[1] = (machine->instruction_register >> 8) & 0xF;
-			machine->operands[2] = machine->instruction_register & 0xFF;
+			entry->handler = next == 0x1 && after != 0xE ? FUSE_LDI_ADC : 0x5;
 			break;
-		// LDR - 7_RS
-		// LoaD with Register offset, Mem[S] -> R
-		// Sets zero if R = 0, clears otherwise
-		case 0x7:
-		// STR - 9_RS
-		// STore with Register offset, R -> Mem[S]
-		// Sets zero if R = 0, clears otherwise
-		case 0x9:
-			machine->operands[1] = (machine->instruction_register >> 4) & 0xF;
-			machine->operands[2] = machine->instruction_register & 0xF;
+			
+		case 0x1:
+			
+			if(next == 0xE) {
+				
+				rr_counted_loop_t loop;
+				
+				entry->handler = machine_counted_loop(machine, address, &loop) ? FUSE_COUNTED_LOOP : FUSE_ADC_BRA;
+				
+			}
+			else
+				entry->handler = 0x1;
+				
 			break;
-		// PSH - AR__
-		// PuSH register to stack, R -> [SP--]
+			
 		case 0xA:
-		// POP - BR__
-		// POP stack to register, [++SP] -> R
-		// Sets zero if R = 0
-		case 0xB:
-			machine->operands[1] = (machine->instruction_register >> 8) & 0xF;
-			break;
-		// JSR - C_XX
-		// Jump to SubRoutine, PC + 2 -> Mem[SP--], XX -> PC
-		case 0xC:
-			machine->operands[1] = machine->instruction_register & 0xFF;
+			entry->handler = next == 0xA && after == 0xC ? FUSE_PSH_PSH_JSR : 0xA;
 			break;
-		// BRA - EIXX
-		// BRAnch on flag conditions, I ? (XX : PC + 2) -> PC
-		// I consists of two 2-bit fields
-		// 01 -> which flags should be considered
-		// 23 -> the state of considered flags to branch on
-		// ex 1, 1100 -> branch only if both zero and carry are cleared
-		// ex 2, 0111 -> branch only if carry is set, ignore the zero flag (interchangeable with 0101)
-		// If I <= 3, this will be an unconditional jump
-		case 0xE:
-			machine->operands[1] = (machine->instruction_register >> 10) & 0x3;
-			machine->operands[2] = (machine->instruction_register >> 8) & 0x3;
-			machine->operands[3] = machine->instruction_register & 0xFF;
+			
+		case 0xB:
+			entry->handler = next == 0xB && after == 0xD ? FUSE_POP_POP_RET : 0xB;
 			break;
-		// MDF - FI__
-		// MoDify Flag, sets the given status flag to the specified value
-		// I consists of two 2-bit fields
-		// 01 -> which flags (Z, C) should be modified
-		// 23 -> state of the flag to update
-		// e.g., 0111 -> set C to 1, leave Z however it is (interchangeable with 0101)
-		case 0xF:
-			machine->operands[1] = (machine->instruction_register >> 10) & 0x3;
-			machine->operands[2] = (machine->instruction_register >> 8) & 0x3;
+			
+		default:
+			entry->handler = entry->operands[0];
 			break;
-		
+			
 	}
 	
+	return entry;
+	
 }
 void machine_execute(rr_machine_t *machine) {
 	
+	// Every instruction moves the program counter, the cases below mark the rest of what they write
+	MARK_STATE(machine, CHANGED_PC);
+	
 	switch(machine->operands[0]) {
 		
 		// Halt
 		case 0x0:
 			machine->status_register |= 0b1100;
+			MARK_STATE(machine, CHANGED_SR);
 			break;
-		
+			
 		// Add with carry
 		case 0x1:
 			
@@ -207,43 +228,49 @@ void machine_execute(rr_machine_t *machine) {
 				
 				// Update status register - [SS] -> maintain, [Z] -> set when the result is 0, [C] -> set when the result exceeds 255
 				machine->status_register = (machine->status_register & 0b1100) | (((temp & 0xFF) == 0) << 1) | (temp > 0xFF);
+				MARK_REGISTER(machine, machine->operands[1]);
+				MARK_STATE(machine, CHANGED_SR);
 				
 			}
-	
+			
 			break;
 			
 		// AND
 		case 0x2:
 			
 			REG(machine, machine->operands[1]) = REG(machine, machine->operands[2]) & REG(machine, machine->operands[3]);
-		
+			
 			// Update status register - [SS_C] -> maintain, [Z] -> set when the result is 0
 			machine->status_register = (machine->status_register & 0b1101) | ((REG(machine, machine->operands[1]) == 0) << 1);
-		
+			MARK_REGISTER(machine, machine->operands[1]);
+			MARK_STATE(machine, CHANGED_SR);
+			
 			break;
 			
 		// XOR
 		case 0x3:
-		
+			
 			REG(machine, machine->operands[1]) = REG(machine, machine->operands[2]) ^ REG(machine, machine->operands[3]);
-		
+			
 			// Update status register - [SS_C] -> maintain, [Z] -> set when the result is 0
 			machine->status_register = (machine->status_register & 0b1101) | ((REG(machine, machine->operands[1]) == 0) << 1);
-		
+			MARK_REGISTER(machine, machine->operands[1]);
+			MARK_STATE(machine, CHANGED_SR);
+			
 			break;
 			
 		// Rotate register
 		case 0x4:
-		
+			
 			// Early break if this should not rotate at all
 			if((REG(machine, machine->operands[3]) & 0b0111) == 0)
 				break;
-		
+				
 			{
-		
+				
 				u16 temp;
 				u8 shift_count = REG(machine, machine->operands[3]) & 0b0111;
-		
+				
 				// Rotate right
 				if(REG(machine, machine->operands[3]) & 0b1000) {
 					
@@ -255,6 +282,8 @@ void machine_execute(rr_machine_t *machine) {
 					machine->status_register = (machine->status_register & 0b1100) | (!REG(machine, machine->operands[1]) << 1) | ((REG(machine, machine->operands[2]) >> (shift_count - 1)) & 1);
 					
 					REG(machine, machine->operands[1]) = temp & 0xFF;
+					MARK_REGISTER(machine, machine->operands[1]);
+					MARK_STATE(machine, CHANGED_SR);
 					
 				}
 				// Rotate left
@@ -267,116 +296,138 @@ void machine_execute(rr_machine_t *machine) {
 					machine->status_register = (machine->status_register & 0b1100) | (!REG(machine, machine->operands[1]) << 1) | ((REG(machine, machine->operands[2]) >> (8 - shift_count)) & 1);
 					
 					REG(machine, machine->operands[1]) = temp & 0xFF;
-
+					MARK_REGISTER(machine, machine->operands[1]);
+					MARK_STATE(machine, CHANGED_SR);
+					
 				}
 				
 			}
-	
+			
 			break;
 			
 		// Load immediate
 		case 0x5:
-		
+			
 			REG(machine, machine->operands[1]) = machine->operands[2];
 			
 			// Update status register - [SS_C] -> maintain, [Z] -> set when the result is 0
 			machine->status_register = (machine->status_register & 0b1101) | ((REG(machine, machine->operands[1]) == 0) << 1);
-		
+			MARK_REGISTER(machine, machine->operands[1]);
+			MARK_STATE(machine, CHANGED_SR);
+			
 			break;
 			
 		// Load from memory
 		case 0x6:
-		
+			
 			REG(machine, machine->operands[1]) = MEM(machine, machine->operands[2]);
 			
 			// Update status register - [SS_C] -> maintain, [Z] -> set when the result is 0
 			machine->status_register = (machine->status_register & 0b1101) | ((REG(machine, machine->operands[1]) == 0) << 1);
-		
+			MARK_REGISTER(machine, machine->operands[1]);
+			MARK_STATE(machine, CHANGED_SR);
+			
 			break;
-		
+			
 		// Load from memory with register offset
 		case 0x7:
-		
+			
 			REG(machine, machine->operands[1]) = MEM(machine, REG(machine, machine->operands[2]));
-		
+			
 			// Update status register - [SS_C] -> maintain, [Z] -> set when the result is 0
 			machine->status_register = (machine->status_register & 0b1101) | ((REG(machine, machine->operands[1]) == 0) << 1);
-		
+			MARK_REGISTER(machine, machine->operands[1]);
+			MARK_STATE(machine, CHANGED_SR);
+			
 			break;
 			
 		// Store
 		case 0x8:
-		
+			
 			MEM(machine, machine->operands[2]) = REG(machine, machine->operands[1]);
+			INVALIDATE_DECODE(machine, machine->operands[2]);
 			
 			// Update status register - [SS_C] -> maintain, [Z] -> set when the result is 0
 			machine->status_register = (machine->status_register & 0b1101) | ((REG(machine, machine->operands[1]) == 0) << 1);
-		
+			MARK_STATE(machine, CHANGED_SR);
+			
 			break;
 			
 		// Store at register offset
 		case 0x9:
-		
+			
 			MEM(machine, REG(machine, machine->operands[2])) = REG(machine, machine->operands[1]);
+			INVALIDATE_DECODE(machine, REG(machine, machine->operands[2]));
 			
 			// Update status register - [SS_C] -> maintain, [Z] -> set when the result is 0
 			machine->status_register = (machine->status_register & 0b1101) | ((REG(machine, machine->operands[1]) == 0) << 1);
+			MARK_STATE(machine, CHANGED_SR);
 			
 			break;
 			
 		// Push register
 		case 0xA:
-		
+			
+			INVALIDATE_DECODE(machine, STACK_POINTER(machine));
 			MACHINE_PUSH(machine, REG(machine, machine->operands[1]));
+			MARK_REGISTER(machine, 15);
 			
 			break;
 			
 		// Pop to register
 		case 0xB:
-		
+			
 			REG(machine, machine->operands[1]) = MACHINE_POP(machine);
+			MARK_REGISTER(machine, 15);
 			
 			// Update status register - [SS_C] -> maintain, [Z] -> set when the result is 0
 			machine->status_register = (machine->status_register & 0b1101) | ((REG(machine, machine->operands[1]) == 0) << 1);
-		
+			MARK_REGISTER(machine, machine->operands[1]);
+			MARK_STATE(machine, CHANGED_SR);
+			
 			break;
-		
+			
 		// Jump subroutine
 		case 0xC:
-		
+			
+			INVALIDATE_DECODE(machine, STACK_POINTER(machine));
 			MACHINE_PUSH(machine, machine->program_counter + 2);
+			MARK_REGISTER(machine, 15);
 			
 			machine->program_counter = machine->operands[1] - 2;
 			
 			break;
-		
+			
 		// Return from subroutine
 		case 0xD:
-		
+			
 			machine->program_counter = MACHINE_POP(machine);
-		
+			MARK_REGISTER(machine, 15);
+			
 			// Return instead of break so we skip adding to the program counter - this would make it problematic if the user wanted to change or read the value in the stack region
 			return;
-		
+			
 		// Branch on flag conditions
 		case 0xE:
-		
+			
 			// Unconditional jump if I <= 3, since operands[1] will be 0 as 0 & X == 0 always
 			if((machine->operands[1] & ~(machine->status_register ^ machine->operands[2])) == machine->operands[1])
 				machine->program_counter = machine->operands[3] - 2;
-		
+				
 			break;
 			
 		// Modify flags
 		case 0xF:
-		
+			
 			if(machine->operands[1] & 0b0010)
 				machine->status_register = (machine->status_register & 0b1101) | (machine->operands[2] & 0b0010);
 			if(machine->operands[1] & 0b0001)
 				machine->status_register = (machine->status_register & 0b1110) | (machine->operands[2] & 0b0001);
-
+				
+			MARK_STATE(machine, CHANGED_SR);
+			
 			break;
-		
+			
 	}
 	
 	machine->program_counter += 2;
@@ -385,32 +436,54 @@ void machine_execute(rr_machine_t *machine) {
 
 u8 machine_step(rr_machine_t *machine, u8 part_step) {
 	
+	// A full cycle from the start skips fetch and decode when the instruction has been seen before
+	if(!part_step && CURRENT_STATE(machine) == 0b00) {
+		
+		rr_decoded_t *entry = &machine->decode_cache[machine->program_counter];
+		
+		if(!entry->valid)
+			entry = machine_predecode(machine, machine->program_counter);
+			
+		machine->instruction_register = entry->instruction;
+		memcpy(machine->operands, entry->operands, 4);
+		MARK_STATE(machine, CHANGED_IR);
+		
+		// The state bits stay at fetch throughout, execute only ever sets them to halt
+		machine_execute(machine);
+		
+		return CURRENT_STATE(machine);
+		
+	}
+	
 	u8 loop_count = part_step ? 1 : (3 - CURRENT_STATE(machine));
 	
 	while(loop_count--)
 		switch(CURRENT_STATE(machine)) {
-		
+			
 			case 0b00:
 				machine_fetch(machine);
 				machine->status_register |= 0b0100;
+				MARK_STATE(machine, CHANGED_SR);
 				break;
 				
 			case 0b01:
 				machine_decode(machine);
 				machine->status_register += 0b0100;
+				MARK_STATE(machine, CHANGED_SR);
 				break;
-			
+				
 			case 0b10:
 				machine_execute(machine);
 				if(CURRENT_STATE(machine) != 3)
 				machine->status_register &= 0b0011;
+				MARK_STATE(machine, CHANGED_SR);
 				break;
-			
+				
 			case 0b11:
 				// Halt
 				break;
 		}
-	
+		
 	return CURRENT_STATE(machine);
 	
 }
@@ -423,7 +496,7 @@ s32 msleep(u64 duration) {
 	
 	if(duration == 0)
 		return 0;
-	
+		
 	ts.tv_sec = duration / 1000;
 	ts.tv_nsec = (duration % 1000) * 1000000;
 	
@@ -439,13 +512,59 @@ s32 msleep(u64 duration) {
 // Run the entire program (up to a HALT) in parts or full cycles with an optional delay between each part/cycle
 u8 machine_run(rr_machine_t *machine, u8 part_step, u64 delay) {
 	
-	while(machine_step(machine, part_step) < 0b11)
-#if defined(_WIN32)
-		Sleep(delay);
-#elif defined(__unix__)
-		msleep(delay);
-#endif
+	// Nothing to wait on between cycles, hand the whole run to the threaded interpreter
+	if(!part_step && !delay) {
+		
+		machine_run_fast(machine, 0);
+		
+		return 0;
+		
+	}
+	
+	// Deadlines are kept from the start of the run, so time spent stepping doesn't stretch the delay
+	if(delay)
+		machine_run_paced(machine, part_step, 1000.0 / delay, 0, NULL);
+	else
+		while(machine_step(machine, part_step) < 0b11);
+		
+	return 0;
+	
+}
 
+void conditions_clear(rr_conditions_t *conditions) {
+	
+	memset(conditions, 0, sizeof(rr_conditions_t));
+	
+}
+
+u8 conditions_add(rr_conditions_t *conditions, u8 kind, u8 index, u8 value) {
+	
+	if(conditions->count == STOP_MAX_CONDITIONS)
+		return 1;
+		
+	if(kind > STOP_STACK_DEPTH_ABOVE || (kind == STOP_REGISTER_EQUAL && index > 15))
+		return 2;
+		
+	// Only the first condition at an address can be reported, any others there would stop at the same time anyway
+	if(kind == STOP_PC_EQUAL) {
+		
+		if(!conditions->pc_stops[value])
+			conditions->pc_stops[value] = conditions->count + 1;
+			
+	}
+	else {
+		
+		rr_condition_t *check = &conditions->checks[conditions->check_count++];
+		
+		check->kind = kind;
+		check->index = index;
+		check->value = value;
+		check->number = conditions->count;
+		
+	}
+	
+	conditions->count++;
+	
 	return 0;
 	
 }
\ No newline at end of file
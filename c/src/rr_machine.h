@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 // Redefines datatypes for simplicity, includes inttypes.h
 #include "../../shared/shared_datatypes.h"
@@ -26,6 +27,54 @@
 #define MACHINE_PUSH(m, x) (MEM(m, STACK_POINTER(m)--) = x)
 // m->memory[++(m->registers[15])]
 #define MACHINE_POP(m) (MEM(m, ++STACK_POINTER(m)))
+// Any write to memory at x stales the predecoded entries starting at x and x - 1, and marks the cell changed for machine_collect_changes
+#define INVALIDATE_DECODE(m, x) (m->decode_cache[(u8)(x)].valid = m->decode_cache[(u8)((x) - 1)].valid = 0, BITMAP_SET(m->changes.memory, x))
+// Mark a register, or any of PC/SR/IR (CHANGED_*), as written for machine_collect_changes
+#define MARK_REGISTER(m, x) (m->changes.registers |= 1 << (x))
+#define MARK_STATE(m, x) (m->changes.state |= (x))
+
+// Test/set bit x of a 256 bit bitmap held as 4 u64 words
+#define BITMAP_TEST(b, x) (((b)[(u8)(x) >> 6] >> ((x) & 63)) & 1)
+#define BITMAP_SET(b, x) ((b)[(u8)(x) >> 6] |= 1ULL << ((x) & 63))
+
+// Instruction sequences the threaded interpreter runs as one handler, numbered after the 16 opcodes
+// Each instruction after the first is still fetched from the decode cache and checked, so a branch into the middle of one or a change to its code just runs the instructions separately
+#define FUSE_FIRST 16
+#define FUSE_LDI_ADC 16
+#define FUSE_ADC_BRA 17
+// An ADC/BRA pair closing a counted loop (see machine_counted_loop), which the interpreter fast-forwards to the loop's exit
+#define FUSE_COUNTED_LOOP 18
+#define FUSE_PSH_PSH_JSR 19
+#define FUSE_POP_POP_RET 20
+#define FUSE_COUNT 5
+
+// Predecoded instruction, one for every possible program counter value (odd values included)
+typedef struct rr_decoded_d {
+	// Instruction register contents the entry was decoded from
+	u16 instruction;
+	// Same layout as the machine operands, [0] holds the opcode
+	u8 operands[4];
+	// Cleared whenever either memory cell under the entry is written
+	u8 valid;
+	// Handler the threaded interpreter dispatches to - the opcode, or a FUSE_* number when the instructions after this one make up a fused sequence with it
+	u8 handler;
+} rr_decoded_t;
+
+// Parts of the machine outside the registers and memory, as held in rr_changes_t.state
+#define CHANGED_PC 0b001
+#define CHANGED_SR 0b010
+#define CHANGED_IR 0b100
+#define CHANGED_ALL 0b111
+
+// What has been written since the last machine_collect_changes, so a front end only has to redraw those cells
+// Instructions mark what they write even when the value stays the same, whole-state replacements (loads, snapshots, fast runs) only mark what differs
+typedef struct rr_changes_d {
+	// One bit per memory cell (see BITMAP_TEST) and per register
+	u64 memory[4];
+	u16 registers;
+	// CHANGED_* bits
+	u8 state;
+} rr_changes_t;
 
 typedef struct rr_machine_d {
 	// Decode variables, holds operands
@@ -41,22 +90,202 @@ typedef struct rr_machine_d {
 	u8 registers[16];
 	// 256 bytes for RAM
 	u8 memory[256];
+	// Decode results indexed by program counter, used by full cycle steps
+	// Code writing to memory directly (instead of through machine_poke) must use INVALIDATE_DECODE
+	rr_decoded_t decode_cache[256];
+	// Kept through machine_reset, which marks what it changes instead
+	rr_changes_t changes;
 } rr_machine_t;
 
+// Why a checked run stopped
+#define RUN_HALTED 0
+#define RUN_CYCLE_LIMIT 1
+#define RUN_INFINITE_LOOP 2
+#define RUN_CONDITION 3
+// A reverse run reached the oldest recorded state
+#define RUN_HISTORY_START 4
+#define RUN_BREAKPOINT 5
+#define RUN_WATCHPOINT 6
+
+// Stop condition kinds for machine_run_until
+// Program counter equals value
+#define STOP_PC_EQUAL 0
+// Register index equals value
+#define STOP_REGISTER_EQUAL 1
+// Memory at index equals value
+#define STOP_MEMORY_EQUAL 2
+// Memory at index differs from what it held when the run started
+#define STOP_MEMORY_CHANGED 3
+// More than value elements on the stack
+#define STOP_STACK_DEPTH_ABOVE 4
+
+#define STOP_MAX_CONDITIONS 16
+
+typedef struct rr_condition_d {
+	u8 kind;
+	u8 index;
+	u8 value;
+	// Position in the order conditions were added, reported back in rr_stop_t
+	u8 number;
+} rr_condition_t;
+
+// Conditions are compiled as they are added - program counter conditions go into a table looked up once per cycle, the rest into a short list checked in turn
+// Kinds with nothing added cost nothing while running
+typedef struct rr_conditions_d {
+	// Condition number + 1 for each address with a program counter condition, 0 elsewhere
+	u8 pc_stops[256];
+	u8 check_count;
+	rr_condition_t checks[STOP_MAX_CONDITIONS];
+	u8 count;
+	// Set when a run stops on a condition
+	u8 stopped;
+} rr_conditions_t;
+
+// Filled in by machine_run_until and machine_run_watch
+typedef struct rr_stop_d {
+	// RUN_HALTED, RUN_CYCLE_LIMIT, RUN_CONDITION, RUN_BREAKPOINT or RUN_WATCHPOINT
+	u8 reason;
+	// Number of the condition that held, for RUN_CONDITION
+	u8 condition;
+	u64 cycles;
+} rr_stop_t;
+
+// Watch kinds for machine_run_watch, combinable
+// Stop before running an instruction at the address
+#define WATCH_BREAK 0b001
+// Stop after an instruction reads or writes the memory cell at the address (instruction fetches aren't counted)
+#define WATCH_READ 0b010
+#define WATCH_WRITE 0b100
+
+// One bit per address for each kind, so checking one costs a shift and a mask whatever the number set
+typedef struct rr_watch_d {
+	u64 breaks[4];
+	u64 reads[4];
+	u64 writes[4];
+	// Set when a run stops on one - its kind, the address (the program counter for a breakpoint) and the address of the instruction that made the access
+	u8 stopped;
+	u8 address;
+	u8 pc;
+} rr_watch_t;
+
+// Filled in by machine_run_detect
+typedef struct rr_loop_d {
+	// Cycles run before stopping
+	u64 cycles;
+	// When an infinite loop is found - cycles run before first reaching it, cycles per trip around it, and the address of its first instruction
+	u64 entry_cycle;
+	u64 period;
+	u8 entry_pc;
+} rr_loop_t;
+
+// Filled in by machine_counted_loop
+typedef struct rr_counted_loop_d {
+	// Branch target and the address of the ADC closing the loop (the BRA follows it)
+	u8 head;
+	u8 end;
+	// Instructions from the head up to the ADC
+	u8 body_length;
+	// ADC <counter>, <counter>, <step> - nothing else in the loop writes the counter or reads it
+	u8 counter;
+	u8 step;
+	// Set when the body sets the carry before the ADC, so the same carry goes into it every trip - otherwise each trip's carry out goes into the next
+	u8 fixed_carry;
+} rr_counted_loop_t;
+
 // Create a base machine
 rr_machine_t *machine_new();
 
 u8 machine_reset(rr_machine_t *machine);
 u8 machine_clear_memory(rr_machine_t *machine);
 
+// Write a single memory cell, keeping the decode cache coherent
+u8 machine_poke(rr_machine_t *machine, u8 address, u8 value);
+
+// Return (in changes) and clear everything written since the last call, returns 1 if anything was
+u8 machine_collect_changes(rr_machine_t *machine, rr_changes_t *changes);
+
+// Mark whatever differs between the machine and the state or memory image about to be written over it, for code replacing them wholesale
+// A NULL memory image marks every cell
+void machine_mark_state(rr_machine_t *machine, const u8 *registers, u8 program_counter, u8 status_register, u16 instruction_register);
+void machine_mark_memory(rr_machine_t *machine, const u8 *memory);
+
 // Load/save machine memory from file
 u8 machine_load(rr_machine_t *machine, const char *memory_filename);
 u8 machine_save(rr_machine_t *machine, const char *memory_filename);
 
+// Individual parts of the machine cycle, normally driven through machine_step
+void machine_fetch(rr_machine_t *machine);
+void machine_decode(rr_machine_t *machine);
+void machine_execute(rr_machine_t *machine);
+
+// Split an instruction into its opcode and operands (4 bytes, laid out like rr_machine_t.operands)
+void machine_decode_instruction(u16 instruction, u8 *operands);
+
+// Fill (and return) the decode cache entry for the instruction at the given address
+rr_decoded_t *machine_predecode(rr_machine_t *machine, u8 address);
+
 // Run part or the remainder of a machine cycle
 u8 machine_step(rr_machine_t *machine, u8 part_step);
 
 // Run the entire program (up to a HALT) in parts or full cycles with an optional delay between each part/cycle
 u8 machine_run(rr_machine_t *machine, u8 part_step, u64 delay);
 
+#if defined(__unix__)
+// Sleep for a number of milliseconds, carrying on through interruptions (Sleep does this on Windows)
+s32 msleep(u64 duration);
+#endif
+
+// Empty a set of stop conditions
+void conditions_clear(rr_conditions_t *conditions);
+
+// Add a stop condition (STOP_*), returns 1 when full or 2 for an unknown kind or register
+u8 conditions_add(rr_conditions_t *conditions, u8 kind, u8 index, u8 value);
+
+// For runs driven outside machine_run_until - copy the conditions into active for a run starting from the machine's current state (taking the starting memory for STOP_MEMORY_CHANGED)
+// then check active against each state along the way, returning 1 (with active->stopped set) once any condition holds
+void conditions_begin(rr_conditions_t *active, const rr_conditions_t *conditions, const rr_machine_t *machine);
+u8 conditions_check(rr_conditions_t *active, const rr_machine_t *machine);
+
+// Run full cycles up to a HALT or max_cycles (0 for no limit) with the threaded interpreter, returns the number of cycles run
+// Registers, flags and the program counter live in locals until it stops, so the machine should not be read from elsewhere meanwhile
+u64 machine_run_fast(rr_machine_t *machine, u64 max_cycles);
+
+// Same as machine_run_fast, but also stops before running from a state matching match exactly (program counter, flags, registers and memory)
+// The starting state itself is never matched, only states returned to later
+u64 machine_run_until_state(rr_machine_t *machine, u64 max_cycles, const rr_machine_t *match);
+
+// Run full cycles up to a HALT, max_cycles (0 for no limit) or just before a cycle that would start with any of the conditions holding, returns the reason it stopped
+// Conditions are not checked against the starting state, so running again after a stop moves on; stop (which may be NULL) gets the details
+// With no conditions this costs the same as machine_run_fast
+u8 machine_run_until(rr_machine_t *machine, u64 max_cycles, const rr_conditions_t *conditions, rr_stop_t *stop);
+
+// Empty a set of breakpoints and watchpoints
+void watch_clear(rr_watch_t *watch);
+
+// Add/remove the given kinds (WATCH_*) at an address, returns 1 for unknown kinds
+u8 watch_add(rr_watch_t *watch, u8 kinds, u8 address);
+u8 watch_remove(rr_watch_t *watch, u8 kinds, u8 address);
+
+// Returns the kinds (WATCH_*) with at least one address set
+u8 watch_active(const rr_watch_t *watch);
+
+// Run full cycles up to a HALT, max_cycles (0 for no limit), just before a cycle starting at a breakpoint (RUN_BREAKPOINT) or just after one reading or writing a watched cell (RUN_WATCHPOINT)
+// Runs the threaded interpreter built with only the checks the watch needs - none at all with nothing set, breakpoints only, or breakpoints and memory accesses
+// The starting state is not checked against breakpoints, so running again after a stop moves on; stop (which may be NULL) gets the cycles run and watch the details
+u8 machine_run_watch(rr_machine_t *machine, u64 max_cycles, rr_watch_t *watch, rr_stop_t *stop);
+
+// Run full cycles like machine_run_fast, but also stop with RUN_INFINITE_LOOP once the machine repeats an earlier state exactly
+// The loop's entry and period are written to loop (which may be NULL), the machine is left somewhere inside the loop
+u8 machine_run_detect(rr_machine_t *machine, u64 max_cycles, rr_loop_t *loop);
+
+// Check whether the ADC at address and the BRA after it close a counted loop as memory stands, returns 1 and fills loop when they do
+// That is a BRA back while Z is clear over a body of register-only instructions (memory is only read) that never touches the counter
+// and works out every register it writes from registers the loop doesn't write or ones written earlier in the same trip, so only the counter differs from trip to trip
+u8 machine_counted_loop(const rr_machine_t *machine, u8 address, rr_counted_loop_t *loop);
+
+// With the registers and flags (ZC bits) as they are at the loop's ADC after at least one whole trip through its body, run the loop's remaining trips to its exit
+// without running the body, or as many as fit in max_cycles - then stopping just after a branch back to the head
+// Returns the cycles stepping would have taken (0 if max_cycles is under 2), the counter and flags are left as stepping would leave them, Z set when the loop exited
+u64 counted_loop_run(const rr_counted_loop_t *loop, u8 *registers, u8 *flags, u64 max_cycles);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,376 @@
+#include "rr_machine.h"
+#include "rr_trace.h"
+#include "rr_profile.h"
+#include "rr_observe.h"
+
+// Direct-threaded dispatch needs the labels-as-values extension, fall back to a switch everywhere else
+#if defined(__GNUC__) && !defined(RR_NO_COMPUTED_GOTO)
+#define RR_THREADED 1
+#else
+#define RR_THREADED 0
+#endif
+
+// Flags are kept unpacked and only worked out where they are read, building with RR_EAGER_FLAGS packs them after every instruction instead
+#if defined(RR_EAGER_FLAGS)
+#define RR_LAZY_FLAGS 0
+#else
+#define RR_LAZY_FLAGS 1
+#endif
+
+#define FAST_CHECK_NONE 0
+#define FAST_CHECK_MATCH 1
+#define FAST_CHECK_CONDITIONS 2
+#define FAST_CHECK_TRACE 3
+#define FAST_CHECK_PROFILE 4
+#define FAST_CHECK_BREAK 5
+#define FAST_CHECK_WATCH 6
+#define FAST_CHECK_OBSERVE 7
+
+// Check the stop conditions against the state about to be run, noting which one held
+static inline u8 conditions_met(rr_conditions_t *conditions, u8 pc, const u8 *registers, const u8 *memory) {
+	
+	u8 c = 0;
+	
+	if(conditions->pc_stops[pc]) {
+		
+		conditions->stopped = conditions->pc_stops[pc];
+		return 1;
+		
+	}
+	
+	for(; c < conditions->check_count; c++) {
+		
+		rr_condition_t *check = &conditions->checks[c];
+		u8 met;
+		
+		switch(check->kind) {
+			
+			case STOP_REGISTER_EQUAL:
+				met = registers[check->index] == check->value;
+				break;
+				
+			case STOP_MEMORY_EQUAL:
+				met = memory[check->index] == check->value;
+				break;
+				
+			// The value was replaced with the starting contents by conditions_begin
+			case STOP_MEMORY_CHANGED:
+				met = memory[check->index] != check->value;
+				break;
+				
+			// The stack grows down from 0xFF
+			default:
+				met = 0xFF - registers[15] > check->value;
+				break;
+				
+		}
+		
+		if(met) {
+			
+			conditions->stopped = check->number + 1;
+			return 1;
+			
+		}
+		
+	}
+	
+	return 0;
+	
+}
+
+void conditions_begin(rr_conditions_t *active, const rr_conditions_t *conditions, const rr_machine_t *machine) {
+	
+	u8 c = 0;
+	
+	*active = *conditions;
+	active->stopped = 0;
+	
+	for(; c < active->check_count; c++)
+		if(active->checks[c].kind == STOP_MEMORY_CHANGED)
+			active->checks[c].value = MEM(machine, active->checks[c].index);
+			
+}
+
+u8 conditions_check(rr_conditions_t *active, const rr_machine_t *machine) {
+	
+	return conditions_met(active, machine->program_counter, machine->registers, machine->memory);
+	
+}
+
+void watch_clear(rr_watch_t *watch) {
+	
+	memset(watch, 0, sizeof(rr_watch_t));
+	
+}
+
+u8 watch_add(rr_watch_t *watch, u8 kinds, u8 address) {
+	
+	u64 bit = (u64)1 << (address & 63);
+	
+	if(!kinds || kinds & ~(WATCH_BREAK | WATCH_READ | WATCH_WRITE))
+		return 1;
+		
+	if(kinds & WATCH_BREAK)
+		watch->breaks[address >> 6] |= bit;
+		
+	if(kinds & WATCH_READ)
+		watch->reads[address >> 6] |= bit;
+		
+	if(kinds & WATCH_WRITE)
+		watch->writes[address >> 6] |= bit;
+		
+	return 0;
+	
+}
+
+u8 watch_remove(rr_watch_t *watch, u8 kinds, u8 address) {
+	
+	u64 bit = (u64)1 << (address & 63);
+	
+	if(!kinds || kinds & ~(WATCH_BREAK | WATCH_READ | WATCH_WRITE))
+		return 1;
+		
+	if(kinds & WATCH_BREAK)
+		watch->breaks[address >> 6] &= ~bit;
+		
+	if(kinds & WATCH_READ)
+		watch->reads[address >> 6] &= ~bit;
+		
+	if(kinds & WATCH_WRITE)
+		watch->writes[address >> 6] &= ~bit;
+		
+	return 0;
+	
+}
+
+u8 watch_active(const rr_watch_t *watch) {
+	
+	u8 kinds = 0;
+	
+	if(watch->breaks[0] | watch->breaks[1] | watch->breaks[2] | watch->breaks[3])
+		kinds |= WATCH_BREAK;
+		
+	if(watch->reads[0] | watch->reads[1] | watch->reads[2] | watch->reads[3])
+		kinds |= WATCH_READ;
+		
+	if(watch->writes[0] | watch->writes[1] | watch->writes[2] | watch->writes[3])
+		kinds |= WATCH_WRITE;
+		
+	return kinds;
+	
+}
+
+#define FAST_RUN_NAME run_fast
+#define FAST_CHECK FAST_CHECK_NONE
+#include "rr_fast_loop.h"
+
+#define FAST_RUN_NAME run_fast_match
+#define FAST_CHECK FAST_CHECK_MATCH
+#include "rr_fast_loop.h"
+
+#define FAST_RUN_NAME run_fast_conditions
+#define FAST_CHECK FAST_CHECK_CONDITIONS
+#include "rr_fast_loop.h"
+
+#define FAST_RUN_NAME run_fast_trace
+#define FAST_CHECK FAST_CHECK_TRACE
+#include "rr_fast_loop.h"
+
+#define FAST_RUN_NAME run_fast_profile
+#define FAST_CHECK FAST_CHECK_PROFILE
+#include "rr_fast_loop.h"
+
+#define FAST_RUN_NAME run_fast_break
+#define FAST_CHECK FAST_CHECK_BREAK
+#include "rr_fast_loop.h"
+
+#define FAST_RUN_NAME run_fast_watch
+#define FAST_CHECK FAST_CHECK_WATCH
+#include "rr_fast_loop.h"
+
+#define FAST_RUN_NAME run_fast_observe
+#define FAST_CHECK FAST_CHECK_OBSERVE
+#include "rr_fast_loop.h"
+
+u64 machine_run_fast(rr_machine_t *machine, u64 max_cycles) {
+	
+	return run_fast(machine, max_cycles, NULL, NULL, NULL, NULL, NULL, NULL);
+	
+}
+
+u64 machine_run_until_state(rr_machine_t *machine, u64 max_cycles, const rr_machine_t *match) {
+	
+	return run_fast_match(machine, max_cycles, match, NULL, NULL, NULL, NULL, NULL);
+	
+}
+
+u8 machine_run_until(rr_machine_t *machine, u64 max_cycles, const rr_conditions_t *conditions, rr_stop_t *stop) {
+	
+	rr_stop_t unused;
+	
+	if(!stop)
+		stop = &unused;
+		
+	stop->condition = 0;
+	
+	if(!conditions || !conditions->count)
+		stop->cycles = run_fast(machine, max_cycles, NULL, NULL, NULL, NULL, NULL, NULL);
+	else {
+		
+		rr_conditions_t active;
+		
+		conditions_begin(&active, conditions, machine);
+		
+		stop->cycles = run_fast_conditions(machine, max_cycles, NULL, &active, NULL, NULL, NULL, NULL);
+		
+		if(active.stopped && CURRENT_STATE(machine) != 0b11) {
+			
+			stop->reason = RUN_CONDITION;
+			stop->condition = active.stopped - 1;
+			
+			return stop->reason;
+			
+		}
+		
+	}
+	
+	stop->reason = CURRENT_STATE(machine) == 0b11 ? RUN_HALTED : RUN_CYCLE_LIMIT;
+	
+	return stop->reason;
+	
+}
+
+u64 machine_run_trace(rr_machine_t *machine, u64 max_cycles, rr_trace_t *trace) {
+	
+	u64 cycles = 0;
+	
+	if(CURRENT_STATE(machine) == 0b11)
+		return 0;
+		
+	// The interpreter would finish a cycle left partway through without recording it, so that one is run here
+	if(CURRENT_STATE(machine)) {
+		
+		u8 pc = machine->program_counter;
+		
+		machine_step(machine, 0);
+		cycles++;
+		
+		trace_put_machine(trace, pc, machine);
+		
+		if(CURRENT_STATE(machine) == 0b11 || max_cycles == 1) {
+			
+			trace_publish(trace);
+			return cycles;
+			
+		}
+		
+		if(max_cycles)
+			max_cycles--;
+			
+	}
+	
+	cycles += run_fast_trace(machine, max_cycles, NULL, NULL, trace, NULL, NULL, NULL);
+	trace_publish(trace);
+	
+	return cycles;
+	
+}
+
+u64 machine_run_observe(rr_machine_t *machine, u64 max_cycles, rr_observer_t *observer) {
+	
+	u64 cycles = 0;
+	
+	if(CURRENT_STATE(machine) == 0b11)
+		return 0;
+		
+	// The interpreter would finish a cycle left partway through without sending it, so that one is stepped here
+	if(CURRENT_STATE(machine)) {
+		
+		machine_step_observe(machine, 0, observer);
+		cycles++;
+		
+		if(CURRENT_STATE(machine) == 0b11 || max_cycles == 1) {
+			
+			observer_flush(observer);
+			return cycles;
+			
+		}
+		
+		if(max_cycles)
+			max_cycles--;
+			
+	}
+	
+	observer_begin(observer, machine);
+	cycles += run_fast_observe(machine, max_cycles, NULL, NULL, NULL, NULL, NULL, observer);
+	observer_flush(observer);
+	
+	return cycles;
+	
+}
+
+u64 machine_run_profile(rr_machine_t *machine, u64 max_cycles, rr_profile_t *profile) {
+	
+	u64 cycles = 0;
+	
+	if(CURRENT_STATE(machine) == 0b11)
+		return 0;
+		
+	// The interpreter would finish a cycle left partway through without counting it, so that one is run here
+	if(CURRENT_STATE(machine)) {
+		
+		u8 operands[4];
+		
+		// Fetched already, but maybe not yet decoded
+		machine_decode_instruction(machine->instruction_register, operands);
+		profile_count(profile, machine, operands);
+		
+		machine_step(machine, 0);
+		cycles++;
+		
+		if(CURRENT_STATE(machine) == 0b11 || max_cycles == 1) {
+			
+			profile->cycles += cycles;
+			return cycles;
+			
+		}
+		
+		if(max_cycles)
+			max_cycles--;
+			
+	}
+	
+	cycles += run_fast_profile(machine, max_cycles, NULL, NULL, NULL, profile, NULL, NULL);
+	profile->cycles += cycles;
+	
+	return cycles;
+	
+}
+
+u8 machine_run_watch(rr_machine_t *machine, u64 max_cycles, rr_watch_t *watch, rr_stop_t *stop) {
+	
+	rr_stop_t unused;
+	u8 kinds = watch_active(watch);
+	
+	if(!stop)
+		stop = &unused;
+		
+	stop->condition = 0;
+	watch->stopped = 0;
+	
+	// The cheapest loop that still sees everything set
+	if(kinds & (WATCH_READ | WATCH_WRITE))
+		stop->cycles = run_fast_watch(machine, max_cycles, NULL, NULL, NULL, NULL, watch, NULL);
+	else if(kinds)
+		stop->cycles = run_fast_break(machine, max_cycles, NULL, NULL, NULL, NULL, watch, NULL);
+	else
+		stop->cycles = run_fast(machine, max_cycles, NULL, NULL, NULL, NULL, NULL, NULL);
+		
+	if(watch->stopped)
+		stop->reason = watch->stopped == WATCH_BREAK ? RUN_BREAKPOINT : RUN_WATCHPOINT;
+	else
+		stop->reason = CURRENT_STATE(machine) == 0b11 ? RUN_HALTED : RUN_CYCLE_LIMIT;
+		
+	return stop->reason;
+	
+}
\ No newline at end of file
@@ -0,0 +1,582 @@
+#include "rr_memo.h"
+
+// A call being recorded - the entry is filled in as it runs, cells are tracked in 256 bit maps
+typedef struct memo_recording_d {
+	rr_memo_entry_t entry;
+	u8 read_cells[32];
+	u8 written_cells[32];
+	// Calls made from inside the recorded one and not yet returned from
+	u32 depth;
+} memo_recording_t;
+
+// How a recorded cycle went
+#define MEMO_RECORDING 0
+#define MEMO_RETURNED 1
+#define MEMO_ABANDONED 2
+
+rr_memo_t *memo_new(u32 entry_count) {
+	
+	rr_memo_t *memo = (rr_memo_t *)calloc(1, sizeof(rr_memo_t));
+	u32 bucket_count = 16;
+	
+	if(!memo)
+		return NULL;
+		
+	// At most half the buckets in use keeps the chains short
+	while(bucket_count < entry_count << 1)
+		bucket_count <<= 1;
+		
+	memo->entries = (rr_memo_entry_t *)malloc(entry_count * sizeof(rr_memo_entry_t));
+	memo->buckets = (u32 *)malloc(bucket_count * sizeof(u32));
+	
+	if(!memo->entries || !memo->buckets) {
+		
+		memo_free(memo);
+		return NULL;
+		
+	}
+	
+	memo->capacity = entry_count;
+	memo->bucket_mask = bucket_count - 1;
+	memo_clear(memo);
+	
+	return memo;
+	
+}
+
+void memo_free(rr_memo_t *memo) {
+	
+	if(!memo)
+		return;
+		
+	free(memo->entries);
+	free(memo->buckets);
+	free(memo);
+	
+}
+
+void memo_clear(rr_memo_t *memo) {
+	
+	memset(memo->buckets, 0xFF, (memo->bucket_mask + 1) * sizeof(u32));
+	memset(memo->key_registers, 0, sizeof(memo->key_registers));
+	memset(memo->key_flags, 0, sizeof(memo->key_flags));
+	memset(memo->keyed, 0, sizeof(memo->keyed));
+	memset(memo->uncacheable, 0, sizeof(memo->uncacheable));
+	
+	memo->count = 0;
+	memo->newest = memo->oldest = MEMO_NONE;
+	memo->hits = memo->misses = memo->recorded = memo->abandoned = memo->evictions = memo->cycles_replayed = 0;
+	
+}
+
+// Hash the call target with the registers and flags its calls are keyed on
+static u32 memo_hash(const rr_memo_t *memo, u8 target, const u8 *registers, u8 flags) {
+	
+	u32 hash = 2166136261u ^ target;
+	u16 key = memo->key_registers[target];
+	u8 r = 0;
+	
+	for(; key; key >>= 1, r++)
+		if(key & 1)
+			hash = (hash ^ registers[r]) * 16777619u;
+			
+	return (hash ^ (flags & memo->key_flags[target])) * 16777619u;
+	
+}
+
+static void memo_unlink_bucket(rr_memo_t *memo, u32 index) {
+	
+	u32 *link = &memo->buckets[memo->entries[index].hash & memo->bucket_mask];
+	
+	while(*link != index)
+		link = &memo->entries[*link].next;
+		
+	*link = memo->entries[index].next;
+	
+}
+
+static void memo_link_bucket(rr_memo_t *memo, u32 index) {
+	
+	u32 *head = &memo->buckets[memo->entries[index].hash & memo->bucket_mask];
+	
+	memo->entries[index].next = *head;
+	*head = index;
+	
+}
+
+static void memo_unlink_recent(rr_memo_t *memo, u32 index) {
+	
+	rr_memo_entry_t *entry = &memo->entries[index];
+	
+	if(entry->newer == MEMO_NONE)
+		memo->newest = entry->older;
+	else
+		memo->entries[entry->newer].older = entry->older;
+		
+	if(entry->older == MEMO_NONE)
+		memo->oldest = entry->newer;
+	else
+		memo->entries[entry->older].newer = entry->newer;
+		
+}
+
+static void memo_link_newest(rr_memo_t *memo, u32 index) {
+	
+	rr_memo_entry_t *entry = &memo->entries[index];
+	
+	entry->newer = MEMO_NONE;
+	entry->older = memo->newest;
+	
+	if(memo->newest == MEMO_NONE)
+		memo->oldest = index;
+	else
+		memo->entries[memo->newest].newer = index;
+		
+	memo->newest = index;
+	
+}
+
+// Find a recorded call to the machine's program counter that read the values the machine holds now
+static rr_memo_entry_t *memo_lookup(rr_memo_t *memo, const rr_machine_t *machine) {
+	
+	u8 target = machine->program_counter;
+	u8 flags = machine->status_register & 0b0011;
+	u32 hash = memo_hash(memo, target, machine->registers, flags);
+	u32 index = memo->buckets[hash & memo->bucket_mask];
+	
+	for(; index != MEMO_NONE; index = memo->entries[index].next) {
+		
+		rr_memo_entry_t *entry = &memo->entries[index];
+		u8 c = 0;
+		u8 r = 0;
+		u16 read = entry->read_registers;
+		
+		if(entry->hash != hash || entry->target != target || (flags & entry->read_flags) != entry->flag_values)
+			continue;
+			
+		for(; read; read >>= 1, r++)
+			if((read & 1) && REG(machine, r) != entry->register_values[r])
+				break;
+				
+		if(read)
+			continue;
+			
+		while(c < entry->read_count && MEM(machine, entry->reads[c].address) == entry->reads[c].value)
+			c++;
+			
+		if(c < entry->read_count)
+			continue;
+			
+		memo_unlink_recent(memo, index);
+		memo_link_newest(memo, index);
+		
+		return entry;
+		
+	}
+	
+	return NULL;
+	
+}
+
+// Leave the machine as running the call would have
+static void memo_apply(const rr_memo_entry_t *entry, rr_machine_t *machine) {
+	
+	u16 written = entry->written_registers;
+	u8 r = 0;
+	u8 c = 0;
+	
+	for(; written; written >>= 1, r++)
+		if(written & 1)
+			REG(machine, r) = entry->final_registers[r];
+			
+	machine->changes.registers |= entry->written_registers;
+	
+	for(; c < entry->write_count; c++)
+		machine_poke(machine, entry->writes[c].address, entry->writes[c].value);
+		
+	machine->status_register = (machine->status_register & ~entry->written_flags) | entry->final_flags;
+	machine->program_counter = entry->program_counter;
+	machine->instruction_register = entry->instruction;
+	machine_decode_instruction(entry->instruction, machine->operands);
+	MARK_STATE(machine, CHANGED_ALL);
+	
+}
+
+// Store a finished recording, in place of the least recently used entry once full
+static void memo_insert(rr_memo_t *memo, const rr_memo_entry_t *recorded) {
+	
+	u8 target = recorded->target;
+	u32 index;
+	
+	// Key lookups on what every call to this address has read, so each entry has a value for everything hashed - rehashing the entries already kept when that shrinks
+	if(!memo->keyed[target]) {
+		
+		memo->key_registers[target] = recorded->read_registers;
+		memo->key_flags[target] = recorded->read_flags;
+		memo->keyed[target] = 1;
+		
+	}
+	else if((memo->key_registers[target] & ~recorded->read_registers) || (memo->key_flags[target] & ~recorded->read_flags)) {
+		
+		memo->key_registers[target] &= recorded->read_registers;
+		memo->key_flags[target] &= recorded->read_flags;
+		
+		for(index = memo->newest; index != MEMO_NONE; index = memo->entries[index].older) {
+			
+			rr_memo_entry_t *entry = &memo->entries[index];
+			
+			if(entry->target != target)
+				continue;
+				
+			memo_unlink_bucket(memo, index);
+			entry->hash = memo_hash(memo, target, entry->register_values, entry->flag_values);
+			memo_link_bucket(memo, index);
+			
+		}
+		
+	}
+	
+	if(memo->count < memo->capacity)
+		index = memo->count++;
+	else {
+		
+		index = memo->oldest;
+		memo_unlink_bucket(memo, index);
+		memo_unlink_recent(memo, index);
+		memo->evictions++;
+		
+	}
+	
+	memo->entries[index] = *recorded;
+	memo->entries[index].hash = memo_hash(memo, target, recorded->register_values, recorded->flag_values);
+	memo_link_bucket(memo, index);
+	memo_link_newest(memo, index);
+	memo->recorded++;
+	
+}
+
+// Note a cell read, unless the call wrote it first - returns 1 when there is no room left
+static u8 memo_read_cell(memo_recording_t *recording, u8 address, u8 value) {
+	
+	rr_memo_entry_t *entry = &recording->entry;
+	
+	if((recording->read_cells[address >> 3] | recording->written_cells[address >> 3]) & (1 << (address & 7)))
+		return 0;
+		
+	if(entry->read_count == MEMO_MAX_READS)
+		return 1;
+		
+	recording->read_cells[address >> 3] |= 1 << (address & 7);
+	entry->reads[entry->read_count].address = address;
+	entry->reads[entry->read_count++].value = value;
+	
+	return 0;
+	
+}
+
+// Run one full cycle of the call being recorded, noting everything it reads before writing and everything it writes
+static u8 memo_record_step(memo_recording_t *recording, rr_machine_t *machine) {
+	
+	rr_memo_entry_t *entry = &recording->entry;
+	rr_decoded_t *decoded = &machine->decode_cache[machine->program_counter];
+	const u8 *operands;
+	u8 sp = STACK_POINTER(machine);
+	u16 reads = 0;
+	u16 writes = 0;
+	u8 flag_reads = 0;
+	u8 flag_writes = 0;
+	s16 read_address = -1;
+	s16 write_address = -1;
+	u8 status = MEMO_RECORDING;
+	u8 full;
+	u8 r = 0;
+	
+	if(!decoded->valid)
+		decoded = machine_predecode(machine, machine->program_counter);
+		
+	operands = decoded->operands;
+	
+	// The instruction bytes count as reads, so changed code never matches
+	full = memo_read_cell(recording, machine->program_counter, MEM(machine, machine->program_counter));
+	full |= memo_read_cell(recording, machine->program_counter + 1, MEM(machine, (u8)(machine->program_counter + 1)));
+	
+	switch(operands[0]) {
+		
+		case 0x0:
+			status = MEMO_ABANDONED;
+			break;
+			
+		case 0x1:
+			reads = (1 << operands[2]) | (1 << operands[3]);
+			flag_reads = 0b0001;
+			writes = 1 << operands[1];
+			flag_writes = 0b0011;
+			break;
+			
+		case 0x2:
+		case 0x3:
+			reads = (1 << operands[2]) | (1 << operands[3]);
+			writes = 1 << operands[1];
+			flag_writes = 0b0010;
+			break;
+			
+		// Z comes from the old destination, and a rotation of 0 writes nothing at all
+		case 0x4:
+			reads = (1 << operands[1]) | (1 << operands[2]) | (1 << operands[3]);
+			flag_reads = 0b0001;
+			
+			if(REG(machine, operands[3]) & 0b0111) {
+				
+				writes = 1 << operands[1];
+				flag_writes = 0b0011;
+				
+			}
+			
+			break;
+			
+		case 0x5:
+			writes = 1 << operands[1];
+			flag_writes = 0b0010;
+			break;
+			
+		case 0x6:
+			read_address = operands[2];
+			writes = 1 << operands[1];
+			flag_writes = 0b0010;
+			break;
+			
+		case 0x7:
+			reads = 1 << operands[2];
+			read_address = REG(machine, operands[2]);
+			writes = 1 << operands[1];
+			flag_writes = 0b0010;
+			break;
+			
+		case 0x8:
+			reads = 1 << operands[1];
+			write_address = operands[2];
+			flag_writes = 0b0010;
+			break;
+			
+		case 0x9:
+			reads = (1 << operands[1]) | (1 << operands[2]);
+			write_address = REG(machine, operands[2]);
+			flag_writes = 0b0010;
+			break;
+			
+		case 0xA:
+			reads = (1 << operands[1]) | (1 << 15);
+			write_address = sp;
+			writes = 1 << 15;
+			break;
+			
+		case 0xB:
+			reads = 1 << 15;
+			read_address = (u8)(sp + 1);
+			writes = (1 << operands[1]) | (1 << 15);
+			flag_writes = 0b0010;
+			break;
+			
+		case 0xC:
+			reads = 1 << 15;
+			write_address = sp;
+			writes = 1 << 15;
+			recording->depth++;
+			break;
+			
+		case 0xD:
+			reads = 1 << 15;
+			read_address = (u8)(sp + 1);
+			writes = 1 << 15;
+			
+			if(recording->depth)
+				recording->depth--;
+			else
+				status = MEMO_RETURNED;
+				
+			break;
+			
+		case 0xE:
+			flag_reads = operands[1];
+			break;
+			
+		case 0xF:
+			flag_writes = operands[1];
+			break;
+			
+	}
+	
+	// Only values from before the call count as reads
+	reads &= ~entry->written_registers & ~entry->read_registers;
+	entry->read_registers |= reads;
+	
+	for(; reads; reads >>= 1, r++)
+		if(reads & 1)
+			entry->register_values[r] = REG(machine, r);
+			
+	flag_reads &= ~entry->written_flags & ~entry->read_flags;
+	entry->read_flags |= flag_reads;
+	entry->flag_values |= machine->status_register & flag_reads;
+	
+	if(read_address >= 0)
+		full |= memo_read_cell(recording, read_address, MEM(machine, read_address));
+		
+	if(write_address >= 0 && !(recording->written_cells[write_address >> 3] & (1 << (write_address & 7)))) {
+		
+		if(entry->write_count == MEMO_MAX_WRITES)
+			full = 1;
+		else {
+			
+			recording->written_cells[write_address >> 3] |= 1 << (write_address & 7);
+			entry->writes[entry->write_count++].address = write_address;
+			
+		}
+		
+	}
+	
+	entry->written_registers |= writes;
+	entry->written_flags |= flag_writes;
+	
+	machine_step(machine, 0);
+	
+	if(full || ++entry->cycles > MEMO_MAX_CYCLES)
+		return MEMO_ABANDONED;
+		
+	return status;
+	
+}
+
+// Fill in the final values once the call has returned
+static void memo_record_finish(memo_recording_t *recording, const rr_machine_t *machine) {
+	
+	rr_memo_entry_t *entry = &recording->entry;
+	u8 c = 0;
+	
+	memcpy(entry->final_registers, machine->registers, 16);
+	entry->final_flags = machine->status_register & entry->written_flags;
+	entry->program_counter = machine->program_counter;
+	entry->instruction = machine->instruction_register;
+	
+	for(; c < entry->write_count; c++)
+		entry->writes[c].value = MEM(machine, entry->writes[c].address);
+		
+}
+
+// Stop at every address holding a JSR as memory stands now - set straight into the address table, as there may be more than STOP_MAX_CONDITIONS of them
+static void memo_find_calls(rr_conditions_t *calls, const rr_machine_t *machine) {
+	
+	u16 address = 0;
+	
+	conditions_clear(calls);
+	
+	for(; address < 256; address++)
+		if((MEM(machine, address) >> 4) == 0xC)
+			calls->pc_stops[address] = calls->count = 1;
+			
+}
+
+u64 machine_run_memo(rr_machine_t *machine, u64 max_cycles, rr_memo_t *memo) {
+	
+	rr_conditions_t calls;
+	memo_recording_t recording;
+	u64 cycle_limit = max_cycles ? max_cycles : UINT64_MAX;
+	u64 cycles = 0;
+	
+	if(CURRENT_STATE(machine) == 0b11)
+		return 0;
+		
+	// Finish a cycle that was left partway through so every lookup is at the start of a cycle
+	if(CURRENT_STATE(machine)) {
+		
+		machine_step(machine, 0);
+		cycles++;
+		
+	}
+	
+	while(cycles < cycle_limit && CURRENT_STATE(machine) != 0b11) {
+		
+		rr_decoded_t *decoded = &machine->decode_cache[machine->program_counter];
+		rr_memo_entry_t *entry;
+		u8 status;
+		
+		if(!decoded->valid)
+			decoded = machine_predecode(machine, machine->program_counter);
+			
+		// Run on to the next call with the interpreter
+		if(decoded->operands[0] != 0xC) {
+			
+			rr_stop_t stop;
+			
+			memo_find_calls(&calls, machine);
+			machine_run_until(machine, cycle_limit - cycles, &calls, &stop);
+			cycles += stop.cycles;
+			
+			continue;
+			
+		}
+		
+		machine_step(machine, 0);
+		
+		if(++cycles == cycle_limit)
+			break;
+			
+		entry = memo_lookup(memo, machine);
+		
+		if(entry && entry->cycles <= cycle_limit - cycles) {
+			
+			memo_apply(entry, machine);
+			cycles += entry->cycles;
+			memo->hits++;
+			memo->cycles_replayed += entry->cycles;
+			
+			continue;
+			
+		}
+		
+		memo->misses++;
+		
+		if(memo->uncacheable[machine->program_counter])
+			continue;
+			
+		// The cell lists are filled as they go, so only what comes before them needs clearing
+		memset(&recording.entry, 0, offsetof(rr_memo_entry_t, reads));
+		memset(recording.read_cells, 0, sizeof(recording.read_cells));
+		memset(recording.written_cells, 0, sizeof(recording.written_cells));
+		recording.depth = 0;
+		recording.entry.target = machine->program_counter;
+		
+		do {
+			
+			status = memo_record_step(&recording, machine);
+			cycles++;
+			
+		} while(status == MEMO_RECORDING && cycles < cycle_limit);
+		
+		if(status == MEMO_RETURNED) {
+			
+			memo_record_finish(&recording, machine);
+			memo_insert(memo, &recording.entry);
+			
+		}
+		// Running out of cycles says nothing about the call, only a call that is too large is given up on
+		else if(status == MEMO_ABANDONED) {
+			
+			memo->abandoned++;
+			memo->uncacheable[recording.entry.target] = 1;
+			
+		}
+		
+	}
+	
+	return cycles;
+	
+}
+
+void memo_report(const rr_memo_t *memo, FILE *out) {
+	
+	u64 lookups = memo->hits + memo->misses;
+	
+	fprintf(out, "Memo: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate), %" PRIu64 " cycles replayed\n", memo->hits, memo->misses, lookups ? memo->hits * 100.0 / lookups : 0.0, memo->cycles_replayed);
+	fprintf(out, "  %" PRIu32 "/%" PRIu32 " entries, %" PRIu64 " calls recorded, %" PRIu64 " evicted, %" PRIu64 " too large to keep\n", memo->count, memo->capacity, memo->recorded, memo->evictions, memo->abandoned);
+	
+}
\ No newline at end of file
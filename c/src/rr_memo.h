@@ -0,0 +1,91 @@
+#ifndef RR_MEMO_H
+#define RR_MEMO_H
+
+#include "rr_machine.h"
+
+// Recorded calls kept by default, the least recently used is dropped beyond this
+#define MEMO_DEFAULT_ENTRIES 1024
+// Limits on one recorded call - one reading more cells (its instruction bytes included), writing more or running longer is not kept
+#define MEMO_MAX_READS 128
+#define MEMO_MAX_WRITES 64
+#define MEMO_MAX_CYCLES 65536
+
+// End of a hash chain or the recency list
+#define MEMO_NONE 0xFFFFFFFF
+
+// A memory cell the call read before writing it (and the value it held), or wrote (and the value it left)
+typedef struct rr_memo_cell_d {
+	u8 address;
+	u8 value;
+} rr_memo_cell_t;
+
+// Everything one call did, from the JSR's target up to the RET taking it back out
+// Replaying it is only valid while everything it read before writing still holds the same value - that includes its own instruction bytes
+typedef struct rr_memo_entry_d {
+	// Next entry in the same hash bucket, and neighbours in the recency list
+	u32 next;
+	u32 newer;
+	u32 older;
+	u32 hash;
+	u64 cycles;
+	u8 target;
+	// Registers and flags (ZC bits) read before being written, and the values they held
+	u16 read_registers;
+	u8 read_flags;
+	u8 flag_values;
+	u8 register_values[16];
+	// Registers and flags written, and the values they were left with
+	u16 written_registers;
+	u8 written_flags;
+	u8 final_flags;
+	u8 final_registers[16];
+	// Where the RET went, and the RET itself (left in the instruction register as after any run)
+	u8 program_counter;
+	u16 instruction;
+	u8 read_count;
+	u8 write_count;
+	rr_memo_cell_t reads[MEMO_MAX_READS];
+	rr_memo_cell_t writes[MEMO_MAX_WRITES];
+} rr_memo_entry_t;
+
+typedef struct rr_memo_d {
+	rr_memo_entry_t *entries;
+	u32 capacity;
+	u32 count;
+	// Heads of the hash chains
+	u32 *buckets;
+	u32 bucket_mask;
+	// Most and least recently used entries
+	u32 newest;
+	u32 oldest;
+	// Registers and flags hashed when looking up a call to each address - the ones every call to it recorded so far has read, once keyed is set
+	u16 key_registers[256];
+	u8 key_flags[256];
+	u8 keyed[256];
+	// Set for addresses whose calls were too large to keep, they are not recorded again until memo_clear
+	u8 uncacheable[256];
+	// Added up over runs until memo_clear
+	u64 hits;
+	u64 misses;
+	u64 recorded;
+	u64 abandoned;
+	u64 evictions;
+	u64 cycles_replayed;
+} rr_memo_t;
+
+// Create a memo keeping up to entry_count recorded calls
+rr_memo_t *memo_new(u32 entry_count);
+void memo_free(rr_memo_t *memo);
+
+// Drop every recorded call and reset the stats
+void memo_clear(rr_memo_t *memo);
+
+// Run full cycles up to a HALT or max_cycles (0 for no limit) like machine_run_fast, returning the number of cycles run (replayed calls included)
+// Each JSR's call is looked up by target and the values it would read - a match is applied in one step, otherwise the call is run and recorded for next time
+// Entries only depend on what they read, so one memo can be kept across runs, loads and resets
+u64 machine_run_memo(rr_machine_t *machine, u64 max_cycles, rr_memo_t *memo);
+
+// Print the hit/miss stats
+void memo_report(const rr_memo_t *memo, FILE *out);
+
+#endif
\ No newline at end of file
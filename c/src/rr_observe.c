@@ -0,0 +1,86 @@
+#include "rr_observe.h"
+
+rr_observer_t *observer_new(u32 batch_size, u8 kinds, rr_observe_fn callback, void *context) {
+	
+	rr_observer_t *observer;
+	
+	if(!callback)
+		return NULL;
+		
+	if(!(observer = (rr_observer_t *)calloc(1, sizeof(rr_observer_t))))
+		return NULL;
+		
+	observer->batch_size = batch_size ? batch_size : OBSERVE_DEFAULT_BATCH;
+	
+	if(!(observer->events = (rr_event_t *)malloc((observer->batch_size + OBSERVE_CYCLE_EVENTS) * sizeof(rr_event_t)))) {
+		
+		free(observer);
+		return NULL;
+		
+	}
+	
+	observer->callback = callback;
+	observer->context = context;
+	observer->kinds = kinds & OBSERVE_ALL;
+	
+	return observer;
+	
+}
+
+void observer_free(rr_observer_t *observer) {
+	
+	if(!observer)
+		return;
+		
+	free(observer->events);
+	free(observer);
+	
+}
+
+void observer_flush(rr_observer_t *observer) {
+	
+	if(!observer->count)
+		return;
+		
+	observer->callback(observer->events, observer->count, observer->context);
+	
+	observer->delivered += observer->count;
+	observer->batches++;
+	observer->count = 0;
+	
+}
+
+void observer_begin(rr_observer_t *observer, const rr_machine_t *machine) {
+	
+	observer->flags = machine->status_register & 0b0011;
+	observer->stack_pointer = STACK_POINTER(machine);
+	
+}
+
+u8 machine_step_observe(rr_machine_t *machine, u8 part_step, rr_observer_t *observer) {
+	
+	u8 state = CURRENT_STATE(machine);
+	u8 pc = machine->program_counter;
+	u8 parts;
+	u8 location = 0;
+	u8 kind;
+	
+	if(state == 0b11)
+		return state;
+		
+	// The parts this step runs - just the current one, or the rest of the cycle
+	parts = part_step ? (state == 0b00 ? OBSERVE_FETCH : state == 0b01 ? OBSERVE_DECODE : OBSERVE_EXECUTE) : (state == 0b00 ? OBSERVE_ALL : state == 0b01 ? OBSERVE_DECODE | OBSERVE_EXECUTE : OBSERVE_EXECUTE);
+	
+	observer_begin(observer, machine);
+	machine_step(machine, part_step);
+	
+	kind = parts & OBSERVE_EXECUTE ? trace_written(machine, &location) : TRACE_WRITE_NONE;
+	
+	observe_put(observer, parts, pc, machine->instruction_register, machine->status_register & 0b0011, STACK_POINTER(machine), kind, location, kind == TRACE_WRITE_NONE ? 0 : kind == TRACE_WRITE_REGISTER ? REG(machine, location) : MEM(machine, location));
+	
+	if(CURRENT_STATE(machine) == 0b11)
+		observer_flush(observer);
+		
+	return CURRENT_STATE(machine);
+	
+}
\ No newline at end of file
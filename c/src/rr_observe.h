@@ -0,0 +1,156 @@
+#ifndef RR_OBSERVE_H
+#define RR_OBSERVE_H
+
+#include "rr_machine.h"
+#include "rr_trace.h"
+
+// Event kinds, also used as the mask of kinds an observer wants
+// An instruction fetched from pc (instruction holds it)
+#define OBSERVE_FETCH 0b000001
+// The same instruction decoded, location holds its opcode (isa_mnemonics[location] names it)
+#define OBSERVE_DECODE 0b000010
+// A register (location, 15 for the stack pointer) or memory cell (location) written with value
+#define OBSERVE_REGISTER 0b000100
+#define OBSERVE_MEMORY 0b001000
+// Z/C changed, location holds the old flags and value the new ones (ZC bits)
+#define OBSERVE_FLAGS 0b010000
+// The machine halted on the HLT at pc
+#define OBSERVE_HALT 0b100000
+#define OBSERVE_ALL 0b111111
+// What executing an instruction can send, as opposed to fetching and decoding it
+#define OBSERVE_EXECUTE (OBSERVE_REGISTER | OBSERVE_MEMORY | OBSERVE_FLAGS | OBSERVE_HALT)
+
+// Most events one cycle can send - fetch, decode, a register or memory write, the stack pointer, flags and halt
+#define OBSERVE_CYCLE_EVENTS 6
+
+// Batch size when observer_new is given 0
+#define OBSERVE_DEFAULT_BATCH 4096
+
+// One event, in the order the machine produced them
+typedef struct rr_event_d {
+	u8 kind;
+	// Address of the instruction the event came from
+	u8 pc;
+	u8 location;
+	u8 value;
+	u16 instruction;
+} rr_event_t;
+
+// Receives each full batch, and whatever is left when a run stops - the events are only valid until it returns
+typedef void (*rr_observe_fn)(const rr_event_t *events, u32 count, void *context);
+
+// Events are appended to a buffer allocated up front and handed over a batch at a time, so observing a cycle costs a few stores rather than a call
+typedef struct rr_observer_d {
+	rr_observe_fn callback;
+	void *context;
+	// OBSERVE_* kinds sent to the callback, the rest are never recorded
+	u8 kinds;
+	// Room for a batch plus one more cycle's events, so a cycle never has to check for room partway through
+	rr_event_t *events;
+	u32 count;
+	u32 batch_size;
+	// Flags and stack pointer after the last cycle observed, to tell when they change
+	u8 flags;
+	u8 stack_pointer;
+	// Totals over the observer's life
+	u64 delivered;
+	u64 batches;
+} rr_observer_t;
+
+// Create an observer sending the given kinds (OBSERVE_*) to callback batch_size events at a time (OBSERVE_DEFAULT_BATCH for 0), returns NULL on failure
+rr_observer_t *observer_new(u32 batch_size, u8 kinds, rr_observe_fn callback, void *context);
+void observer_free(rr_observer_t *observer);
+
+// Hand whatever is buffered to the callback now
+void observer_flush(rr_observer_t *observer);
+
+// Start observing from the machine's current flags and stack pointer (the observing runs and steps do this themselves)
+void observer_begin(rr_observer_t *observer, const rr_machine_t *machine);
+
+// Record the parts (OBSERVE_FETCH, OBSERVE_DECODE and/or OBSERVE_EXECUTE) of the cycle run from pc - the flags and stack pointer it left behind and what it wrote, as for trace_put
+// Hands the batch over once it is full, at the end of the cycle
+static inline void observe_put(rr_observer_t *observer, u8 parts, u8 pc, u16 instruction, u8 flags, u8 stack_pointer, u8 kind, u8 location, u8 value) {
+	
+	// Built up in a local and stored in one go, as in trace_put
+	rr_event_t event;
+	rr_event_t *events = observer->events + observer->count;
+	u8 wanted = observer->kinds & parts;
+	u8 n = 0;
+	
+	event.pc = pc;
+	event.instruction = instruction;
+	
+	if(wanted & OBSERVE_FETCH) {
+		
+		event.kind = OBSERVE_FETCH;
+		event.location = event.value = 0;
+		events[n++] = event;
+		
+	}
+	
+	if(wanted & OBSERVE_DECODE) {
+		
+		event.kind = OBSERVE_DECODE;
+		event.location = instruction >> 12;
+		event.value = 0;
+		events[n++] = event;
+		
+	}
+	
+	if(parts & OBSERVE_EXECUTE) {
+		
+		if(kind != TRACE_WRITE_NONE && wanted & (kind == TRACE_WRITE_REGISTER ? OBSERVE_REGISTER : OBSERVE_MEMORY)) {
+			
+			event.kind = kind == TRACE_WRITE_REGISTER ? OBSERVE_REGISTER : OBSERVE_MEMORY;
+			event.location = location;
+			event.value = value;
+			events[n++] = event;
+			
+		}
+		
+		// Pushes, pops, calls and returns move the stack pointer besides what they write
+		if(stack_pointer != observer->stack_pointer && !(kind == TRACE_WRITE_REGISTER && location == 15) && wanted & OBSERVE_REGISTER) {
+			
+			event.kind = OBSERVE_REGISTER;
+			event.location = 15;
+			event.value = stack_pointer;
+			events[n++] = event;
+			
+		}
+		
+		if(flags != observer->flags && wanted & OBSERVE_FLAGS) {
+			
+			event.kind = OBSERVE_FLAGS;
+			event.location = observer->flags;
+			event.value = flags;
+			events[n++] = event;
+			
+		}
+		
+		if(!(instruction >> 12) && wanted & OBSERVE_HALT) {
+			
+			event.kind = OBSERVE_HALT;
+			event.location = event.value = 0;
+			events[n++] = event;
+			
+		}
+		
+		observer->flags = flags;
+		observer->stack_pointer = stack_pointer;
+		
+	}
+	
+	if((observer->count += n) >= observer->batch_size)
+		observer_flush(observer);
+		
+}
+
+// Run full cycles like machine_run_fast, sending every one of them to the observer as events and flushing what is left when it stops
+// Observing is compiled into its own copy of the threaded interpreter, the other runs are unaffected by it
+u64 machine_run_observe(rr_machine_t *machine, u64 max_cycles, rr_observer_t *observer);
+
+// Run part or the remainder of a machine cycle like machine_step, sending the parts run to the observer
+// Events wait for a full batch as in a run, except a halt, which flushes them straight away
+u8 machine_step_observe(rr_machine_t *machine, u8 part_step, rr_observer_t *observer);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include <math.h>
+#include "rr_pace.h"
+
+// Monotonic time in nanoseconds
+static u64 pace_now() {
+	
+#if defined(_WIN32)
+	LARGE_INTEGER counter, frequency;
+	
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	
+	return (u64)((f64)counter.QuadPart * 1e9 / frequency.QuadPart);
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+	
+}
+
+// Sleep until the monotonic clock reaches deadline
+#if defined(_WIN32)
+static void pace_sleep_until(HANDLE timer, u64 deadline) {
+	
+	u64 now = pace_now();
+	LARGE_INTEGER due;
+	
+	if(now >= deadline)
+		return;
+		
+	// Negative due times are relative, in 100ns units - the wait still ends on the absolute deadline it was worked out from
+	due.QuadPart = -(LONGLONG)((deadline - now) / 100);
+	
+	if(SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+		WaitForSingleObject(timer, INFINITE);
+		
+}
+#else
+static void pace_sleep_until(u64 deadline) {
+	
+	struct timespec ts;
+	
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+	
+	// An interrupted sleep just sleeps again towards the same deadline
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+	
+}
+#endif
+
+// Full cycles go through the interpreter a batch at a time, parts are stepped one by one
+static u64 pace_batch(rr_machine_t *machine, u8 part_step, u64 steps, void *context) {
+	
+	u64 done = 0;
+	
+	if(!part_step)
+		return machine_run_fast(machine, steps);
+		
+	while(done < steps) {
+		
+		done++;
+		
+		if(machine_step(machine, 1) == 0b11)
+			break;
+			
+	}
+	
+	return done;
+	
+}
+
+u8 machine_run_paced(rr_machine_t *machine, u8 part_step, f64 hz, u64 max_steps, rr_pace_t *pace) {
+	
+	return machine_run_paced_by(machine, part_step, hz, max_steps, pace_batch, NULL, pace);
+	
+}
+
+u8 machine_run_paced_by(rr_machine_t *machine, u8 part_step, f64 hz, u64 max_steps, rr_pace_fn run, void *context, rr_pace_t *pace) {
+	
+	rr_pace_t unused;
+	u64 step_limit = max_steps ? max_steps : UINT64_MAX;
+	u64 start;
+	f64 batch_steps;
+#if defined(_WIN32)
+	HANDLE timer;
+#endif
+	
+	if(!pace)
+		pace = &unused;
+		
+	memset(pace, 0, sizeof(rr_pace_t));
+	pace->target_hz = hz;
+	
+	// Written this way round to turn NaN away too
+	if(!(hz > 0))
+		return CURRENT_STATE(machine);
+		
+	// Enough steps per wakeup to keep the interval between them at least PACE_MIN_INTERVAL_NS, held to what a u32 takes for huge rates
+	batch_steps = ceil(hz * PACE_MIN_INTERVAL_NS / 1e9);
+	pace->batch = batch_steps < UINT32_MAX ? (u32)batch_steps : UINT32_MAX;
+	
+#if defined(_WIN32)
+	timer = CreateWaitableTimer(NULL, TRUE, NULL);
+#endif
+	
+	start = pace_now();
+	
+	while(CURRENT_STATE(machine) != 0b11 && pace->steps < step_limit) {
+		
+		u64 batch = pace->batch;
+		u64 done;
+		u64 deadline;
+		u64 now;
+		f64 offset;
+		f64 lateness;
+		
+		if(batch > step_limit - pace->steps)
+			batch = step_limit - pace->steps;
+			
+		pace->steps += done = run(machine, part_step, batch, context);
+		
+		// The last batch waits out its time too, so the run takes as long as its steps should
+		// Worked out from the start each time, so rounding never accumulates
+		// Tiny rates put it further off than a u64 reaches, which is as good as never
+		offset = pace->steps * 1e9 / hz;
+		deadline = offset < (f64)(UINT64_MAX - start) ? start + (u64)offset : UINT64_MAX;
+		
+		if(pace_now() > deadline)
+			pace->overruns++;
+		else
+#if defined(_WIN32)
+			pace_sleep_until(timer, deadline);
+#else
+			pace_sleep_until(deadline);
+#endif
+			
+		now = pace_now();
+		lateness = now > deadline ? (f64)(now - deadline) : 0;
+		
+		pace->wakeups++;
+		pace->lateness_total += lateness;
+		pace->lateness_squares += lateness * lateness;
+		
+		if(lateness > pace->lateness_max)
+			pace->lateness_max = lateness;
+			
+		// Stopped short of the batch by the batch function
+		if(done < batch)
+			break;
+			
+	}
+	
+	pace->seconds = (pace_now() - start) / 1e9;
+	
+#if defined(_WIN32)
+	if(timer)
+		CloseHandle(timer);
+#endif
+		
+	return CURRENT_STATE(machine);
+	
+}
+
+void pace_report(const rr_pace_t *pace, FILE *out) {
+	
+	f64 achieved = pace->seconds > 0 ? pace->steps / pace->seconds : 0;
+	f64 mean = pace->wakeups ? pace->lateness_total / pace->wakeups : 0;
+	f64 variance = pace->wakeups ? pace->lateness_squares / pace->wakeups - mean * mean : 0;
+	
+	fprintf(out, "Ran %" PRIu64 " steps in %.3f s: %.2f Hz achieved of %.2f Hz targeted (%+.3f%%)\n", pace->steps, pace->seconds, achieved, pace->target_hz, pace->target_hz > 0 ? (achieved / pace->target_hz - 1) * 100 : 0.0);
+	fprintf(out, "  %" PRIu64 " wakeups of %" PRIu32 " steps, %" PRIu64 " overruns, wakeup lateness %.1f us mean, %.1f us deviation, %.1f us max\n", pace->wakeups, pace->batch, pace->overruns, mean / 1000, variance > 0 ? sqrt(variance) / 1000 : 0.0, pace->lateness_max / 1000);
+	
+}
\ No newline at end of file
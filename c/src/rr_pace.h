@@ -0,0 +1,41 @@
+#ifndef RR_PACE_H
+#define RR_PACE_H
+
+#include "rr_machine.h"
+
+// Shortest time slept between batches of steps - faster rates run several steps per wakeup instead of asking timers for intervals they can't keep
+#define PACE_MIN_INTERVAL_NS 1000000
+// Fastest rate the command-line interface takes, well past what the interpreter steps at
+#define PACE_MAX_HZ 1e10
+
+// Filled in by machine_run_paced
+typedef struct rr_pace_d {
+	f64 target_hz;
+	// Steps run at each wakeup
+	u32 batch;
+	u64 steps;
+	u64 wakeups;
+	// Wakeups where the deadline had already passed before sleeping (the host couldn't keep up)
+	u64 overruns;
+	f64 seconds;
+	// How long after its deadline each wakeup came, in nanoseconds
+	f64 lateness_total;
+	f64 lateness_squares;
+	f64 lateness_max;
+} rr_pace_t;
+
+// Runs a batch of up to steps parts (part_step set) or full cycles for machine_run_paced_by, returning the steps run - fewer ends the run, as a HALT does
+typedef u64 (*rr_pace_fn)(rr_machine_t *machine, u8 part_step, u64 steps, void *context);
+
+// Run parts (part_step set) or full cycles at hz steps per second until a HALT or max_steps (0 for no limit), returns the machine state as machine_step does
+// Every wakeup has an absolute deadline worked out from the start time and the steps run so far, so late wakeups don't add up to drift
+// pace (which may be NULL) gets the achieved rate and how late wakeups came
+u8 machine_run_paced(rr_machine_t *machine, u8 part_step, f64 hz, u64 max_steps, rr_pace_t *pace);
+
+// Same as machine_run_paced, with each batch run by run (called with context) - to record the steps as they go, say
+u8 machine_run_paced_by(rr_machine_t *machine, u8 part_step, f64 hz, u64 max_steps, rr_pace_fn run, void *context, rr_pace_t *pace);
+
+// Print the target and achieved rates and the wakeup jitter
+void pace_report(const rr_pace_t *pace, FILE *out);
+
+#endif
\ No newline at end of file
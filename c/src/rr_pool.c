@@ -0,0 +1,273 @@
+#include "rr_pool.h"
+
+#if defined(__unix__)
+#include <sys/mman.h>
+#endif
+
+// Huge page size assumed when rounding up mappings for them
+#define POOL_HUGE_PAGE_SIZE (2 << 20)
+
+static void *pool_aligned_alloc(u64 size) {
+	
+#if defined(_WIN32)
+	return _aligned_malloc(size, POOL_ALIGNMENT);
+#else
+	void *memory;
+	
+	return posix_memalign(&memory, POOL_ALIGNMENT, size) ? NULL : memory;
+#endif
+	
+}
+
+static void pool_aligned_free(void *memory) {
+	
+#if defined(_WIN32)
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+	
+}
+
+// Try for huge pages, leaving slab->slots NULL when the host has none to give
+static void pool_map_huge(rr_pool_t *pool, rr_pool_slab_t *slab, u64 size) {
+	
+#if defined(_WIN32)
+	SIZE_T page = GetLargePageMinimum();
+	
+	if(!page)
+		return;
+		
+	// Needs the lock pages privilege, without it this fails and the slab comes from the heap
+	slab->mapped_size = (size + page - 1) & ~(u64)(page - 1);
+	
+	if((slab->slots = (u8 *)VirtualAlloc(NULL, slab->mapped_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE)))
+		pool->stats.huge_slabs++;
+	else
+		slab->mapped_size = 0;
+#elif defined(__unix__)
+	void *memory = MAP_FAILED;
+	
+	slab->mapped_size = (size + POOL_HUGE_PAGE_SIZE - 1) & ~(u64)(POOL_HUGE_PAGE_SIZE - 1);
+	
+#if defined(MAP_HUGETLB)
+	// Reserved huge pages first, then transparent ones
+	if((memory = mmap(NULL, slab->mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) != MAP_FAILED)
+		pool->stats.huge_slabs++;
+#endif
+	
+	if(memory == MAP_FAILED) {
+		
+		if((memory = mmap(NULL, slab->mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+			
+			slab->mapped_size = 0;
+			return;
+			
+		}
+		
+#if defined(MADV_HUGEPAGE)
+		madvise(memory, slab->mapped_size, MADV_HUGEPAGE);
+#endif
+	
+	}
+	
+	slab->slots = (u8 *)memory;
+#endif
+	
+}
+
+static void pool_slab_free(rr_pool_slab_t *slab) {
+	
+	if(!slab->mapped_size)
+		pool_aligned_free(slab->slots);
+#if defined(_WIN32)
+	else
+		VirtualFree(slab->slots, 0, MEM_RELEASE);
+#elif defined(__unix__)
+	else
+		munmap(slab->slots, slab->mapped_size);
+#endif
+	
+	free(slab);
+	
+}
+
+// Add a slab of slot_count machines after the last, growing the free list so releases never have to allocate
+static rr_pool_slab_t *pool_add_slab(rr_pool_t *pool, u32 slot_count) {
+	
+	rr_pool_slab_t *slab = (rr_pool_slab_t *)calloc(1, sizeof(rr_pool_slab_t));
+	rr_pool_slab_t **last = &pool->slabs;
+	rr_machine_t **free_list;
+	u64 size = (u64)slot_count * POOL_SLOT_SIZE;
+	
+	if(!slab)
+		return NULL;
+		
+	pool->stats.allocations++;
+	
+	if(pool->flags & POOL_HUGE_PAGES)
+		pool_map_huge(pool, slab, size);
+		
+	if(!slab->slots && !(slab->slots = (u8 *)pool_aligned_alloc(size))) {
+		
+		free(slab);
+		return NULL;
+		
+	}
+	
+	pool->stats.allocations++;
+	slab->slot_count = slot_count;
+	
+	if(!(free_list = (rr_machine_t **)realloc(pool->free_list, (pool->stats.capacity + slot_count) * sizeof(rr_machine_t *)))) {
+		
+		pool_slab_free(slab);
+		return NULL;
+		
+	}
+	
+	pool->stats.allocations++;
+	pool->free_list = free_list;
+	pool->stats.capacity += slot_count;
+	
+	while(*last)
+		last = &(*last)->next;
+		
+	*last = slab;
+	
+	return slab;
+	
+}
+
+rr_pool_t *pool_new(u32 machine_count, u8 flags) {
+	
+	rr_pool_t *pool = (rr_pool_t *)calloc(1, sizeof(rr_pool_t));
+	
+	if(!pool)
+		return NULL;
+		
+	pool->grow_count = machine_count ? machine_count : POOL_DEFAULT_MACHINES;
+	pool->flags = flags;
+	
+	if(!(pool->template = (rr_machine_t *)pool_aligned_alloc(POOL_SLOT_SIZE))) {
+		
+		pool_free(pool);
+		return NULL;
+		
+	}
+	
+	// The pool itself and its template
+	pool->stats.allocations = 2;
+	
+	// Same state as machine_new
+	memset(pool->template, 0, sizeof(rr_machine_t));
+	STACK_POINTER(pool->template) = 0xFF;
+	
+	if(!(pool->current = pool_add_slab(pool, pool->grow_count))) {
+		
+		pool_free(pool);
+		return NULL;
+		
+	}
+	
+	return pool;
+	
+}
+
+void pool_free(rr_pool_t *pool) {
+	
+	if(!pool)
+		return;
+		
+	while(pool->slabs) {
+		
+		rr_pool_slab_t *next = pool->slabs->next;
+		
+		pool_slab_free(pool->slabs);
+		pool->slabs = next;
+		
+	}
+	
+	pool_aligned_free(pool->template);
+	free(pool->free_list);
+	free(pool);
+	
+}
+
+rr_machine_t *pool_acquire(rr_pool_t *pool) {
+	
+	rr_machine_t *machine;
+	
+	if(pool->free_count)
+		machine = pool->free_list[--pool->free_count];
+	else {
+		
+		// Move on to the next slab, added now if this is the last
+		if(pool->slab_used == pool->current->slot_count) {
+			
+			rr_pool_slab_t *next = pool->current->next ? pool->current->next : pool_add_slab(pool, pool->grow_count);
+			
+			if(!next)
+				return NULL;
+				
+			pool->current = next;
+			pool->slab_used = 0;
+			
+		}
+		
+		machine = (rr_machine_t *)(pool->current->slots + (u64)pool->slab_used++ * POOL_SLOT_SIZE);
+		
+	}
+	
+	memcpy(machine, pool->template, sizeof(rr_machine_t));
+	
+	pool->stats.acquires++;
+	
+	if(++pool->stats.in_use > pool->stats.peak_in_use)
+		pool->stats.peak_in_use = pool->stats.in_use;
+		
+	return machine;
+	
+}
+
+void pool_release(rr_pool_t *pool, rr_machine_t *machine) {
+	
+	if(!machine)
+		return;
+		
+	pool->free_list[pool->free_count++] = machine;
+	pool->stats.releases++;
+	pool->stats.in_use--;
+	
+}
+
+void pool_release_all(rr_pool_t *pool) {
+	
+	pool->current = pool->slabs;
+	pool->slab_used = 0;
+	pool->free_count = 0;
+	pool->stats.releases += pool->stats.in_use;
+	pool->stats.in_use = 0;
+	
+}
+
+void pool_set_template(rr_pool_t *pool, const rr_machine_t *machine) {
+	
+	memcpy(pool->template, machine, sizeof(rr_machine_t));
+	
+}
+
+void pool_reset(rr_pool_t *pool, rr_machine_t *machine) {
+	
+	memcpy(machine, pool->template, sizeof(rr_machine_t));
+	pool->stats.resets++;
+	
+}
+
+void pool_report(const rr_pool_t *pool, FILE *out) {
+	
+	const rr_pool_stats_t *stats = &pool->stats;
+	
+	fprintf(out, "Pool: %u machines (%u in use, peak %u), %u byte slots, %u huge page slabs\n", stats->capacity, stats->in_use, stats->peak_in_use, (u32)POOL_SLOT_SIZE, stats->huge_slabs);
+	fprintf(out, "  %" PRIu64 " acquires, %" PRIu64 " releases, %" PRIu64 " resets, %" PRIu64 " host allocations\n", stats->acquires, stats->releases, stats->resets, stats->allocations);
+	
+}
\ No newline at end of file
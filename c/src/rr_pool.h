@@ -0,0 +1,80 @@
+#ifndef RR_POOL_H
+#define RR_POOL_H
+
+#include "rr_machine.h"
+
+// Machines start on cache line boundaries and are padded out to a whole number of lines, so no two share one
+#define POOL_ALIGNMENT 64
+#define POOL_SLOT_SIZE ((sizeof(rr_machine_t) + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1))
+
+// Machines per slab when pool_new is given 0
+#define POOL_DEFAULT_MACHINES 64
+
+// Flags for pool_new
+// Back slabs with huge pages where the host has them to give (falling back to normal pages)
+#define POOL_HUGE_PAGES 0b01
+
+// Running counts, so a steady state can be checked for host allocations
+typedef struct rr_pool_stats_d {
+	// Host allocations made - slabs and the free list growing
+	u64 allocations;
+	u64 acquires;
+	u64 releases;
+	u64 resets;
+	u32 in_use;
+	u32 peak_in_use;
+	u32 capacity;
+	// Slabs that got huge pages
+	u32 huge_slabs;
+} rr_pool_stats_t;
+
+// A run of machine slots from one host allocation
+typedef struct rr_pool_slab_d {
+	struct rr_pool_slab_d *next;
+	u8 *slots;
+	u32 slot_count;
+	// Bytes mapped, when the slab came from mmap/VirtualAlloc instead of the aligned allocator
+	u64 mapped_size;
+} rr_pool_slab_t;
+
+// Hands out machines released back first, then the next unused slot, adding a slab once every slot is in use
+// Not safe to share between threads - give each thread its own pool
+typedef struct rr_pool_d {
+	// Slabs in the order they were added, and the one slots are being handed out from
+	rr_pool_slab_t *slabs;
+	rr_pool_slab_t *current;
+	// Slots handed out from the current slab, anything past it (and every slab after it) is unused
+	u32 slab_used;
+	// Machines given back since the last pool_release_all, with room for every machine in the pool
+	rr_machine_t **free_list;
+	u32 free_count;
+	// Machines in slabs added after the first
+	u32 grow_count;
+	u8 flags;
+	// State every machine is handed out in and reset to, a blank machine until pool_set_template
+	rr_machine_t *template;
+	rr_pool_stats_t stats;
+} rr_pool_t;
+
+// Create a pool with room for machine_count machines up front (and as many more for each slab added later), flags are POOL_*
+// Returns NULL if the first slab can't be allocated
+rr_pool_t *pool_new(u32 machine_count, u8 flags);
+// Release every slab at once, machines handed out from the pool go with them
+void pool_free(rr_pool_t *pool);
+
+// Hand out a machine in the template's state, returns NULL if a slab can't be added
+rr_machine_t *pool_acquire(rr_pool_t *pool);
+// Give a machine back for reuse
+void pool_release(rr_pool_t *pool, rr_machine_t *machine);
+// Take back every machine handed out at once, without touching them - all slabs are reused from the start
+void pool_release_all(rr_pool_t *pool);
+
+// Make a copy of machine the state pool_acquire and pool_reset give, decode cache included (build it first with machine_predecode to hand out warm machines)
+void pool_set_template(rr_pool_t *pool, const rr_machine_t *machine);
+// Put a machine back in the template's state with one copy of the whole machine
+void pool_reset(rr_pool_t *pool, rr_machine_t *machine);
+
+// Print the counts above
+void pool_report(const rr_pool_t *pool, FILE *out);
+
+#endif
\ No newline at end of file
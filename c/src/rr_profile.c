@@ -0,0 +1,219 @@
+#include "rr_profile.h"
+#include "rr_isa.h"
+
+const char *profile_fusion_names[FUSE_COUNT] = {
+	"LDI+ADC", "ADC+BRA", "ADC+BRA (counted loop)", "PSH+PSH+JSR", "POP+POP+RET"
+};
+
+void profile_clear(rr_profile_t *profile) {
+	
+	memset(profile, 0, sizeof(rr_profile_t));
+	
+}
+
+void profile_count(rr_profile_t *profile, const rr_machine_t *machine, const u8 *operands) {
+	
+	u8 pc = machine->program_counter;
+	
+	profile->pc_counts[pc]++;
+	profile->opcode_counts[operands[0]]++;
+	
+	switch(operands[0]) {
+		
+		case 0x6:
+			profile->memory_reads[operands[2]]++;
+			break;
+			
+		case 0x7:
+			profile->memory_reads[REG(machine, operands[2])]++;
+			break;
+			
+		case 0x8:
+			profile->memory_writes[operands[2]]++;
+			break;
+			
+		case 0x9:
+			profile->memory_writes[REG(machine, operands[2])]++;
+			break;
+			
+		case 0xA:
+			profile->memory_writes[STACK_POINTER(machine)]++;
+			break;
+			
+		case 0xB:
+		case 0xD:
+			profile->memory_reads[(u8)(STACK_POINTER(machine) + 1)]++;
+			break;
+			
+		case 0xC:
+			profile->memory_writes[STACK_POINTER(machine)]++;
+			profile->calls[operands[1]]++;
+			break;
+			
+		case 0xE:
+			profile->branches[pc][(operands[1] & ~(machine->status_register ^ operands[2])) == operands[1]]++;
+			profile->branch_targets[pc] = operands[3];
+			break;
+			
+	}
+	
+}
+
+// Write the indices of the largest (non-zero) of count values spaced stride apart into order, largest first, and return how many were written
+static u32 profile_rank(const u64 *values, u32 count, u32 stride, u16 *order, u32 top) {
+	
+	u32 ranked = 0;
+	u32 c;
+	
+	for(c = 0; c < count; c++) {
+		
+		u64 value = values[c * stride];
+		u32 position = ranked;
+		
+		if(!value)
+			continue;
+			
+		// Insertion into the short sorted list, dropping whatever falls off the end
+		while(position && values[order[position - 1] * stride] < value) {
+			
+			if(position < top)
+				order[position] = order[position - 1];
+				
+			position--;
+			
+		}
+		
+		if(position < top) {
+			
+			order[position] = c;
+			
+			if(ranked < top)
+				ranked++;
+				
+		}
+		
+	}
+	
+	return ranked;
+	
+}
+
+u32 profile_hot_loops(const rr_profile_t *profile, rr_hot_loop_t *loops, u32 max_loops) {
+	
+	rr_hot_loop_t found[256];
+	u64 cycles[256];
+	u16 order[256];
+	u32 found_count = 0;
+	u32 ranked;
+	u32 c;
+	
+	// Every taken branch back to (or onto) itself closes a loop over the addresses in between
+	for(c = 0; c < 256; c++) {
+		
+		rr_hot_loop_t *loop = &found[found_count];
+		u32 address;
+		
+		if(!profile->branches[c][1] || profile->branch_targets[c] > c)
+			continue;
+			
+		loop->start = profile->branch_targets[c];
+		loop->end = c < 255 ? c + 1 : c;
+		loop->trips = profile->branches[c][1];
+		loop->cycles = 0;
+		
+		for(address = loop->start; address <= loop->end; address++)
+			loop->cycles += profile->pc_counts[address];
+			
+		cycles[found_count++] = loop->cycles;
+		
+	}
+	
+	ranked = profile_rank(cycles, found_count, 1, order, max_loops < 256 ? max_loops : 256);
+	
+	for(c = 0; c < ranked; c++)
+		loops[c] = found[order[c]];
+		
+	return ranked;
+	
+}
+
+void profile_report(const rr_profile_t *profile, FILE *out, u32 top) {
+	
+	rr_hot_loop_t loops[256];
+	u64 calls_total = 0;
+	u64 dispatches_saved = 0;
+	u16 order[256];
+	u32 ranked;
+	u32 c;
+	f64 total = profile->cycles ? (f64)profile->cycles : 1;
+	
+	if(top > 256)
+		top = 256;
+		
+	fprintf(out, "Profile of %" PRIu64 " cycles\n", profile->cycles);
+	
+	ranked = profile_hot_loops(profile, loops, top);
+	fprintf(out, "Hot loops:\n");
+	
+	for(c = 0; c < ranked; c++)
+		fprintf(out, "  $%02X-$%02X: %" PRIu64 " cycles (%.1f%%), %" PRIu64 " trips\n", loops[c].start, loops[c].end, loops[c].cycles, loops[c].cycles * 100 / total, loops[c].trips);
+		
+	for(c = 0; c < 256; c++)
+		calls_total += profile->calls[c];
+		
+	ranked = profile_rank(profile->calls, 256, 1, order, top);
+	fprintf(out, "Call targets:\n");
+	
+	for(c = 0; c < ranked; c++)
+		fprintf(out, "  $%02X: %" PRIu64 " calls (%.1f%%)\n", order[c], profile->calls[order[c]], profile->calls[order[c]] * 100.0 / calls_total);
+		
+	ranked = profile_rank(profile->branches[0], 256, 2, order, top);
+	fprintf(out, "Branches (not taken):\n");
+	
+	for(c = 0; c < ranked; c++)
+		fprintf(out, "  $%02X: %" PRIu64 " not taken, %" PRIu64 " taken\n", order[c], profile->branches[order[c]][0], profile->branches[order[c]][1]);
+		
+	ranked = profile_rank(profile->branches[0] + 1, 256, 2, order, top);
+	fprintf(out, "Branches (taken):\n");
+	
+	for(c = 0; c < ranked; c++)
+		fprintf(out, "  $%02X: %" PRIu64 " taken to $%02X, %" PRIu64 " not taken\n", order[c], profile->branches[order[c]][1], profile->branch_targets[order[c]], profile->branches[order[c]][0]);
+		
+	ranked = profile_rank(profile->opcode_counts, 16, 1, order, 16);
+	fprintf(out, "Opcodes:\n");
+	
+	for(c = 0; c < ranked; c++)
+		fprintf(out, "  %s: %" PRIu64 " (%.1f%%)\n", isa_mnemonics[order[c]], profile->opcode_counts[order[c]], profile->opcode_counts[order[c]] * 100 / total);
+		
+	fprintf(out, "Fused sequences:\n");
+	
+	for(c = 0; c < FUSE_COUNT; c++) {
+		
+		if(profile->fusions[c])
+			fprintf(out, "  %s: %" PRIu64 "\n", profile_fusion_names[c], profile->fusions[c]);
+			
+		dispatches_saved += profile->fusions[c] * (c + FUSE_FIRST >= FUSE_PSH_PSH_JSR ? 2 : 1);
+		
+	}
+	
+	fprintf(out, "  %" PRIu64 " dispatches for %" PRIu64 " instructions (%.1f%% fewer than one per instruction)\n", profile->cycles - dispatches_saved, profile->cycles, dispatches_saved * 100 / total);
+	
+	ranked = profile_rank(profile->pc_counts, 256, 1, order, top);
+	fprintf(out, "Hottest addresses:\n");
+	
+	for(c = 0; c < ranked; c++)
+		fprintf(out, "  $%02X: %" PRIu64 " (%.1f%%)\n", order[c], profile->pc_counts[order[c]], profile->pc_counts[order[c]] * 100 / total);
+		
+	ranked = profile_rank(profile->memory_reads, 256, 1, order, top);
+	fprintf(out, "Most read memory:\n");
+	
+	for(c = 0; c < ranked; c++)
+		fprintf(out, "  $%02X: %" PRIu64 " reads, %" PRIu64 " writes\n", order[c], profile->memory_reads[order[c]], profile->memory_writes[order[c]]);
+		
+	ranked = profile_rank(profile->memory_writes, 256, 1, order, top);
+	fprintf(out, "Most written memory:\n");
+	
+	for(c = 0; c < ranked; c++)
+		fprintf(out, "  $%02X: %" PRIu64 " writes, %" PRIu64 " reads\n", order[c], profile->memory_writes[order[c]], profile->memory_reads[order[c]]);
+		
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef RR_PROFILE_H
+#define RR_PROFILE_H
+
+#include "rr_machine.h"
+
+// Counts gathered by machine_run_profile, all flat arrays indexed by address (or opcode) - they add up over runs until profile_clear
+typedef struct rr_profile_d {
+	u64 cycles;
+	// Instructions started at each address, and of each opcode
+	u64 pc_counts[256];
+	u64 opcode_counts[16];
+	// BRA instructions at each address, [address][0] not taken and [address][1] taken
+	u64 branches[256][2];
+	// Target of the BRA last run at each address
+	u8 branch_targets[256];
+	// JSR instructions calling each address
+	u64 calls[256];
+	// Data reads and writes of each memory cell (LDM/LDR/POP/RET and STO/STR/PSH/JSR, instruction fetches are not counted)
+	u64 memory_reads[256];
+	u64 memory_writes[256];
+	// Fused sequences (FUSE_*) the plain interpreter would start, each saving a dispatch for every instruction after its first
+	u64 fusions[FUSE_COUNT];
+} rr_profile_t;
+
+// A loop found from a taken backward branch
+typedef struct rr_hot_loop_d {
+	// First and last address of the loop (the target and address of the branch)
+	u8 start;
+	u8 end;
+	// Times the branch was taken
+	u64 trips;
+	// Instructions run from addresses inside the loop
+	u64 cycles;
+} rr_hot_loop_t;
+
+void profile_clear(rr_profile_t *profile);
+
+// Run full cycles like machine_run_fast, counting every one of them into the profile
+// Counting is compiled into its own copy of the threaded interpreter, the other runs are unaffected by it
+u64 machine_run_profile(rr_machine_t *machine, u64 max_cycles, rr_profile_t *profile);
+
+// Count one instruction about to run from the machine's current state (used where the interpreter isn't)
+void profile_count(rr_profile_t *profile, const rr_machine_t *machine, const u8 *operands);
+
+// Fill loops with up to max_loops loops found in the profile, hottest (most cycles inside) first, and return how many were found
+u32 profile_hot_loops(const rr_profile_t *profile, rr_hot_loop_t *loops, u32 max_loops);
+
+// Print the top entries of each ranking - hot loops, call targets, opcodes, addresses and memory cells
+void profile_report(const rr_profile_t *profile, FILE *out, u32 top);
+
+#endif
\ No newline at end of file
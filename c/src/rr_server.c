@@ -0,0 +1,873 @@
+// accept4
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "rr_server.h"
+
+#if defined(__linux__)
+
+#include <stdarg.h>
+#include <ctype.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+// Events taken from epoll per wait
+#define SERVER_EVENTS 64
+#define SERVER_OPERAND_COUNT 4
+#define SERVER_HELP_COUNT 11
+
+static const char *server_state_names[4] = {
+	"Fetch",
+	"Decode",
+	"Execute",
+	"Halt"
+};
+
+static const char *server_helptext[SERVER_HELP_COUNT] = {
+	"save <file name> - saves main memory to a file in the server's file directory, if it has one",
+	"load <file name> - loads main memory from a 256 byte file in the server's file directory, if it has one",
+	"step [<part|full>,<number of steps>] - steps the machine in parts or full steps (full if not specified)",
+	"run [<part|full>,<max cycles>] - runs the machine until a halt, the limit or stop, sharing the server with other running sessions",
+	"stop - ends the run in progress",
+	"poke <location>,<value> - sets a memory location, register, sp, pc, ir or sr",
+	"peek <location> - prints a memory location, register, sp, pc, ir or sr",
+	"dump - prints all machine contents",
+	"reset - resets machine registers",
+	"clear - clears machine memory",
+	"help - display all valid commands"
+};
+
+// Numbers as the command line takes them - %binary, $hex, 0octal or decimal
+static u8 server_parse(const char *str, u64 *value) {
+	
+	char *end_ptr;
+	u8 base = 10;
+	
+	switch(*str) {
+		
+		case '%':
+			base = 2;
+			str++;
+			break;
+			
+		case '$':
+			base = 16;
+			str++;
+			break;
+			
+		case '0':
+			base = 8;
+			break;
+			
+		default:
+			if(!isdigit((u8)*str))
+				return 1;
+				
+	}
+	
+	*value = strtoull(str, &end_ptr, base);
+	
+	return str == end_ptr;
+	
+}
+
+// Make room for length more bytes of output, dropping the session instead once its client has fallen too far behind
+static u8 session_reserve(rr_session_t *session, u32 length) {
+	
+	u32 capacity = session->output_capacity ? session->output_capacity : 256;
+	char *output;
+	
+	if(session->closing)
+		return 1;
+		
+	if(session->output_length + length > SERVER_OUTPUT_LIMIT) {
+		
+		session->closing = 1;
+		return 1;
+		
+	}
+	
+	if(session->output_length + length <= session->output_capacity)
+		return 0;
+		
+	while(capacity < session->output_length + length)
+		capacity <<= 1;
+		
+	if(!(output = (char *)realloc(session->output, capacity))) {
+		
+		session->closing = 1;
+		return 1;
+		
+	}
+	
+	session->output = output;
+	session->output_capacity = capacity;
+	
+	return 0;
+	
+}
+
+static void session_write(rr_session_t *session, const void *data, u32 length) {
+	
+	if(session_reserve(session, length))
+		return;
+		
+	memcpy(session->output + session->output_length, data, length);
+	session->output_length += length;
+	
+}
+
+static void session_printf(rr_session_t *session, const char *format, ...) {
+	
+	va_list args;
+	s32 length;
+	
+	va_start(args, format);
+	length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	
+	// One more for the terminator vsnprintf writes, which the next output overwrites
+	if(length < 0 || session_reserve(session, length + 1))
+		return;
+		
+	va_start(args, format);
+	vsnprintf(session->output + session->output_length, length + 1, format, args);
+	va_end(args);
+	
+	session->output_length += length;
+	
+}
+
+// Ask epoll for input until the client shuts its side, and for room to write only while there is output waiting
+// A hang up is always reported, so a client that goes away mid run is noticed
+static void session_watch(rr_server_t *server, rr_session_t *session) {
+	
+	struct epoll_event event;
+	
+	event.events = (session->eof ? 0 : EPOLLIN | EPOLLRDHUP) | (session->output_length ? EPOLLOUT : 0);
+	event.data.ptr = session;
+	
+	if(event.events != session->watching && !epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, session->fd, &event))
+		session->watching = event.events;
+		
+}
+
+static void session_flush(rr_session_t *session) {
+	
+	u32 sent = 0;
+	
+	while(sent < session->output_length) {
+		
+		ssize_t written = send(session->fd, session->output + sent, session->output_length - sent, MSG_NOSIGNAL);
+		
+		if(written >= 0)
+			sent += written;
+		else if(errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+		else if(errno != EINTR) {
+			
+			session->closing = 1;
+			break;
+			
+		}
+		
+	}
+	
+	memmove(session->output, session->output + sent, session->output_length - sent);
+	session->output_length -= sent;
+	
+}
+
+// Answer a binary request straight from the machine state, which is whole between slices of a run
+static void session_binary(rr_session_t *session, const u8 *request) {
+	
+	u8 reply[SERVER_BINARY_HEADER_SIZE + SERVER_STATE_SIZE];
+	u8 *payload = reply + SERVER_BINARY_HEADER_SIZE;
+	rr_machine_t *machine = session->machine;
+	u16 length = 0;
+	
+	switch(request[1]) {
+		
+		case SERVER_READ_STATE:
+		case SERVER_READ_REGISTERS:
+			payload[0] = machine->program_counter;
+			payload[1] = machine->status_register;
+			payload[2] = machine->instruction_register & 0xFF;
+			payload[3] = machine->instruction_register >> 8;
+			memcpy(payload + 4, machine->registers, 16);
+			length = SERVER_REGISTERS_SIZE;
+			
+			if(request[1] == SERVER_READ_STATE) {
+				
+				memcpy(payload + length, machine->memory, 256);
+				length += 256;
+				
+			}
+			
+			break;
+			
+		case SERVER_READ_MEMORY:
+			length = 256 - request[2];
+			
+			if(request[3] && request[3] < length)
+				length = request[3];
+				
+			memcpy(payload, machine->memory + request[2], length);
+			break;
+			
+		// Unknown requests get an empty reply, keeping the client in step
+		default:
+			break;
+			
+	}
+	
+	reply[0] = 0;
+	reply[1] = request[1];
+	reply[2] = length & 0xFF;
+	reply[3] = length >> 8;
+	
+	session_write(session, reply, SERVER_BINARY_HEADER_SIZE + length);
+	
+}
+
+static void session_finish(rr_session_t *session, const char *reason) {
+	
+	session->running = 0;
+	session_printf(session, "Ran %" PRIu64 " %s, %s\nOK\n", session->cycles, session->part_step ? "parts" : "cycles", reason);
+	
+}
+
+// Registers, sp, pc, ir and sr, or a memory address - returns 1 for anything else
+static u8 session_poke(rr_session_t *session, const char *location, u16 value) {
+	
+	rr_machine_t *machine = session->machine;
+	u64 index;
+	
+	if(location[0] == 'r' && !server_parse(location + 1, &index) && index < 16) {
+		
+		REG(machine, index) = value;
+		MARK_REGISTER(machine, index);
+		
+	}
+	else if(!strcmp(location, "sp")) {
+		
+		STACK_POINTER(machine) = value;
+		MARK_REGISTER(machine, 15);
+		
+	}
+	else if(!strcmp(location, "pc")) {
+		
+		machine->program_counter = value;
+		MARK_STATE(machine, CHANGED_PC);
+		
+	}
+	else if(!strcmp(location, "ir")) {
+		
+		machine->instruction_register = value;
+		MARK_STATE(machine, CHANGED_IR);
+		
+	}
+	else if(!strcmp(location, "sr")) {
+		
+		machine->status_register = value & 0x0F;
+		MARK_STATE(machine, CHANGED_SR);
+		
+	}
+	else if(!server_parse(location, &index) && index < 256)
+		machine_poke(machine, index, value);
+	else
+		return 1;
+		
+	return 0;
+	
+}
+
+static u8 session_peek(rr_session_t *session, const char *location) {
+	
+	rr_machine_t *machine = session->machine;
+	u64 index;
+	
+	if(location[0] == 'r' && !server_parse(location + 1, &index) && index < 16)
+		session_printf(session, "Register %X: $%02X\n", (u8)index, REG(machine, index));
+	else if(!strcmp(location, "sp"))
+		session_printf(session, "Stack pointer: $%02X (%u elements)\n", STACK_POINTER(machine), 0xFF - STACK_POINTER(machine));
+	else if(!strcmp(location, "pc"))
+		session_printf(session, "Program counter: %02X\n", machine->program_counter);
+	else if(!strcmp(location, "ir"))
+		session_printf(session, "Instruction register: $%04X\n", machine->instruction_register);
+	else if(!strcmp(location, "sr"))
+		session_printf(session, "Status register: %X (State: %s, Zero: %c, Carry: %c)\n", machine->status_register, server_state_names[CURRENT_STATE(machine)], (ZERO_SET(machine) ? 'Y' : 'N'), (CARRY_SET(machine) ? 'Y' : 'N'));
+	else if(!server_parse(location, &index) && index < 256)
+		session_printf(session, "[%02X]: $%02X\n", (u8)index, MEM(machine, index));
+	else
+		return 1;
+		
+	return 0;
+	
+}
+
+// Same layout as the command line's dump
+static void session_dump(rr_session_t *session) {
+	
+	rr_machine_t *machine = session->machine;
+	u8 row = 0;
+	u8 column;
+	
+	session_printf(session, "PC: [%02X] IR: [%04X] SR: [%02X]\n", machine->program_counter, machine->instruction_register, machine->status_register);
+	session_printf(session, "    0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F       R\n");
+	
+	for(; row < 0x10; row++) {
+		
+		session_printf(session, "%X", row);
+		
+		for(column = 0; column < 0x10; column++)
+			session_printf(session, " [%02X]", MEM(machine, row * 0x10 + column));
+			
+		session_printf(session, row < 0xF ? "    [%02X]\n" : "  SP[%02X]\n", REG(machine, row));
+		
+	}
+	
+}
+
+// Run one command line, leaving its output and OK/ERR line to be sent - step and run only answer once their run ends
+static void session_command(rr_session_t *session, char *line) {
+	
+	rr_machine_t *machine = session->machine;
+	char *operands[SERVER_OPERAND_COUNT] = {"", "", "", ""};
+	char *cmd;
+	char *c = line;
+	u8 op_counter = 0;
+	
+	for(; *c; c++)
+		*c = tolower((u8)*c);
+		
+	if(!(cmd = strtok(line, " \r"))) {
+		
+		session_printf(session, "OK\n");
+		return;
+		
+	}
+	
+	while(op_counter < SERVER_OPERAND_COUNT && (c = strtok(NULL, ", \r")))
+		operands[op_counter++] = c;
+		
+	if(!strcmp(cmd, "save") || !strcmp(cmd, "load")) {
+		
+		char path[SERVER_PATH_SIZE + SERVER_LINE_SIZE];
+		
+		if(!operands[0][0]) {
+			session_printf(session, "ERR Missing parameter for %s\n", cmd);
+			return;
+		}
+		
+		if(!session->files[0]) {
+			session_printf(session, "ERR File access is turned off on this server\n");
+			return;
+		}
+		
+		// Plain names only, nothing outside the file directory can be reached
+		if(strchr(operands[0], '/') || !strcmp(operands[0], ".") || !strcmp(operands[0], "..")) {
+			session_printf(session, "ERR Not a file name\n");
+			return;
+		}
+		
+		snprintf(path, sizeof(path), "%s/%s", session->files, operands[0]);
+		
+		switch(cmd[0] == 's' ? machine_save(machine, path) : machine_load(machine, path)) {
+			
+			case 0:
+				session_printf(session, cmd[0] == 's' ? "Memory contents saved to file\nOK\n" : "Loaded memory from file\nOK\n");
+				break;
+				
+			case 1:
+				session_printf(session, "ERR Could not open file\n");
+				break;
+				
+			default:
+				session_printf(session, "ERR Could not %s file\n", cmd[0] == 's' ? "write to" : "read from");
+				break;
+				
+		}
+		
+	}
+	// Both start a run that goes a slice at a time, step just has a limit of 1 by default
+	else if(!strcmp(cmd, "step") || !strcmp(cmd, "run")) {
+		
+		u8 op0_specified = 0;
+		u64 count = cmd[0] == 's';
+		
+		session->part_step = 0;
+		
+		if(!strcmp(operands[0], "part")) {
+			
+			session->part_step = 1;
+			op0_specified = 1;
+			
+		}
+		else if(!strcmp(operands[0], "full"))
+			op0_specified = 1;
+			
+		if(operands[op0_specified][0] && server_parse(operands[op0_specified], &count)) {
+			session_printf(session, "ERR Unable to convert value specified\n");
+			return;
+		}
+		
+		if(cmd[0] == 's' && !count) {
+			
+			session_printf(session, "OK\n");
+			return;
+			
+		}
+		
+		session->running = 1;
+		session->max_cycles = count;
+		session->cycles = 0;
+		
+	}
+	else if(!strcmp(cmd, "stop")) {
+		
+		if(session->running)
+			session_finish(session, "stopped");
+			
+		session_printf(session, "OK\n");
+		
+	}
+	else if(!strcmp(cmd, "poke")) {
+		
+		u64 value;
+		
+		if(!operands[0][0] || !operands[1][0]) {
+			session_printf(session, "ERR Missing parameter for poke\n");
+			return;
+		}
+		
+		if(server_parse(operands[1], &value) || session_poke(session, operands[0], value))
+			session_printf(session, "ERR Unable to convert value specified\n");
+		else
+			session_printf(session, "OK\n");
+			
+	}
+	else if(!strcmp(cmd, "peek")) {
+		
+		if(!operands[0][0]) {
+			session_printf(session, "ERR Missing parameter for peek\n");
+			return;
+		}
+		
+		if(session_peek(session, operands[0]))
+			session_printf(session, "ERR Unable to convert value specified\n");
+		else
+			session_printf(session, "OK\n");
+			
+	}
+	else if(!strcmp(cmd, "dump")) {
+		
+		session_dump(session);
+		session_printf(session, "OK\n");
+		
+	}
+	else if(!strcmp(cmd, "reset")) {
+		
+		machine_reset(machine);
+		session_printf(session, "OK\n");
+		
+	}
+	else if(!strcmp(cmd, "clear")) {
+		
+		machine_clear_memory(machine);
+		session_printf(session, "OK\n");
+		
+	}
+	else if(!strcmp(cmd, "help")) {
+		
+		u8 h = 0;
+		
+		for(; h < SERVER_HELP_COUNT; h++)
+			session_printf(session, "%s\n", server_helptext[h]);
+			
+		session_printf(session, "OK\n");
+		
+	}
+	else
+		session_printf(session, "ERR Unrecognized command %s\n", cmd);
+		
+}
+
+// Handle everything whole in the input, in order - a run holds back what comes after it, apart from binary requests and stop
+static void session_process(rr_session_t *session) {
+	
+	u32 used = 0;
+	
+	while(used < session->input_length && !session->closing) {
+		
+		char *start = session->input + used;
+		u32 available = session->input_length - used;
+		char *end;
+		
+		if(!*start) {
+			
+			if(available < SERVER_BINARY_SIZE)
+				break;
+				
+			session_binary(session, (u8 *)start);
+			used += SERVER_BINARY_SIZE;
+			
+			continue;
+			
+		}
+		
+		if(!(end = (char *)memchr(start, '\n', available)))
+			break;
+			
+		if(session->running && (end - start < 4 || strncasecmp(start, "stop", 4) || strspn(start + 4, " \r") != (size_t)(end - start - 4)))
+			break;
+			
+		*end = 0;
+		used += end - start + 1;
+		
+		session_command(session, start);
+		
+	}
+	
+	memmove(session->input, session->input + used, session->input_length - used);
+	session->input_length -= used;
+	
+	// A full buffer that can't be taken apart is a line too long to ever be handled
+	if(session->input_length == SERVER_LINE_SIZE && !session->running) {
+		
+		session_printf(session, "ERR Line too long\n");
+		session->closing = 1;
+		
+	}
+	
+}
+
+static void session_read(rr_session_t *session) {
+	
+	while(session->input_length < SERVER_LINE_SIZE) {
+		
+		ssize_t received = recv(session->fd, session->input + session->input_length, SERVER_LINE_SIZE - session->input_length, 0);
+		
+		if(received > 0)
+			session->input_length += received;
+		else if(!received) {
+			
+			session->eof = 1;
+			break;
+			
+		}
+		else if(errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+		else if(errno != EINTR) {
+			
+			session->closing = 1;
+			break;
+			
+		}
+		
+	}
+	
+	session_process(session);
+	
+}
+
+// Give a running session its slice of cycles (or parts), answering once the run is over
+static void session_slice(rr_server_t *server, rr_session_t *session) {
+	
+	rr_machine_t *machine = session->machine;
+	u64 slice = server->slice_cycles;
+	
+	if(session->max_cycles && slice > session->max_cycles - session->cycles)
+		slice = session->max_cycles - session->cycles;
+		
+	if(session->part_step)
+		for(; slice && CURRENT_STATE(machine) != 0b11; slice--) {
+			
+			machine_step(machine, 1);
+			session->cycles++;
+			
+		}
+	else
+		session->cycles += machine_run_fast(machine, slice);
+		
+	if(CURRENT_STATE(machine) == 0b11)
+		session_finish(session, "halted");
+	else if(session->max_cycles && session->cycles >= session->max_cycles)
+		session_finish(session, "reached the limit");
+	else
+		return;
+		
+	// Lines held back by the run can go now
+	session_process(session);
+	
+}
+
+static void session_free(rr_session_t *session) {
+	
+	close(session->fd);
+	free(session->machine);
+	free(session->output);
+	free(session);
+	
+}
+
+static void server_accept(rr_server_t *server) {
+	
+	while(1) {
+		
+		struct epoll_event event;
+		rr_session_t *session;
+		s32 fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		
+		if(fd < 0) {
+			
+			if(errno == EINTR)
+				continue;
+				
+			break;
+			
+		}
+		
+		if(server->session_count == server->max_sessions || !(session = (rr_session_t *)calloc(1, sizeof(rr_session_t)))) {
+			
+			close(fd);
+			continue;
+			
+		}
+		
+		session->fd = fd;
+		session->files = server->files;
+		session->watching = EPOLLIN | EPOLLRDHUP;
+		
+		event.events = EPOLLIN | EPOLLRDHUP;
+		event.data.ptr = session;
+		
+		if(!(session->machine = machine_new()) || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+			
+			session_free(session);
+			continue;
+			
+		}
+		
+		server->sessions[server->session_count++] = session;
+		
+	}
+	
+}
+
+rr_server_t *server_new(const char *socket_path, u32 max_sessions, u64 slice_cycles) {
+	
+	rr_server_t *server;
+	struct sockaddr_un address;
+	struct epoll_event event;
+	struct stat existing;
+	
+	if(strlen(socket_path) >= sizeof(address.sun_path) || !(server = (rr_server_t *)calloc(1, sizeof(rr_server_t))))
+		return NULL;
+		
+	server->listen_fd = server->epoll_fd = -1;
+	server->max_sessions = max_sessions ? max_sessions : SERVER_DEFAULT_SESSIONS;
+	server->slice_cycles = slice_cycles ? slice_cycles : SERVER_DEFAULT_SLICE;
+	
+	if(!(server->sessions = (rr_session_t **)calloc(server->max_sessions, sizeof(rr_session_t *)))) {
+		
+		server_free(server);
+		return NULL;
+		
+	}
+	
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	
+	// Only a socket left behind by an earlier server is replaced, never any other file
+	if(!stat(socket_path, &existing) && S_ISSOCK(existing.st_mode))
+		unlink(socket_path);
+		
+	if((server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0 || bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address))) {
+		
+		server_free(server);
+		return NULL;
+		
+	}
+	
+	// Bound, so server_free removes the socket file from here on
+	strcpy(server->socket_path, socket_path);
+	
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	
+	if(listen(server->listen_fd, SOMAXCONN) || (server->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event)) {
+		
+		server_free(server);
+		return NULL;
+		
+	}
+	
+	return server;
+	
+}
+
+u8 server_files(rr_server_t *server, const char *directory) {
+	
+	if(!directory) {
+		
+		server->files[0] = 0;
+		return 0;
+		
+	}
+	
+	if(!directory[0] || strlen(directory) >= sizeof(server->files))
+		return 1;
+		
+	strcpy(server->files, directory);
+	
+	return 0;
+	
+}
+
+void server_free(rr_server_t *server) {
+	
+	u32 s = 0;
+	
+	if(!server)
+		return;
+		
+	for(; s < server->session_count; s++)
+		session_free(server->sessions[s]);
+		
+	if(server->listen_fd >= 0)
+		close(server->listen_fd);
+		
+	if(server->epoll_fd >= 0)
+		close(server->epoll_fd);
+		
+	if(server->socket_path[0])
+		unlink(server->socket_path);
+		
+	free(server->sessions);
+	free(server);
+	
+}
+
+u8 server_run(rr_server_t *server) {
+	
+	struct epoll_event events[SERVER_EVENTS];
+	
+	while(!server->stopping) {
+		
+		u32 s = 0;
+		u8 running = 0;
+		s32 count;
+		s32 e = 0;
+		
+		for(; s < server->session_count; s++)
+			running |= server->sessions[s]->running;
+			
+		// Only block while nothing is running
+		if((count = epoll_wait(server->epoll_fd, events, SERVER_EVENTS, running ? 0 : -1)) < 0) {
+			
+			if(errno == EINTR)
+				continue;
+				
+			return 1;
+			
+		}
+		
+		for(; e < count; e++) {
+			
+			rr_session_t *session = (rr_session_t *)events[e].data.ptr;
+			
+			if(!session)
+				server_accept(server);
+			else {
+				
+				if(events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+					session_read(session);
+					
+				// Both sides closed, nobody is left to answer, so a run in progress ends with the session
+				if(events[e].events & (EPOLLHUP | EPOLLERR))
+					session->closing = 1;
+					
+				if(events[e].events & EPOLLOUT)
+					session_flush(session);
+					
+			}
+			
+		}
+		
+		// Round robin, each running session gets one slice per pass
+		for(s = 0; s < server->session_count; s++)
+			if(server->sessions[s]->running && !server->sessions[s]->closing)
+				session_slice(server, server->sessions[s]);
+				
+		// Send what was answered, and drop sessions that are done - a client that has shut its side still gets every answer first
+		for(s = 0; s < server->session_count;) {
+			
+			rr_session_t *session = server->sessions[s];
+			
+			if(session->output_length && !session->closing)
+				session_flush(session);
+				
+			if(session->closing || (session->eof && !session->running && !session->output_length)) {
+				
+				session_free(session);
+				server->sessions[s] = server->sessions[--server->session_count];
+				
+				continue;
+				
+			}
+			
+			session_watch(server, session);
+			s++;
+			
+		}
+		
+	}
+	
+	return 0;
+	
+}
+
+void server_stop(rr_server_t *server) {
+	
+	server->stopping = 1;
+	
+}
+
+#else
+
+rr_server_t *server_new(const char *socket_path, u32 max_sessions, u64 slice_cycles) {
+	
+	return NULL;
+	
+}
+
+void server_free(rr_server_t *server) {
+	
+}
+
+u8 server_files(rr_server_t *server, const char *directory) {
+	
+	return 1;
+	
+}
+
+u8 server_run(rr_server_t *server) {
+	
+	return 1;
+	
+}
+
+void server_stop(rr_server_t *server) {
+	
+	server->stopping = 1;
+	
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef RR_SERVER_H
+#define RR_SERVER_H
+
+#include "rr_machine.h"
+
+// Sessions served at once unless server_new is given another limit
+#define SERVER_DEFAULT_SESSIONS 1024
+// Cycles a running session gets before the others have their turn
+#define SERVER_DEFAULT_SLICE 65536
+// Longest command line, and the most unsent output a session may build up before it is dropped as too slow
+#define SERVER_LINE_SIZE 4096
+#define SERVER_OUTPUT_LIMIT (1 << 20)
+// Longest file directory, joined with a file name, load and save may use
+#define SERVER_PATH_SIZE 4096
+
+// Binary requests start with a 0 byte (which never starts a command line) and are always 4 bytes long:
+// 0, <SERVER_READ_*>, <first>, <count>
+// The reply is 0, <the same SERVER_READ_*>, <payload length, 2 bytes little endian> and the payload
+#define SERVER_BINARY_SIZE 4
+#define SERVER_BINARY_HEADER_SIZE 4
+// PC, SR, IR (little endian), 16 registers then 256 bytes of memory
+#define SERVER_READ_STATE 1
+// PC, SR, IR (little endian) and 16 registers
+#define SERVER_READ_REGISTERS 2
+// <count> bytes of memory from <first> (0 reads up to the end of memory)
+#define SERVER_READ_MEMORY 3
+#define SERVER_STATE_SIZE (4 + 16 + 256)
+#define SERVER_REGISTERS_SIZE (4 + 16)
+
+// A connection and the machine it owns
+typedef struct rr_session_d {
+	s32 fd;
+	rr_machine_t *machine;
+	// Bytes received but not yet handled
+	char input[SERVER_LINE_SIZE];
+	u32 input_length;
+	// Bytes waiting for the socket to take them
+	char *output;
+	u32 output_length;
+	u32 output_capacity;
+	// A run in progress, spread over as many slices as it takes - 0 max_cycles for no limit
+	u8 running;
+	u8 part_step;
+	u64 max_cycles;
+	u64 cycles;
+	// Events asked of epoll, reading stops once the client has shut its side
+	u32 watching;
+	u8 eof;
+	// Set once the connection is finished with, sessions are closed after each pass of the event loop
+	u8 closing;
+	// The server's file directory, empty while load and save are turned off
+	const char *files;
+} rr_session_t;
+
+typedef struct rr_server_d {
+	s32 listen_fd;
+	s32 epoll_fd;
+	// Open sessions, packed at the start of the array
+	rr_session_t **sessions;
+	u32 session_count;
+	u32 max_sessions;
+	u64 slice_cycles;
+	// Set by server_stop, checked once per pass of the event loop
+	volatile u8 stopping;
+	char socket_path[108];
+	// The only directory load and save may use, empty (the default) turns them off
+	char files[SERVER_PATH_SIZE];
+} rr_server_t;
+
+// Listen on a Unix domain socket at socket_path (replacing any socket file already there), 0 max_sessions/slice_cycles use the defaults above
+// Returns NULL if the socket can't be set up, or on platforms without epoll
+rr_server_t *server_new(const char *socket_path, u32 max_sessions, u64 slice_cycles);
+// Close every session and the socket, and remove the socket file
+void server_free(rr_server_t *server);
+// Let load and save use plain file names (no '/', never "." or "..") inside directory, NULL turns them off again
+// Returns 1 if the directory name is too long
+u8 server_files(rr_server_t *server, const char *directory);
+
+// Serve sessions until server_stop, returns 1 if the event loop fails
+// Each connection gets its own machine and is served commands a line at a time, answered with their output and an "OK" or "ERR <reason>" line:
+// load/save <file name> (only once server_files has given a directory), step [part|full][,<count>], run [part|full][,<max cycles>], stop, poke <location>,<value>, peek <location>, dump, reset, clear, help
+// Runs go a slice of cycles at a time, round robin with the other running sessions, and answer once they halt, reach their limit or are stopped
+// Later lines wait for the run to finish, apart from stop and binary requests, which are answered between slices
+// A client that closes the connection ends its session and any run in progress, one that only shuts its side is still sent every answer
+u8 server_run(rr_server_t *server);
+// Safe to call from a signal handler
+void server_stop(rr_server_t *server);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,426 @@
+#include "rr_snapshot.h"
+
+// The state bytes of a snapshot, as streams store them
+#define SNAPSHOT_STATE(s) ((u8 *)&(s)->program_counter)
+// Changed bytes closer together than this are sent as one run, the unchanged bytes between them cost less than another run header
+#define SNAPSHOT_RUN_GAP 2
+
+void snapshot_take(rr_snapshot_t *snapshot, const rr_machine_t *machine) {
+	
+	memcpy(snapshot->magic, SNAPSHOT_MAGIC, 4);
+	snapshot->version = SNAPSHOT_VERSION;
+	snapshot->program_counter = machine->program_counter;
+	snapshot->status_register = machine->status_register;
+	snapshot->instruction[0] = machine->instruction_register & 0xFF;
+	snapshot->instruction[1] = machine->instruction_register >> 8;
+	memcpy(snapshot->operands, machine->operands, 4);
+	memcpy(snapshot->registers, machine->registers, 16);
+	memcpy(snapshot->memory, machine->memory, 256);
+	
+}
+
+u8 snapshot_restore(rr_machine_t *machine, const rr_snapshot_t *snapshot) {
+	
+	if(memcmp(snapshot->magic, SNAPSHOT_MAGIC, 4) || snapshot->version != SNAPSHOT_VERSION)
+		return 1;
+		
+	machine_mark_state(machine, snapshot->registers, snapshot->program_counter, snapshot->status_register & 0x0F, snapshot->instruction[0] | (snapshot->instruction[1] << 8));
+	machine_mark_memory(machine, snapshot->memory);
+	
+	machine->program_counter = snapshot->program_counter;
+	machine->status_register = snapshot->status_register & 0x0F;
+	machine->instruction_register = snapshot->instruction[0] | (snapshot->instruction[1] << 8);
+	memcpy(machine->operands, snapshot->operands, 4);
+	memcpy(machine->registers, snapshot->registers, 16);
+	memcpy(machine->memory, snapshot->memory, 256);
+	
+	// Same as machine_load, the cache was built from the code being replaced
+	memset(machine->decode_cache, 0, sizeof(machine->decode_cache));
+	
+	return 0;
+	
+}
+
+u8 machine_save_state(rr_machine_t *machine, const char *snapshot_filename) {
+	
+	rr_snapshot_t snapshot;
+	FILE *snapshot_file = fopen(snapshot_filename, "wb");
+	u8 failed;
+	
+	if(!snapshot_file)
+		return 1;
+		
+	snapshot_take(&snapshot, machine);
+	
+	failed = fwrite(&snapshot, sizeof(rr_snapshot_t), 1, snapshot_file) != 1;
+	
+	if(fclose(snapshot_file))
+		failed = 1;
+		
+	return failed ? 2 : 0;
+	
+}
+
+u8 machine_load_state(rr_machine_t *machine, const char *snapshot_filename) {
+	
+	rr_snapshot_t snapshot;
+	FILE *snapshot_file = fopen(snapshot_filename, "rb");
+	
+	if(!snapshot_file)
+		return 1;
+		
+	if(fread(&snapshot, sizeof(rr_snapshot_t), 1, snapshot_file) != 1) {
+		
+		fclose(snapshot_file);
+		
+		return 2;
+		
+	}
+	
+	fclose(snapshot_file);
+	
+	return snapshot_restore(machine, &snapshot) ? 3 : 0;
+	
+}
+
+// Runs of changed bytes between previous and current, returns the payload size
+static u32 snapshot_delta(const u8 *previous, const u8 *current, u8 *payload) {
+	
+	u32 size = 0;
+	u32 position = 0;
+	u32 c;
+	
+	while(position < SNAPSHOT_STATE_SIZE) {
+		
+		u32 start = position;
+		u32 end;
+		
+		while(start < SNAPSHOT_STATE_SIZE && previous[start] == current[start])
+			start++;
+			
+		if(start == SNAPSHOT_STATE_SIZE)
+			break;
+			
+		// Skips longer than a byte holds go out as empty runs
+		for(; start - position > 0xFF; position += 0xFF) {
+			
+			payload[size++] = 0xFF;
+			payload[size++] = 0;
+			
+		}
+		
+		// Carry the run on over short stretches of unchanged bytes
+		for(end = start + 1; end < SNAPSHOT_STATE_SIZE && end - start < 0xFF; end++) {
+			
+			if(previous[end] != current[end])
+				continue;
+				
+			for(c = end; c < SNAPSHOT_STATE_SIZE && c - end < SNAPSHOT_RUN_GAP && previous[c] == current[c]; c++);
+			
+			if(c == SNAPSHOT_STATE_SIZE || c - end == SNAPSHOT_RUN_GAP)
+				break;
+				
+		}
+		
+		payload[size++] = start - position;
+		payload[size++] = end - start;
+		memcpy(payload + size, current + start, end - start);
+		size += end - start;
+		
+		position = end;
+		
+	}
+	
+	return size;
+	
+}
+
+// Apply a delta payload to state, returns 1 if it runs past the end of the state
+static u8 snapshot_apply(u8 *state, const u8 *payload, u32 size) {
+	
+	u32 position = 0;
+	u32 p = 0;
+	
+	while(p + 2 <= size) {
+		
+		u32 length = payload[p + 1];
+		
+		position += payload[p];
+		p += 2;
+		
+		if(position + length > SNAPSHOT_STATE_SIZE || p + length > size)
+			return 1;
+			
+		memcpy(state + position, payload + p, length);
+		position += length;
+		p += length;
+		
+	}
+	
+	return p != size;
+	
+}
+
+static u8 snapshot_index_frame(rr_snapshot_stream_t *stream, u64 cycle, u64 offset, u8 kind) {
+	
+	rr_snapshot_frame_t *frame;
+	
+	if(stream->frame_count == stream->frame_capacity) {
+		
+		u64 capacity = stream->frame_capacity ? stream->frame_capacity << 1 : 1024;
+		rr_snapshot_frame_t *frames = (rr_snapshot_frame_t *)realloc(stream->frames, capacity * sizeof(rr_snapshot_frame_t));
+		
+		if(!frames)
+			return 1;
+			
+		stream->frames = frames;
+		stream->frame_capacity = capacity;
+		
+	}
+	
+	frame = &stream->frames[stream->frame_count];
+	frame->cycle = cycle;
+	frame->offset = offset;
+	frame->keyframe = kind == SNAPSHOT_FRAME_KEY ? stream->frame_count : stream->frames[stream->frame_count - 1].keyframe;
+	
+	stream->frame_count++;
+	stream->keyframe_count += kind == SNAPSHOT_FRAME_KEY;
+	
+	return 0;
+	
+}
+
+rr_snapshot_stream_t *snapshot_stream_create(const char *stream_filename, u32 keyframe_interval) {
+	
+	rr_snapshot_stream_t *stream = (rr_snapshot_stream_t *)calloc(1, sizeof(rr_snapshot_stream_t));
+	u8 header[8] = {0};
+	
+	if(!stream)
+		return NULL;
+		
+	if(!(stream->file = fopen(stream_filename, "wb"))) {
+		
+		free(stream);
+		return NULL;
+		
+	}
+	
+	stream->writing = 1;
+	stream->keyframe_interval = keyframe_interval ? keyframe_interval : SNAPSHOT_DEFAULT_KEYFRAME_INTERVAL;
+	
+	memcpy(header, SNAPSHOT_STREAM_MAGIC, 4);
+	header[4] = SNAPSHOT_STREAM_VERSION;
+	
+	stream->error = fwrite(header, sizeof(header), 1, stream->file) != 1;
+	stream->bytes = sizeof(header);
+	
+	return stream;
+	
+}
+
+rr_snapshot_stream_t *snapshot_stream_open(const char *stream_filename) {
+	
+	rr_snapshot_stream_t *stream = (rr_snapshot_stream_t *)calloc(1, sizeof(rr_snapshot_stream_t));
+	u8 header[SNAPSHOT_FRAME_HEADER_SIZE];
+	u64 file_size;
+	
+	if(!stream)
+		return NULL;
+		
+	if(!(stream->file = fopen(stream_filename, "rb")) || fread(header, 8, 1, stream->file) != 1 || memcmp(header, SNAPSHOT_STREAM_MAGIC, 4) || header[4] != SNAPSHOT_STREAM_VERSION) {
+		
+		if(stream->file)
+			fclose(stream->file);
+			
+		free(stream);
+		return NULL;
+		
+	}
+	
+	// Seeking past the end succeeds, so frames are checked against the size instead
+	fseek(stream->file, 0, SEEK_END);
+	file_size = ftell(stream->file);
+	fseek(stream->file, 8, SEEK_SET);
+	
+	stream->bytes = 8;
+	
+	while(fread(header, SNAPSHOT_FRAME_HEADER_SIZE, 1, stream->file) == 1) {
+		
+		u64 cycle = 0;
+		u32 size = header[9] | (header[10] << 8);
+		u8 b = 8;
+		
+		while(b--)
+			cycle = (cycle << 8) | header[1 + b];
+			
+		// A delta with nothing before it to apply to, or a payload that isn't all there, ends the stream
+		if(header[0] > SNAPSHOT_FRAME_DELTA || (header[0] == SNAPSHOT_FRAME_DELTA && !stream->frame_count) || (header[0] == SNAPSHOT_FRAME_KEY && size != SNAPSHOT_STATE_SIZE))
+			break;
+			
+		if(stream->bytes + SNAPSHOT_FRAME_HEADER_SIZE + size > file_size || fseek(stream->file, size, SEEK_CUR))
+			break;
+			
+		if(snapshot_index_frame(stream, cycle, stream->bytes, header[0])) {
+			
+			snapshot_stream_close(stream);
+			return NULL;
+			
+		}
+		
+		stream->bytes += SNAPSHOT_FRAME_HEADER_SIZE + size;
+		
+	}
+	
+	return stream;
+	
+}
+
+u8 snapshot_stream_close(rr_snapshot_stream_t *stream) {
+	
+	u8 error;
+	
+	if(!stream)
+		return 0;
+		
+	error = stream->error;
+	
+	if(fclose(stream->file) && stream->writing)
+		error = 1;
+		
+	free(stream->frames);
+	free(stream);
+	
+	return error;
+	
+}
+
+u8 snapshot_stream_put(rr_snapshot_stream_t *stream, const rr_machine_t *machine, u64 cycle) {
+	
+	rr_snapshot_t snapshot;
+	u8 header[SNAPSHOT_FRAME_HEADER_SIZE];
+	// Runs cost 2 bytes each on top of the bytes they carry, but a delta that big is sent as a keyframe anyway
+	u8 payload[SNAPSHOT_STATE_SIZE * 2];
+	u8 *state = SNAPSHOT_STATE(&snapshot);
+	u32 size = SNAPSHOT_STATE_SIZE;
+	u8 kind = SNAPSHOT_FRAME_KEY;
+	u8 b = 0;
+	
+	if(!stream->writing)
+		return 1;
+		
+	snapshot_take(&snapshot, machine);
+	
+	if(stream->frame_count && stream->since_keyframe < stream->keyframe_interval && (size = snapshot_delta(stream->previous, state, payload)) < SNAPSHOT_STATE_SIZE)
+		kind = SNAPSHOT_FRAME_DELTA;
+	else
+		size = SNAPSHOT_STATE_SIZE;
+		
+	header[0] = kind;
+	
+	for(; b < 8; b++)
+		header[1 + b] = cycle >> (b * 8);
+		
+	header[9] = size & 0xFF;
+	header[10] = size >> 8;
+	
+	if(fwrite(header, SNAPSHOT_FRAME_HEADER_SIZE, 1, stream->file) != 1 || fwrite(kind == SNAPSHOT_FRAME_KEY ? state : payload, size, 1, stream->file) != 1 || snapshot_index_frame(stream, cycle, stream->bytes, kind)) {
+		
+		stream->error = 1;
+		return 1;
+		
+	}
+	
+	stream->since_keyframe = kind == SNAPSHOT_FRAME_KEY ? 1 : stream->since_keyframe + 1;
+	stream->bytes += SNAPSHOT_FRAME_HEADER_SIZE + size;
+	memcpy(stream->previous, state, SNAPSHOT_STATE_SIZE);
+	
+	return 0;
+	
+}
+
+u8 snapshot_stream_seek(rr_snapshot_stream_t *stream, u64 cycle, rr_machine_t *machine, u64 *found) {
+	
+	rr_snapshot_t snapshot;
+	u8 payload[SNAPSHOT_STATE_SIZE * 2];
+	u64 low = 0;
+	u64 high = stream->frame_count;
+	u64 target;
+	u64 f;
+	
+	// Frames go up in cycle, find the last at or before the one asked for
+	while(low < high) {
+		
+		u64 middle = low + (high - low) / 2;
+		
+		if(stream->frames[middle].cycle <= cycle)
+			low = middle + 1;
+		else
+			high = middle;
+			
+	}
+	
+	if(!low || stream->writing)
+		return 1;
+		
+	target = low - 1;
+	f = stream->frames[target].keyframe;
+	
+	if(fseek(stream->file, stream->frames[f].offset, SEEK_SET))
+		return 1;
+		
+	for(; f <= target; f++) {
+		
+		u8 header[SNAPSHOT_FRAME_HEADER_SIZE];
+		u32 size;
+		
+		if(fread(header, SNAPSHOT_FRAME_HEADER_SIZE, 1, stream->file) != 1)
+			return 1;
+			
+		size = header[9] | (header[10] << 8);
+		
+		if(size > sizeof(payload) || fread(payload, size, 1, stream->file) != 1)
+			return 1;
+			
+		if(header[0] == SNAPSHOT_FRAME_KEY)
+			memcpy(SNAPSHOT_STATE(&snapshot), payload, SNAPSHOT_STATE_SIZE);
+		else if(snapshot_apply(SNAPSHOT_STATE(&snapshot), payload, size))
+			return 1;
+			
+	}
+	
+	memcpy(snapshot.magic, SNAPSHOT_MAGIC, 4);
+	snapshot.version = SNAPSHOT_VERSION;
+	snapshot_restore(machine, &snapshot);
+	
+	if(found)
+		*found = stream->frames[target].cycle;
+		
+	return 0;
+	
+}
+
+u64 machine_run_snapshots(rr_machine_t *machine, u64 max_cycles, u64 interval, rr_snapshot_stream_t *stream) {
+	
+	u64 cycles = 0;
+	
+	if(!interval)
+		interval = 1;
+		
+	snapshot_stream_put(stream, machine, 0);
+	
+	while(CURRENT_STATE(machine) != 0b11 && (!max_cycles || cycles < max_cycles)) {
+		
+		u64 chunk = interval;
+		
+		if(max_cycles && chunk > max_cycles - cycles)
+			chunk = max_cycles - cycles;
+			
+		cycles += machine_run_fast(machine, chunk);
+		
+		snapshot_stream_put(stream, machine, cycles);
+		
+	}
+	
+	return cycles;
+	
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef RR_SNAPSHOT_H
+#define RR_SNAPSHOT_H
+
+#include "rr_machine.h"
+
+// Snapshot file layout - everything a machine needs to carry on from where it was, all single bytes so the file reads the same on any machine
+#define SNAPSHOT_MAGIC "RRSN"
+#define SNAPSHOT_VERSION 1
+// The state after the magic and version, the part streams store and compare
+#define SNAPSHOT_STATE_SIZE (sizeof(rr_snapshot_t) - offsetof(rr_snapshot_t, program_counter))
+
+// Snapshot stream layout - a header then one frame per snapshot, each either a keyframe holding the whole state or a delta against the frame before it
+// Frames are a kind byte, the cycle (8 bytes, little endian), the payload size (2 bytes, little endian) and the payload
+// Delta payloads are runs of changed bytes, each <bytes unchanged before it> <length> <bytes>
+#define SNAPSHOT_STREAM_MAGIC "RRSS"
+#define SNAPSHOT_STREAM_VERSION 1
+#define SNAPSHOT_FRAME_KEY 0
+#define SNAPSHOT_FRAME_DELTA 1
+#define SNAPSHOT_FRAME_HEADER_SIZE 11
+// Frames between keyframes unless snapshot_stream_create is given another interval, the most a restore has to replay
+#define SNAPSHOT_DEFAULT_KEYFRAME_INTERVAL 64
+
+typedef struct rr_snapshot_d {
+	char magic[4];
+	u8 version;
+	u8 program_counter;
+	u8 status_register;
+	// Instruction register, low byte first
+	u8 instruction[2];
+	u8 operands[4];
+	u8 registers[16];
+	u8 memory[256];
+} rr_snapshot_t;
+
+// Where each frame of a stream being read starts
+typedef struct rr_snapshot_frame_d {
+	u64 cycle;
+	u64 offset;
+	// Index of the keyframe a restore of this frame starts from
+	u64 keyframe;
+} rr_snapshot_frame_t;
+
+typedef struct rr_snapshot_stream_d {
+	FILE *file;
+	u8 writing;
+	// Set once a write fails, reported by snapshot_stream_close
+	u8 error;
+	u32 keyframe_interval;
+	u32 since_keyframe;
+	// State of the last frame written, which the next delta is against
+	u8 previous[SNAPSHOT_STATE_SIZE];
+	// Frame index, built as frames are written or by scanning the stream when it is opened for reading
+	rr_snapshot_frame_t *frames;
+	u64 frame_count;
+	u64 frame_capacity;
+	u64 keyframe_count;
+	// Size of the stream so far
+	u64 bytes;
+} rr_snapshot_stream_t;
+
+// Copy the machine's state into a snapshot, and back - restoring returns 1 (leaving the machine alone) for a snapshot of another format or version
+void snapshot_take(rr_snapshot_t *snapshot, const rr_machine_t *machine);
+u8 snapshot_restore(rr_machine_t *machine, const rr_snapshot_t *snapshot);
+
+// Save/load the whole machine state to/from a snapshot file, returns 1 if the file can't be opened, 2 if it can't be written/read or 3 for a file that isn't a version SNAPSHOT_VERSION snapshot
+u8 machine_save_state(rr_machine_t *machine, const char *snapshot_filename);
+u8 machine_load_state(rr_machine_t *machine, const char *snapshot_filename);
+
+// Start a new stream, with a keyframe every keyframe_interval frames (0 for SNAPSHOT_DEFAULT_KEYFRAME_INTERVAL)
+rr_snapshot_stream_t *snapshot_stream_create(const char *stream_filename, u32 keyframe_interval);
+// Open a stream for snapshot_stream_seek, reading just the frame headers to index it - returns NULL if it can't be opened or isn't a stream
+// A frame cut short (by a writer that never finished) ends the stream there
+rr_snapshot_stream_t *snapshot_stream_open(const char *stream_filename);
+// Returns 1 if any write to the stream failed
+u8 snapshot_stream_close(rr_snapshot_stream_t *stream);
+
+// Add the machine's state as it is at the given cycle, which should be later than the last frame's - returns 1 if the write fails
+// Frames only store the bytes that changed since the frame before, apart from every keyframe_interval'th and any delta that would be no smaller
+u8 snapshot_stream_put(rr_snapshot_stream_t *stream, const rr_machine_t *machine, u64 cycle);
+
+// Restore the machine to the last frame at or before the given cycle, replaying deltas from the keyframe before it
+// Returns 1 if there is no such frame or the stream can't be read, found (which may be NULL) gets the cycle of the frame restored
+u8 snapshot_stream_seek(rr_snapshot_stream_t *stream, u64 cycle, rr_machine_t *machine, u64 *found);
+
+// Run full cycles like machine_run_fast, adding a frame to the stream before the first, after every interval cycles and at the end
+// Returns the number of cycles run, cycles in the stream count from 0 at the start of the run
+u64 machine_run_snapshots(rr_machine_t *machine, u64 max_cycles, u64 interval, rr_snapshot_stream_t *stream);
+
+#endif
\ No newline at end of file
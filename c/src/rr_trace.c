@@ -0,0 +1,237 @@
+#include "rr_trace.h"
+
+#if !defined(_WIN32)
+#include <sched.h>
+#endif
+
+// Let the other side of the ring catch up
+static void trace_wait(u8 writer) {
+	
+#if defined(_WIN32)
+	Sleep(writer);
+#else
+	if(writer)
+		msleep(1);
+	else
+		sched_yield();
+#endif
+	
+}
+
+// Write out records [from, to), in at most two pieces where the ring wraps around
+static void trace_write(rr_trace_t *trace, u64 from, u64 to) {
+	
+	while(from != to) {
+		
+		u64 start = from & TRACE_RING_MASK;
+		u64 count = to - from;
+		
+		if(count > TRACE_RING_RECORDS - start)
+			count = TRACE_RING_RECORDS - start;
+			
+		if(!atomic_load_explicit(&trace->error, memory_order_relaxed) && fwrite(&trace->ring[start], sizeof(rr_trace_record_t), count, trace->file) != count)
+			atomic_store_explicit(&trace->error, 1, memory_order_relaxed);
+			
+		from += count;
+		
+	}
+	
+}
+
+// Drain the ring to the file until the trace is closed - the file is unbuffered, so each piece goes out in a single large write
+#if defined(_WIN32)
+static DWORD WINAPI trace_writer(LPVOID argument) {
+#else
+static void *trace_writer(void *argument) {
+#endif
+	
+	rr_trace_t *trace = (rr_trace_t *)argument;
+	u64 drained = 0;
+	
+	while(1) {
+		
+		// Closing is read first, so everything handed over before it was set is still written
+		u8 closing = atomic_load_explicit(&trace->closing, memory_order_acquire);
+		u64 published = atomic_load_explicit(&trace->published, memory_order_acquire);
+		
+		if(published != drained) {
+			
+			trace_write(trace, drained, published);
+			drained = published;
+			atomic_store_explicit(&trace->drained, drained, memory_order_release);
+			
+		}
+		else if(closing)
+			break;
+		else
+			trace_wait(1);
+			
+	}
+	
+	return 0;
+	
+}
+
+rr_trace_t *trace_open(const char *trace_filename, const rr_machine_t *machine) {
+	
+	rr_trace_t *trace = (rr_trace_t *)calloc(1, sizeof(rr_trace_t));
+	rr_trace_header_t header;
+	
+	if(!trace)
+		return NULL;
+		
+	trace->ring = (rr_trace_record_t *)malloc(TRACE_RING_RECORDS * sizeof(rr_trace_record_t));
+	trace->file = fopen(trace_filename, "wb");
+	
+	if(!trace->ring || !trace->file) {
+		
+		if(trace->file)
+			fclose(trace->file);
+			
+		free(trace->ring);
+		free(trace);
+		
+		return NULL;
+		
+	}
+	
+	setvbuf(trace->file, NULL, _IONBF, 0);
+	
+	memcpy(header.magic, TRACE_MAGIC, 4);
+	header.version = TRACE_VERSION;
+	header.record_size = sizeof(rr_trace_record_t);
+	header.program_counter = machine->program_counter;
+	header.status_register = machine->status_register;
+	memcpy(header.registers, machine->registers, 16);
+	memcpy(header.memory, machine->memory, 256);
+	
+	if(fwrite(&header, sizeof(rr_trace_header_t), 1, trace->file) != 1)
+		trace->error = 1;
+		
+	atomic_init(&trace->published, 0);
+	atomic_init(&trace->drained, 0);
+	atomic_init(&trace->closing, 0);
+	
+	// Without the writer nothing would ever drain the ring, and trace_reserve would wait on it forever
+#if defined(_WIN32)
+	if(!(trace->writer = CreateThread(NULL, 0, trace_writer, trace, 0, NULL))) {
+#else
+	if(pthread_create(&trace->writer, NULL, trace_writer, trace)) {
+#endif
+		
+		fclose(trace->file);
+		remove(trace_filename);
+		free(trace->ring);
+		free(trace);
+		
+		return NULL;
+		
+	}
+	
+	return trace;
+	
+}
+
+u8 trace_close(rr_trace_t *trace) {
+	
+	u8 error;
+	
+	trace_publish(trace);
+	atomic_store_explicit(&trace->closing, 1, memory_order_release);
+	
+#if defined(_WIN32)
+	WaitForSingleObject(trace->writer, INFINITE);
+	CloseHandle(trace->writer);
+#else
+	pthread_join(trace->writer, NULL);
+#endif
+	
+	error = atomic_load(&trace->error);
+	
+	if(fclose(trace->file))
+		error = 1;
+		
+	free(trace->ring);
+	free(trace);
+	
+	return error;
+	
+}
+
+void trace_publish(rr_trace_t *trace) {
+	
+	atomic_store_explicit(&trace->published, trace->head, memory_order_release);
+	
+}
+
+void trace_reserve(rr_trace_t *trace) {
+	
+	trace_publish(trace);
+	
+	// Only the chunk about to be filled has to be free, the writer is usually far ahead of that
+	while(trace->head + TRACE_CHUNK_RECORDS - atomic_load_explicit(&trace->drained, memory_order_acquire) > TRACE_RING_RECORDS)
+		trace_wait(0);
+		
+	trace->limit = trace->head + TRACE_CHUNK_RECORDS;
+	
+}
+
+u8 trace_written(const rr_machine_t *machine, u8 *location) {
+	
+	switch(machine->operands[0]) {
+		
+		case 0x0:
+		case 0xD:
+		case 0xE:
+		case 0xF:
+			*location = 0;
+			return TRACE_WRITE_NONE;
+			
+		case 0x8:
+			*location = machine->operands[2];
+			return TRACE_WRITE_MEMORY;
+			
+		case 0x9:
+			*location = REG(machine, machine->operands[2]);
+			return TRACE_WRITE_MEMORY;
+			
+		// Pushes write just above the stack pointer they leave behind
+		case 0xA:
+		case 0xC:
+			*location = STACK_POINTER(machine) + 1;
+			return TRACE_WRITE_MEMORY;
+			
+		default:
+			*location = machine->operands[1];
+			return TRACE_WRITE_REGISTER;
+			
+	}
+	
+}
+
+void trace_put_machine(rr_trace_t *trace, u8 pc, const rr_machine_t *machine) {
+	
+	u8 location;
+	u8 kind = trace_written(machine, &location);
+	
+	trace_put(trace, pc, machine->instruction_register, machine->status_register, STACK_POINTER(machine), kind, location, kind == TRACE_WRITE_NONE ? 0 : kind == TRACE_WRITE_REGISTER ? REG(machine, location) : MEM(machine, location));
+	
+}
+
+u8 trace_read_header(FILE *file, rr_trace_header_t *header) {
+	
+	if(fread(header, sizeof(rr_trace_header_t), 1, file) != 1)
+		return 1;
+		
+	if(memcmp(header->magic, TRACE_MAGIC, 4) || header->version != TRACE_VERSION || header->record_size != sizeof(rr_trace_record_t))
+		return 2;
+		
+	return 0;
+	
+}
+
+u32 trace_read_records(FILE *file, rr_trace_record_t *records, u32 count) {
+	
+	return fread(records, sizeof(rr_trace_record_t), count, file);
+	
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef RR_TRACE_H
+#define RR_TRACE_H
+
+#include "rr_machine.h"
+
+#include <stdatomic.h>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+// Trace file layout - a header holding the machine state the trace starts from, followed by one fixed-width record per cycle
+#define TRACE_MAGIC "RRTR"
+#define TRACE_VERSION 1
+
+// Records in the ring between the running machine and the writer thread (16MB), and how many the machine fills before handing them over
+#define TRACE_RING_RECORDS (1 << 21)
+#define TRACE_RING_MASK (TRACE_RING_RECORDS - 1)
+#define TRACE_CHUNK_RECORDS (1 << 15)
+
+// What a cycle wrote besides the program counter, flags and stack pointer
+#define TRACE_WRITE_NONE 0
+#define TRACE_WRITE_REGISTER 1
+#define TRACE_WRITE_MEMORY 2
+
+// One executed cycle, all single bytes so the file reads the same on any machine
+typedef struct rr_trace_record_d {
+	// Address of the instruction and its two bytes as they were in memory (operands are decoded from these)
+	u8 program_counter;
+	u8 instruction[2];
+	// Status register after the cycle, the state bits are only set for HLT
+	u8 status_register;
+	// Stack pointer after the cycle
+	u8 stack_pointer;
+	u8 kind;
+	// Register number or memory address written, and the value written there
+	u8 location;
+	u8 value;
+} rr_trace_record_t;
+
+typedef struct rr_trace_header_d {
+	char magic[4];
+	u8 version;
+	// sizeof(rr_trace_record_t)
+	u8 record_size;
+	// Machine state when the trace was opened
+	u8 program_counter;
+	u8 status_register;
+	u8 registers[16];
+	u8 memory[256];
+} rr_trace_header_t;
+
+// Records are filled in by the running machine and written out by a background thread, with no locks between them
+// The machine only touches shared state once per chunk, handing over everything up to head and making sure the next chunk is free
+typedef struct rr_trace_d {
+	rr_trace_record_t *ring;
+	// Written by the machine only - the next record to fill and where the current chunk ends
+	u64 head;
+	u64 limit;
+	// Records handed over to the writer, and records it has written out
+	_Alignas(64) _Atomic u64 published;
+	_Alignas(64) _Atomic u64 drained;
+	_Atomic u8 closing;
+	// Set by the writer when the file could not be written, records are then dropped so the machine never waits forever
+	_Atomic u8 error;
+	FILE *file;
+#if defined(_WIN32)
+	HANDLE writer;
+#else
+	pthread_t writer;
+#endif
+} rr_trace_t;
+
+// Create the trace file, write the machine's current state as its header and start the writer thread, returns NULL on failure (the writer thread not starting included)
+rr_trace_t *trace_open(const char *trace_filename, const rr_machine_t *machine);
+
+// Write out everything recorded, stop the writer and close the file - returns 1 if anything could not be written
+u8 trace_close(rr_trace_t *trace);
+
+// Hand over the records filled so far and wait for room for another chunk (called when head reaches limit)
+void trace_reserve(rr_trace_t *trace);
+
+// Hand over the records filled so far without waiting
+void trace_publish(rr_trace_t *trace);
+
+// Record one executed cycle - the instruction run from address pc, the flags and stack pointer it left behind and what it wrote
+static inline void trace_put(rr_trace_t *trace, u8 pc, u16 instruction, u8 flags, u8 stack_pointer, u8 kind, u8 location, u8 value) {
+	
+	// Built up in a local and stored in one go - stores through the ring's byte fields could alias anything, forcing the interpreter to reload its state after each one
+	rr_trace_record_t record;
+	
+	if(trace->head == trace->limit)
+		trace_reserve(trace);
+		
+	record.program_counter = pc;
+	record.instruction[0] = instruction >> 8;
+	record.instruction[1] = instruction & 0xFF;
+	record.status_register = flags;
+	record.stack_pointer = stack_pointer;
+	record.kind = kind;
+	record.location = location;
+	record.value = value;
+	
+	trace->ring[trace->head++ & TRACE_RING_MASK] = record;
+	
+}
+
+// Work out what the instruction the machine has just run wrote from its operands - returns TRACE_WRITE_* with the register or address in location
+u8 trace_written(const rr_machine_t *machine, u8 *location);
+
+// Record the cycle the machine has just run from address pc, working out what it wrote from the instruction
+void trace_put_machine(rr_trace_t *trace, u8 pc, const rr_machine_t *machine);
+
+// Run full cycles like machine_run_fast, recording every one of them to the trace
+// A machine partway through a cycle finishes it first, recorded the same way
+u64 machine_run_trace(rr_machine_t *machine, u64 max_cycles, rr_trace_t *trace);
+
+// Reading traces back - check and read the header, then read up to count records at a time (returns the number read)
+u8 trace_read_header(FILE *file, rr_trace_header_t *header);
+u32 trace_read_records(FILE *file, rr_trace_record_t *records, u32 count);
+
+#endif
\ No newline at end of file